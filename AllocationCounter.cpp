@@ -0,0 +1,104 @@
+#include "AllocationCounter.h"
+#include "MemoryTracker.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> sAllocations(0);
+
+// Every block starts with its size and category, so freeing can take them off the right counter.
+// Padded to the alignment operator new guarantees, which the user part keeps
+struct Header {
+	size_t size;
+	MemoryCategory category;
+};
+
+const size_t HEADER_SIZE = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+static_assert(sizeof(Header) <= HEADER_SIZE, "Allocation header doesn't fit in its padding");
+
+static void* TrackedAllocate(size_t size, MemoryCategory category) {
+	unsigned char* block = static_cast<unsigned char*>(std::malloc(HEADER_SIZE + size));
+	if (!block) {
+		return nullptr;
+	}
+
+	sAllocations.fetch_add(1, std::memory_order_relaxed);
+	MemoryTracker::OnAllocate(category, size);
+	*reinterpret_cast<Header*>(block) = { size, category };
+	return block + HEADER_SIZE;
+}
+
+static void TrackedFree(void* p) {
+	if (!p) {
+		return;
+	}
+
+	unsigned char* block = static_cast<unsigned char*>(p) - HEADER_SIZE;
+	const Header& header = *reinterpret_cast<Header*>(block);
+	MemoryTracker::OnFree(header.category, header.size);
+	std::free(block);
+}
+
+uint64_t AllocationCounter::GetCount() {
+	return sAllocations.load(std::memory_order_relaxed);
+}
+
+// ImGui only runs inside the editor, whatever scope it happens to be called from
+void* AllocationCounter::Allocate(size_t size, void* userData) {
+	return TrackedAllocate(size, MemoryCategory::EDITOR);
+}
+
+void AllocationCounter::Free(void* p, void* userData) {
+	TrackedFree(p);
+}
+
+static void* CountedNew(size_t size) {
+	void* p = TrackedAllocate(size, MemoryTracker::GetCurrentCategory());
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+// Replacements of the global allocation functions. Over-aligned types go through the aligned
+// overloads, which keep their default implementation and aren't counted
+void* operator new(size_t size) {
+	return CountedNew(size);
+}
+
+void* operator new[](size_t size) {
+	return CountedNew(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	return TrackedAllocate(size, MemoryTracker::GetCurrentCategory());
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+	return TrackedAllocate(size, MemoryTracker::GetCurrentCategory());
+}
+
+void operator delete(void* p) noexcept {
+	TrackedFree(p);
+}
+
+void operator delete[](void* p) noexcept {
+	TrackedFree(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	TrackedFree(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+	TrackedFree(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+	TrackedFree(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+	TrackedFree(p);
+}
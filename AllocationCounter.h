@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Counts heap allocations: global operator new of this program is replaced to count every call, and ImGui
+// is pointed at Allocate/Free. Comparing the count across a frame shows whether the frame allocated.
+// Sizes go to MemoryTracker, under the thread's MemoryScope (always EDITOR for ImGui). Allocations inside the driver, GLFW or irrKlang use their own heaps and aren't seen
+class AllocationCounter
+{
+public:
+	// Allocations since startup, on any thread
+	static uint64_t GetCount();
+
+	// For ImGui::SetAllocatorFunctions
+	static void* Allocate(size_t size, void* userData);
+	static void Free(void* p, void* userData);
+};
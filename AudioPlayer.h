@@ -34,7 +34,7 @@ public:
 		std::cout << mSoundEngine->setMixedDataOutputReceiver(mSoundData) << '\n';
 	}
 
-	std::unordered_map<std::string, std::string> GetSongs() {
+	const std::unordered_map<std::string, std::string>& GetSongs() const {
 		return mSongs;
 	};
 
@@ -0,0 +1,48 @@
+#include "Bloom.h"
+#include "GLState.h"
+
+Bloom::Bloom(int mipCount) : mThreshold(1.0f), mKnee(0.5f), mFilterRadius(0.005f), mMipCount(mipCount),
+	mDownsampleShader(new Shader("ScreenShader.vert", "BloomDownsample.frag")),
+	mUpsampleShader(new Shader("ScreenShader.vert", "BloomUpsample.frag"))
+{
+	mDownsampleShader->Use();
+	mDownsampleShader->SetInt("srcTexture", 0);
+	mUpsampleShader->Use();
+	mUpsampleShader->SetInt("srcTexture", 0);
+}
+
+Bloom::~Bloom() {
+	delete mDownsampleShader;
+	delete mUpsampleShader;
+}
+
+int Bloom::GetMipCount() {
+	return mMipCount;
+}
+
+void Bloom::Downsample(GLuint srcTexture, bool firstPass, QuadMesh* pQuadMesh) {
+	mDownsampleShader->Use();
+	mDownsampleShader->SetFloat("threshold", mThreshold);
+	mDownsampleShader->SetFloat("knee", mKnee);
+	mDownsampleShader->SetInt("firstPass", firstPass);
+
+	pQuadMesh->BindVAO();
+	GLState::ActiveTexture(GL_TEXTURE0);
+	GLState::BindTexture(GL_TEXTURE_2D, srcTexture);
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+}
+
+void Bloom::Upsample(GLuint srcTexture, QuadMesh* pQuadMesh) {
+	mUpsampleShader->Use();
+	mUpsampleShader->SetFloat("filterRadius", mFilterRadius);
+
+	pQuadMesh->BindVAO();
+	GLState::ActiveTexture(GL_TEXTURE0);
+	GLState::BindTexture(GL_TEXTURE_2D, srcTexture);
+
+	GLState::Enable(GL_BLEND);
+	GLState::BlendFunc(GL_ONE, GL_ONE);
+	GLState::BlendEquation(GL_FUNC_ADD);
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+	GLState::Disable(GL_BLEND);
+}
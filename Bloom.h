@@ -0,0 +1,35 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "Shader.h"
+#include "QuadMesh.h"
+
+// Physically based bloom (Jimenez, "Next Generation Post Processing in Call of Duty: Advanced Warfare").
+// The HDR image is progressively downsampled with a 13-tap filter into a mip chain starting at half
+// resolution, then upsampled back with a 3x3 tent filter, adding each level onto the next larger one.
+// The mip chain is transient and owned by the frame graph; each level is one pass drawn into the bound target.
+class Bloom
+{
+public:
+	Bloom(int mipCount = 6);
+	~Bloom();
+
+	int GetMipCount();
+
+	// Draws the next smaller level. The first pass also applies the threshold and a Karis average against fireflies
+	void Downsample(GLuint srcTexture, bool firstPass, QuadMesh* pQuadMesh);
+
+	// Blurs a level and adds it onto the next larger one (the bound target)
+	void Upsample(GLuint srcTexture, QuadMesh* pQuadMesh);
+
+	// Brightness where bloom starts, and the width of the soft transition around it
+	float mThreshold, mKnee;
+
+	// Tent filter radius in UV units of each upsampled level
+	float mFilterRadius;
+
+private:
+	int mMipCount;
+	Shader* mDownsampleShader, *mUpsampleShader;
+};
@@ -0,0 +1,34 @@
+#version 330 core
+out vec3 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D srcTexture;
+uniform float filterRadius;
+
+// 3x3 tent filter:
+//  1   | 1 2 1 |
+// -- * | 2 4 2 |
+// 16   | 1 2 1 |
+void main()
+{
+	float x = filterRadius;
+	float y = filterRadius;
+
+	vec3 a = texture(srcTexture, vec2(TexCoords.x - x, TexCoords.y + y)).rgb;
+	vec3 b = texture(srcTexture, vec2(TexCoords.x,     TexCoords.y + y)).rgb;
+	vec3 c = texture(srcTexture, vec2(TexCoords.x + x, TexCoords.y + y)).rgb;
+
+	vec3 d = texture(srcTexture, vec2(TexCoords.x - x, TexCoords.y)).rgb;
+	vec3 e = texture(srcTexture, vec2(TexCoords.x,     TexCoords.y)).rgb;
+	vec3 f = texture(srcTexture, vec2(TexCoords.x + x, TexCoords.y)).rgb;
+
+	vec3 g = texture(srcTexture, vec2(TexCoords.x - x, TexCoords.y - y)).rgb;
+	vec3 h = texture(srcTexture, vec2(TexCoords.x,     TexCoords.y - y)).rgb;
+	vec3 i = texture(srcTexture, vec2(TexCoords.x + x, TexCoords.y - y)).rgb;
+
+	vec3 color = e * 4.0;
+	color += (b + d + f + h) * 2.0;
+	color += (a + c + g + i);
+	FragColor = color * (1.0 / 16.0);
+}
@@ -0,0 +1,62 @@
+#include "CommandBuffer.h"
+
+void CommandBuffer::Clear() {
+	mData.clear();
+	mCount = 0;
+}
+
+void CommandBuffer::BindProgram(Shader* shader) {
+	Push<BindProgramCommand>().shader = shader;
+}
+
+void CommandBuffer::SetMat4(GLint location, const glm::mat4& value) {
+	if (location == -1) {
+		return;
+	}
+	SetMat4Command& command = Push<SetMat4Command>();
+	command.location = location;
+	command.value = value;
+}
+
+void CommandBuffer::SetVec3(GLint location, const glm::vec3& value) {
+	if (location == -1) {
+		return;
+	}
+	SetVec3Command& command = Push<SetVec3Command>();
+	command.location = location;
+	command.value = value;
+}
+
+void CommandBuffer::SetFloat(GLint location, GLfloat value) {
+	if (location == -1) {
+		return;
+	}
+	SetFloatCommand& command = Push<SetFloatCommand>();
+	command.location = location;
+	command.value = value;
+}
+
+void CommandBuffer::SetInt(GLint location, GLint value) {
+	if (location == -1) {
+		return;
+	}
+	SetIntCommand& command = Push<SetIntCommand>();
+	command.location = location;
+	command.value = value;
+}
+
+void CommandBuffer::BindTextures(TexturePack* texturePack) {
+	Push<BindTexturesCommand>().texturePack = texturePack;
+}
+
+void CommandBuffer::SetStencil(GLenum func, GLint ref, GLuint mask, GLuint writeMask) {
+	SetStencilCommand& command = Push<SetStencilCommand>();
+	command.func = func;
+	command.ref = ref;
+	command.mask = mask;
+	command.writeMask = writeMask;
+}
+
+void CommandBuffer::Draw(unsigned int mesh) {
+	Push<DrawCommand>().mesh = mesh;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+class Shader;
+struct TexturePack;
+
+enum class CommandType : uint32_t {
+	BIND_PROGRAM,
+	SET_MAT4,
+	SET_VEC3,
+	SET_FLOAT,
+	SET_INT,
+	BIND_TEXTURES,
+	SET_STENCIL,
+	DRAW,
+	NUM
+};
+
+// Every command starts with its type and its size in the buffer, so a reader can step to the next one
+struct CommandHeader {
+	CommandType type;
+	uint32_t size;
+};
+
+struct BindProgramCommand {
+	static const CommandType TYPE = CommandType::BIND_PROGRAM;
+	CommandHeader header;
+	Shader* shader;
+};
+
+// Uniforms of the program bound by the last BIND_PROGRAM, by location resolved before recording
+struct SetMat4Command {
+	static const CommandType TYPE = CommandType::SET_MAT4;
+	CommandHeader header;
+	GLint location;
+	glm::mat4 value;
+};
+
+struct SetVec3Command {
+	static const CommandType TYPE = CommandType::SET_VEC3;
+	CommandHeader header;
+	GLint location;
+	glm::vec3 value;
+};
+
+struct SetFloatCommand {
+	static const CommandType TYPE = CommandType::SET_FLOAT;
+	CommandHeader header;
+	GLint location;
+	GLfloat value;
+};
+
+struct SetIntCommand {
+	static const CommandType TYPE = CommandType::SET_INT;
+	CommandHeader header;
+	GLint location;
+	GLint value;
+};
+
+// The pack's maps on units 0 to 5
+struct BindTexturesCommand {
+	static const CommandType TYPE = CommandType::BIND_TEXTURES;
+	CommandHeader header;
+	TexturePack* texturePack;
+};
+
+struct SetStencilCommand {
+	static const CommandType TYPE = CommandType::SET_STENCIL;
+	CommandHeader header;
+	GLenum func;
+	GLint ref;
+	GLuint mask;
+	GLuint writeMask;
+};
+
+// One of the renderer's shape meshes, by mesh id
+struct DrawCommand {
+	static const CommandType TYPE = CommandType::DRAW;
+	CommandHeader header;
+	unsigned int mesh;
+};
+
+// Draw commands recorded without GL, so any thread can build one, and replayed later on the GL thread.
+// Commands are plain structs packed one after the other in a byte buffer that only grows: Clear keeps
+// the memory, so a buffer recorded every frame stops allocating once it has seen its largest frame
+class CommandBuffer
+{
+public:
+	static const size_t ALIGNMENT = 8;
+
+	void Clear();
+
+	// Uniforms that aren't active in the program (location -1) are left out
+	void BindProgram(Shader* shader);
+	void SetMat4(GLint location, const glm::mat4& value);
+	void SetVec3(GLint location, const glm::vec3& value);
+	void SetFloat(GLint location, GLfloat value);
+	void SetInt(GLint location, GLint value);
+	void BindTextures(TexturePack* texturePack);
+	void SetStencil(GLenum func, GLint ref, GLuint mask, GLuint writeMask);
+	void Draw(unsigned int mesh);
+
+	// Walk from begin to end, each command's header.size on from the last
+	const unsigned char* begin() const { return mData.data(); }
+	const unsigned char* end() const { return mData.data() + mData.size(); }
+
+	int GetCount() const { return mCount; }
+	size_t GetSize() const { return mData.size(); }
+
+private:
+	template <typename T>
+	T& Push() {
+		static_assert(alignof(T) <= ALIGNMENT, "Command needs a larger alignment than the buffer gives");
+		const uint32_t size = static_cast<uint32_t>((sizeof(T) + ALIGNMENT - 1) & ~(ALIGNMENT - 1));
+		size_t offset = mData.size();
+		mData.resize(offset + size);
+		mCount++;
+
+		T& command = *reinterpret_cast<T*>(mData.data() + offset);
+		command.header = { T::TYPE, size };
+		return command;
+	}
+
+	// new[] storage is aligned for any fundamental type, and every command size is a multiple of ALIGNMENT
+	std::vector<unsigned char> mData;
+	int mCount = 0;
+};
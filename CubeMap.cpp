@@ -1,16 +1,21 @@
 #include "Cubemap.h"
+#include "GLState.h"
+#include "MemoryTracker.h"
 
 Cubemap::Cubemap(std::vector<std::string>& faces) : ID(0) {
+    MemoryScope memoryScope(MemoryCategory::TEXTURES);
     glGenTextures(1, &ID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, ID);
+    GLState::BindTexture(GL_TEXTURE_CUBE_MAP, ID);
 
     int width, height, nrChannels;
+    size_t bytes = 0;
 
     for (unsigned int i = 0; i < faces.size(); i++) {
         unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
 
         if (data) {
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+            bytes += MemoryTracker::GetTextureBytes(GL_RGB, width, height);
             stbi_image_free(data);
         }
         else
@@ -25,8 +30,13 @@ Cubemap::Cubemap(std::vector<std::string>& faces) : ID(0) {
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    MemoryTracker::TrackGPU(GPUObject::TEXTURE, ID, bytes);
+}
+
+Cubemap::~Cubemap() {
+    GLState::DeleteTextures(1, &ID);
 }
 
 void Cubemap::Bind() {
-    glBindTexture(GL_TEXTURE_CUBE_MAP, ID);
+    GLState::BindTexture(GL_TEXTURE_CUBE_MAP, ID);
 }
\ No newline at end of file
@@ -13,6 +13,9 @@
 class Cubemap {
 public:
     Cubemap(std::vector<std::string>& faces);
+    ~Cubemap();
+    Cubemap(const Cubemap&) = delete;
+    Cubemap& operator=(const Cubemap&) = delete;
     void Bind();
 
 private:
@@ -23,11 +23,49 @@ uniform int numberOfLights;
 
 uniform vec3 viewPos;
 
+// Split-sum IBL: L2 spherical harmonics irradiance for diffuse, prefiltered environment and BRDF LUT for specular
+layout(std140) uniform IrradianceSH {
+	vec4 shCoefficients[9];
+};
+uniform samplerCube prefilterMap;
+uniform sampler2D brdfLUT;
+uniform float prefilterMaxLod;
+uniform bool iblOn;
+
 // Position of only one light source for now (named "Light Source")
 uniform vec3 lightPos;
 uniform float farPlane;
+uniform float nearPlane;
+
+// Shadow filters, same order as ShadowFilter in Renderer.h
+const int SHADOW_HARD = 0;
+const int SHADOW_HARDWARE_PCF = 1;
+const int SHADOW_PCF = 2;
+const int SHADOW_POISSON_PCF = 3;
+const int SHADOW_PCSS = 4;
+
+// Sample offsets precomputed on the CPU (Renderer::SetupShadowSamples)
+layout (std140) uniform ShadowSamples {
+	vec4 pcfOffsets[20];
+	vec4 poissonDisk[32];
+	ivec4 sampleCounts; // x: fixed PCF, y: Poisson PCF, z: PCSS blocker search
+};
 
+// Same cube map bound twice: raw depths for blocker search, comparison sampler for filtering
 uniform samplerCube shadowDepthCubeMap;
+uniform samplerCubeShadow shadowCompareCubeMap;
+
+uniform int shadowFilter;
+uniform float shadowBias;
+uniform float shadowFilterRadius;
+uniform float shadowLightSize;
+
+// Screen-space AO (occlusion, view depth) at 1/ssaoScale of the G-Buffer resolution, multiplied into the ambient term
+uniform bool ssaoOn;
+uniform sampler2D ssaoTexture;
+uniform int ssaoScale;
+uniform vec2 ssaoSize;
+uniform mat4 view;
 
 const float PI = 3.14159265359;
 
@@ -58,24 +96,142 @@ vec3 FresnelSchlick(float cosTheta, vec3 F0)
 	return F0 + (1.0 - F0) * pow(1.0 - cosTheta, 5.0);
 }
 
+// Irradiance (already divided by PI) from the SH coefficients, the cosine convolution is baked in on the CPU
+vec3 IrradianceSHEval(vec3 n)
+{
+	vec3 irradiance = shCoefficients[0].rgb * 0.282095
+		+ shCoefficients[1].rgb * 0.488603 * n.y
+		+ shCoefficients[2].rgb * 0.488603 * n.z
+		+ shCoefficients[3].rgb * 0.488603 * n.x
+		+ shCoefficients[4].rgb * 1.092548 * n.x * n.y
+		+ shCoefficients[5].rgb * 1.092548 * n.y * n.z
+		+ shCoefficients[6].rgb * 0.315392 * (3.0 * n.z * n.z - 1.0)
+		+ shCoefficients[7].rgb * 1.092548 * n.x * n.z
+		+ shCoefficients[8].rgb * 0.546274 * (n.x * n.x - n.y * n.y);
+	// L2 ringing can dip below zero around small, very bright lights
+	return max(irradiance, vec3(0.0));
+}
+
+// Rough surfaces reflect less at grazing angles, used for the ambient term
+vec3 FresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness)
+{
+	return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+}
+
+// Per-pixel rotation for the Poisson disk, turns banding into fine noise
+float InterleavedGradientNoise(vec2 p) {
+	return fract(52.9829189 * fract(dot(p, vec2(0.06711056, 0.00583715))));
+}
+
+// Returns 1 if lit. Filtered over 2x2 texels by the comparison sampler
+float CompareDepth(vec3 sampleDir, float currentDepth) {
+	return texture(shadowCompareCubeMap, vec4(sampleDir, (currentDepth - shadowBias) / farPlane));
+}
+
+// Basis perpendicular to the sample direction, to spread 2D disk samples over the cube map
+void ShadowBasis(vec3 dir, out vec3 T, out vec3 B) {
+	vec3 up = abs(dir.y) < 0.999 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+	T = normalize(cross(up, dir));
+	B = cross(dir, T);
+}
+
+float PoissonPCF(vec3 fragToLight, float currentDepth, float radius, vec3 T, vec3 B, mat2 rotation) {
+	float lit = 0.0;
+	for (int i = 0; i < sampleCounts.y; i++) {
+		vec2 offset = rotation * poissonDisk[i].xy * radius;
+		lit += CompareDepth(fragToLight + T * offset.x + B * offset.y, currentDepth);
+	}
+	return 1.0 - lit / float(sampleCounts.y);
+}
+
 float ShadowCalculation(vec3 fragPos) {
 	vec3 fragToLight = fragPos - lightPos;
-	float closestDepth = texture(shadowDepthCubeMap, fragToLight).r;
-	closestDepth *= farPlane;
 	float currentDepth = length(fragToLight);
-	float bias = 0.05f;
-	float shadow = currentDepth - bias > closestDepth ? 1.0 : 0.0;
-	return shadow;
+
+	if (shadowFilter == SHADOW_HARD) {
+		float closestDepth = texture(shadowDepthCubeMap, fragToLight).r * farPlane;
+		return currentDepth - shadowBias > closestDepth ? 1.0 : 0.0;
+	}
+
+	if (shadowFilter == SHADOW_HARDWARE_PCF) {
+		return 1.0 - CompareDepth(fragToLight, currentDepth);
+	}
+
+	if (shadowFilter == SHADOW_PCF) {
+		float lit = 0.0;
+		for (int i = 0; i < sampleCounts.x; i++) {
+			lit += CompareDepth(fragToLight + pcfOffsets[i].xyz * shadowFilterRadius, currentDepth);
+		}
+		return 1.0 - lit / float(sampleCounts.x);
+	}
+
+	vec3 T, B;
+	ShadowBasis(fragToLight / currentDepth, T, B);
+	float angle = 2.0 * PI * InterleavedGradientNoise(gl_FragCoord.xy);
+	mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+
+	if (shadowFilter == SHADOW_POISSON_PCF) {
+		return PoissonPCF(fragToLight, currentDepth, shadowFilterRadius, T, B, rotation);
+	}
+
+	// PCSS: find the average blocker depth in the region of the shadow map that can see the light
+	float searchRadius = shadowLightSize * (currentDepth - nearPlane) / currentDepth;
+	float blockerDepth = 0.0;
+	int blockers = 0;
+	for (int i = 0; i < sampleCounts.z; i++) {
+		vec2 offset = rotation * poissonDisk[i].xy * searchRadius;
+		float sampleDepth = texture(shadowDepthCubeMap, fragToLight + T * offset.x + B * offset.y).r * farPlane;
+		if (sampleDepth < currentDepth - shadowBias) {
+			blockerDepth += sampleDepth;
+			blockers++;
+		}
+	}
+
+	if (blockers == 0) {
+		return 0.0;
+	}
+
+	// Penumbra grows with the receiver's distance behind the blocker
+	blockerDepth /= float(blockers);
+	float penumbra = (currentDepth - blockerDepth) * shadowLightSize / blockerDepth;
+	return PoissonPCF(fragToLight, currentDepth, max(penumbra, 0.002), T, B, rotation);
+}
+
+// Bilateral upsample: bilinear weights over the 4 nearest SSAO texels, scaled down for texels at another depth
+float SSAOUpsample(ivec2 pixel, float depth) {
+	if (ssaoScale == 1) {
+		return texelFetch(ssaoTexture, pixel, 0).r;
+	}
+
+	vec2 lowResPos = (vec2(pixel) + 0.5) / float(ssaoScale) - 0.5;
+	ivec2 base = ivec2(floor(lowResPos));
+	vec2 f = fract(lowResPos);
+
+	float occlusion = 0.0;
+	float weightSum = 0.0;
+	for (int i = 0; i < 4; i++) {
+		ivec2 offset = ivec2(i & 1, i >> 1);
+		ivec2 texel = clamp(base + offset, ivec2(0), ivec2(ssaoSize) - 1);
+		vec2 ssao = texelFetch(ssaoTexture, texel, 0).rg;
+		vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+		float weight = bilinear.x * bilinear.y / (0.001 + abs(depth - ssao.g) / max(depth, 0.001));
+		occlusion += ssao.r * weight;
+		weightSum += weight;
+	}
+	return weightSum > 0.0 ? occlusion / weightSum : 1.0;
 }
 
 void main() {
 
-	vec3 FragPos = texture(gPosition, TexCoords).rgb;
-	vec3 N = texture(gNormal, TexCoords).rgb;
-	vec3 albedo = texture(gAlbedo, TexCoords).rgb;
-	float roughness = texture(gRoughMetalAO, TexCoords).r;
-	float metalness = texture(gRoughMetalAO, TexCoords).g;
-	float ao = texture(gRoughMetalAO, TexCoords).b;
+	// G-Buffer and output share size and viewport, so this stays right when only part of them is rendered to
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	vec3 FragPos = texelFetch(gPosition, pixel, 0).rgb;
+	vec3 N = texelFetch(gNormal, pixel, 0).rgb;
+	vec3 albedo = texelFetch(gAlbedo, pixel, 0).rgb;
+	vec3 roughMetalAO = texelFetch(gRoughMetalAO, pixel, 0).rgb;
+	float roughness = roughMetalAO.r;
+	float metalness = roughMetalAO.g;
+	float ao = roughMetalAO.b;
 
 	vec3 V = normalize(viewPos - FragPos);
 	vec3 F0 = vec3(0.4);
@@ -110,7 +266,28 @@ void main() {
 		Lo += (kD * albedo / PI + specular) * radiance * NdotL; 
 	}
 
-	vec3 ambient = vec3(0.03) * albedo * ao;// * texture(myTexture, TexCoords).rgb;
+	vec3 ambient;
+
+	if (iblOn) {
+		float NdotV = max(dot(N, V), 0.0);
+		vec3 kS = FresnelSchlickRoughness(NdotV, F0, roughness);
+		vec3 kD = (1.0 - kS) * (1.0 - metalness);
+		vec3 diffuse = IrradianceSHEval(N) * albedo;
+
+		vec3 R = reflect(-V, N);
+		vec3 prefilteredColor = textureLod(prefilterMap, R, roughness * prefilterMaxLod).rgb;
+		vec2 envBRDF = texture(brdfLUT, vec2(NdotV, roughness)).rg;
+		vec3 specular = prefilteredColor * (kS * envBRDF.x + envBRDF.y);
+
+		ambient = (kD * diffuse + specular) * ao;
+	}
+	else {
+		ambient = vec3(0.03) * albedo * ao;
+	}
+
+	if (ssaoOn) {
+		ambient *= SSAOUpsample(pixel, -(view * vec4(FragPos, 1.0)).z);
+	}
 
 	float shadow  = ShadowCalculation(FragPos);
 
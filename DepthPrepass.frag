@@ -0,0 +1,5 @@
+#version 330 core
+
+// Depth only, the pre-pass has no color targets
+void main() {
+}
@@ -0,0 +1,19 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+// Same expression as the forward vertex shaders, and invariant in all of them,
+// so the forward pass produces bit-identical depth for its equal depth test
+invariant gl_Position;
+
+// Built with INDIRECT for IndirectBatch, which feeds each object's model matrix as an instanced attribute
+#ifdef INDIRECT
+layout (location = 5) in mat4 model;
+#else
+uniform mat4 model;
+#endif
+uniform mat4 view;
+uniform mat4 proj;
+
+void main() {
+	gl_Position = proj * view * model * vec4(aPos, 1.0);
+}
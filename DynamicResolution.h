@@ -0,0 +1,47 @@
+#pragma once
+
+#include <algorithm>
+
+// Picks the fraction of the window resolution the scene is rendered at, so the GPU frame time
+// stays at a target. Incremental PID controller on the relative frame time error: the integral
+// term does most of the work, proportional and derivative terms react to sudden spikes.
+// GPU timings arrive a few frames late and smoothed, so the gains are kept small to avoid oscillating.
+class DynamicResolution
+{
+public:
+	DynamicResolution() : mTargetFrameTime(16.6f), mMinScale(0.5f), mKp(0.05f), mKi(0.02f), mKd(0.01f),
+		mScale(1.0f), mLastError(0.0f), mPrevError(0.0f) {}
+
+	// Feeds the latest GPU frame time in ms and returns the new scale
+	float Update(float gpuFrameTime) {
+		if (gpuFrameTime <= 0.0f) {
+			return mScale;
+		}
+
+		// Positive when there is time to spare
+		float error = (mTargetFrameTime - gpuFrameTime) / mTargetFrameTime;
+		float delta = mKp * (error - mLastError) + mKi * error + mKd * (error - 2.0f * mLastError + mPrevError);
+
+		mScale = std::clamp(mScale + delta, mMinScale, 1.0f);
+		mPrevError = mLastError;
+		mLastError = error;
+		return mScale;
+	}
+
+	void Reset() {
+		mScale = 1.0f;
+		mLastError = 0.0f;
+		mPrevError = 0.0f;
+	}
+
+	float GetScale() { return mScale; }
+
+	// Frame time to aim for in ms and the lowest scale the controller may pick
+	float mTargetFrameTime, mMinScale;
+
+	float mKp, mKi, mKd;
+
+private:
+	float mScale;
+	float mLastError, mPrevError;
+};
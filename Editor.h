@@ -5,21 +5,31 @@
 #include "imgui/imgui_impl_glfw.h"
 
 #include "Renderer.h"
+#include "GLState.h"
 #include "ResourceManager.h"
 #include "AudioPlayer.h"
 #include "Camera.h"
+#include "AllocationCounter.h"
+#include "MemoryTracker.h"
+#include "FrameArena.h"
 
 class Editor
 {
 public:
 	Editor(GLFWwindow* window) {
 		IMGUI_CHECKVERSION();
+
+		// ImGui allocates with malloc otherwise, which the allocation counter wouldn't see
+		ImGui::SetAllocatorFunctions(AllocationCounter::Allocate, AllocationCounter::Free);
 		ImGui::CreateContext();
 		ImGuiIO& io = ImGui::GetIO(); (void)io;
 		ImGui::StyleColorsDark();
 		ImGui_ImplGlfw_InitForOpenGL(window, true);
 		ImGui_ImplOpenGL3_Init("#version 330");
 
+		// Created while the context is current here, so Update never needs GL and can run off the render thread
+		ImGui_ImplOpenGL3_CreateDeviceObjects();
+
 		// UI coloring
 		ImGuiStyle& style = ImGui::GetStyle();
 		style.Colors[ImGuiCol_Header] = ImColor(200, 100, 0);
@@ -53,7 +63,15 @@ public:
 		ImGui::DestroyContext();
 	}
 
+	// Builds the UI and applies its edits. Needs no GL, the draw data is rendered by Render
 	void Update(Renderer* pRenderer, ResourceManager* pResourceManager, AudioPlayer* pAudioHandler, Camera* pCamera) {
+		MemoryScope memoryScope(MemoryCategory::EDITOR);
+
+		// Heap allocations on any thread since the last Update, which is about one frame
+		uint64_t allocationCount = AllocationCounter::GetCount();
+		mFrameAllocations = allocationCount - mLastAllocationCount;
+		mLastAllocationCount = allocationCount;
+		mFramesWithoutAllocations = mFrameAllocations == 0 ? mFramesWithoutAllocations + 1 : 0;
 
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplGlfw_NewFrame();
@@ -62,7 +80,7 @@ public:
 		auto& shapeMap = pRenderer->GetShapeMap();
 		auto& textureMap = pResourceManager->GetTextureList();
 		auto& texturePackMap = pResourceManager->GetTexturePackList();
-		auto& envMapsMap = pResourceManager->GetHDRImagePairList();
+		auto& envMapsMap = pResourceManager->GetHDRImagePathList();
 
 		// List of cubes in the scene
 		ImGui::Begin("Shape List");
@@ -85,10 +103,12 @@ public:
 			ImGui::EndListBox();
 		}
 		if (ImGui::Button("Add Shape")) {
+			MemoryScope shapeScope(MemoryCategory::SCENE);
 			pRenderer->AddShape("Shape " + std::to_string(++mShapeCount), new Shape(pResourceManager, ShapeShading::PBR));
 		}
 
 		if (ImGui::Button("Add 10 Shapes")) {
+			MemoryScope shapeScope(MemoryCategory::SCENE);
 			for (int i = 0; i < 10; i++) {
 				pRenderer->AddShape("Shape " + std::to_string(++mShapeCount), new Shape(pResourceManager, ShapeShading::PBR));
 			}
@@ -114,6 +134,7 @@ public:
 							else {
 								shapeMap[mSelectedShape]->mTransform->scale = glm::vec3(0.5f, 0.5f, 0.5f);
 							}
+							pRenderer->MarkTransformDirty(mSelectedShape);
 							shapeMap[mSelectedShape]->mShading = mShapeShadingMap[mSelectedShapeShading];
 						}
 
@@ -165,11 +186,31 @@ public:
 
 			ImGui::Text("Transform");
 
-			ImGui::SliderFloat3("Position", &(shapeMap[mSelectedShape]->mTransform.get()->position.x), -2, 2);
+			// Position, scale and rotation are relative to the parent
+			const std::string& parent = pRenderer->GetShapeParent(mSelectedShape);
+			if (ImGui::BeginListBox("Parent", ImVec2(200.0f, 60.0f))) {
+				if (ImGui::Selectable("None", parent.empty())) {
+					pRenderer->SetShapeParent(mSelectedShape, "");
+				}
+				for (auto& [name, shape] : shapeMap) {
+					if (name == mSelectedShape) {
+						continue;
+					}
+					if (ImGui::Selectable(name.c_str(), parent == name) && !pRenderer->SetShapeParent(mSelectedShape, name)) {
+						std::cout << "Can't parent " << mSelectedShape << " to its own child " << name << '\n';
+					}
+				}
+				ImGui::EndListBox();
+			}
+
+			bool transformChanged = ImGui::SliderFloat3("Position", &(shapeMap[mSelectedShape]->mTransform.get()->position.x), -2, 2);
 
 			if (!(shapeMap[mSelectedShape]->mShading == ShapeShading::LIGHT)) {
-				ImGui::SliderFloat3("Scale", &(shapeMap[mSelectedShape]->mTransform.get()->scale.x), -2, 2);
-				ImGui::SliderFloat3("Rotation", &(shapeMap[mSelectedShape]->mTransform.get()->rotation.x), 0, 180);
+				transformChanged |= ImGui::SliderFloat3("Scale", &(shapeMap[mSelectedShape]->mTransform.get()->scale.x), -2, 2);
+				transformChanged |= ImGui::SliderFloat3("Rotation", &(shapeMap[mSelectedShape]->mTransform.get()->rotation.x), 0, 180);
+			}
+			if (transformChanged) {
+				pRenderer->MarkTransformDirty(mSelectedShape);
 			}			
 
 			if (shapeMap[mSelectedShape]->mShading == ShapeShading::PHONG) {
@@ -216,15 +257,15 @@ public:
 			// Show list of different env. maps to choose from
 			if (pRenderer->mSkyboxOn) {
 				if (ImGui::BeginListBox("Environments", ImVec2(200.0f, 100.0f))); {
-					for (auto& [name, envMap] : envMapsMap)
+					for (auto& [name, envMapPath] : envMapsMap)
 					{
 						if (name == "") {
 							continue;
 						}
-						const bool is_selected = (mSelectedTexturePack == name);
+						const bool is_selected = (mSelectedEnvMap == name);
 						if (ImGui::Selectable(name.c_str(), is_selected)) {
 							mSelectedEnvMap = name;
-							pRenderer->GenerateCubemapFromEquiRecIrrMap(mSelectedEnvMap, pResourceManager);
+							pRenderer->SetEnvironment(mSelectedEnvMap, pResourceManager);
 							//pRenderer->SetTexturePackForShape(pResourceManager->GetTexturePack(mSelectedTexturePack), mSelectedShape);
 						}
 
@@ -234,13 +275,23 @@ public:
 					ImGui::EndListBox();
 				}
 			}
+
+			// Baked environments resident on the GPU, most recently used first
+			IBLCache* pIBLCache = pRenderer->GetIBLCache();
+			if (!pRenderer->GetPendingEnvironment().empty()) {
+				ImGui::Text("Loading %s...", pRenderer->GetPendingEnvironment().c_str());
+			}
+			ImGui::Text("Resident: %.1f MB", pIBLCache->GetResidentBytes() / (1024.0f * 1024.0f));
+			for (IBLEnvironment* environment : pIBLCache->GetResident()) {
+				ImGui::BulletText("%s (%.1f MB)", environment->name.c_str(), environment->gpuBytes / (1024.0f * 1024.0f));
+			}
 		}
 		ImGui::End();
 
 		// Audio Player
 		ImGui::Begin("Audio Player");
 		{
-			auto trackList = pAudioHandler->GetSongs();
+			auto& trackList = pAudioHandler->GetSongs();
 
 			if (ImGui::BeginListBox("##Audio"));
 			{
@@ -278,14 +329,262 @@ public:
 		ImGui::End();
 
 		ImGui::Begin("Other Options"); {
-			ImGui::Checkbox("HDR", &pRenderer->mHDROn);
+			const char* tonemapperNames[] = { "None", "Exponential", "Reinhard", "ACES", "AgX" };
+			int tonemapper = static_cast<int>(pRenderer->mTonemapper);
+			if (ImGui::Combo("Tone Mapping", &tonemapper, tonemapperNames, IM_ARRAYSIZE(tonemapperNames))) {
+				pRenderer->mTonemapper = static_cast<Tonemapper>(tonemapper);
+			}
 			ImGui::SliderFloat("Exposure", &pRenderer->mExposure, 0, 5);
+			ImGui::Checkbox("Bloom", &pRenderer->mBloomOn);
+			if (pRenderer->mBloomOn) {
+				ImGui::SliderFloat("Bloom Intensity", &pRenderer->mBloomIntensity, 0, 1);
+				ImGui::SliderFloat("Bloom Threshold", &pRenderer->mBloom->mThreshold, 0, 5);
+				ImGui::SliderFloat("Bloom Knee", &pRenderer->mBloom->mKnee, 0, 1);
+				ImGui::SliderFloat("Bloom Radius", &pRenderer->mBloom->mFilterRadius, 0.001f, 0.02f);
+			}
+			ImGui::Checkbox("Dynamic Resolution", &pRenderer->mDynamicResolutionOn);
+			if (pRenderer->mDynamicResolutionOn) {
+				DynamicResolution* pDynamicResolution = pRenderer->mDynamicResolution;
+				ImGui::SliderFloat("Target Frame Time (ms)", &pDynamicResolution->mTargetFrameTime, 4.0f, 33.3f);
+				ImGui::SliderFloat("Min Scale", &pDynamicResolution->mMinScale, 0.25f, 1.0f);
+				ImGui::SliderFloat("Upscale Sharpness", &pRenderer->mUpscaleSharpness, 0.0f, 1.0f);
+				ImGui::Text("Scale: %.0f%% (GPU %.2f ms)", pDynamicResolution->GetScale() * 100.0f, pRenderer->GetProfiler()->GetFrameTime());
+			}
+			const char* antiAliasingNames[] = { "None", "TAA", "4x MSAA" };
+			int antiAliasing = static_cast<int>(pRenderer->mAntiAliasing);
+			if (ImGui::Combo("Anti-Aliasing", &antiAliasing, antiAliasingNames, IM_ARRAYSIZE(antiAliasingNames))) {
+				pRenderer->mAntiAliasing = static_cast<AntiAliasing>(antiAliasing);
+			}
+			if (pRenderer->mAntiAliasing == AntiAliasing::TAA) {
+				ImGui::SliderFloat("TAA History Weight", &pRenderer->mTAAHistoryWeight, 0.5f, 0.98f);
+			}
+			else if (pRenderer->mAntiAliasing == AntiAliasing::MSAA_4X && pRenderer->mDeferredShadingOn) {
+				ImGui::Text("MSAA is only used in forward mode");
+			}
+
+			// Forward scene cost measured for each mode so far
+			ImGui::Text("Forward scene cost");
+			for (int i = 0; i < IM_ARRAYSIZE(antiAliasingNames); i++) {
+				ImGui::Text("%-14s %6.3f ms", antiAliasingNames[i], pRenderer->mAntiAliasingCost[i]);
+			}
 			ImGui::Checkbox("Deferred Shading", &pRenderer->mDeferredShadingOn);
+			if (pRenderer->mDeferredShadingOn) {
+				ImGui::Checkbox("Show G-Buffers", &pRenderer->mShowGBuffer);
+			}
+			else {
+				ImGui::Checkbox("Depth Pre-Pass", &pRenderer->mDepthPrepassOn);
+			}
+			ImGui::Checkbox("GPU-Driven Depth Passes", &pRenderer->mGPUDrivenOn);
 			ImGui::ColorEdit3("BG Color", &pRenderer->mClearColor.r);
 		}
 		ImGui::End();
 
-		if (pRenderer->mDeferredShadingOn) {
+		ImGui::Begin("Shadows"); {
+			const char* filterNames[] = { "Hard", "Hardware PCF", "PCF", "Poisson PCF", "PCSS" };
+			int filter = static_cast<int>(pRenderer->mShadowFilter);
+			if (ImGui::Combo("Filter", &filter, filterNames, IM_ARRAYSIZE(filterNames))) {
+				pRenderer->mShadowFilter = static_cast<ShadowFilter>(filter);
+			}
+			ImGui::SliderFloat("Bias", &pRenderer->mShadowBias, 0.0f, 0.2f);
+			ImGui::SliderFloat("Filter Radius", &pRenderer->mShadowFilterRadius, 0.0f, 0.2f);
+			ImGui::SliderFloat("Light Size", &pRenderer->mShadowLightSize, 0.0f, 1.0f);
+
+			// Lighting pass cost measured for each filter so far
+			ImGui::Text("Lighting pass cost");
+			for (int i = 0; i < IM_ARRAYSIZE(filterNames); i++) {
+				ImGui::Text("%-14s %6.3f ms", filterNames[i], pRenderer->mShadowFilterCost[i]);
+			}
+		}
+		ImGui::End();
+
+		ImGui::Begin("Ambient Occlusion"); {
+			ImGui::Checkbox("SSAO", &pRenderer->mSSAOOn);
+			ImGui::Checkbox("Half Resolution", &pRenderer->mSSAOHalfResolution);
+			ImGui::SliderFloat("Radius", &pRenderer->mSSAORadius, 0.05f, 2.0f);
+			ImGui::SliderFloat("Bias", &pRenderer->mSSAOBias, 0.0f, 0.1f);
+			ImGui::SliderFloat("Intensity", &pRenderer->mSSAOIntensity, 0.5f, 4.0f);
+			if (!pRenderer->mDeferredShadingOn) {
+				ImGui::Text("SSAO is only used with deferred shading");
+			}
+
+			// Occlusion + blur cost measured at each resolution so far
+			ImGui::Text("SSAO cost");
+			ImGui::Text("%-14s %6.3f ms", "Full", pRenderer->mSSAOCost[0]);
+			ImGui::Text("%-14s %6.3f ms", "Half", pRenderer->mSSAOCost[1]);
+		}
+		ImGui::End();
+
+		ImGui::Begin("GPU Profiler"); {
+			GPUProfiler* pProfiler = pRenderer->GetProfiler();
+			for (const auto& timing : pProfiler->GetTimings()) {
+				ImGui::Text("%*s%-*s %6.3f ms", timing.depth * 2, "", 24 - timing.depth * 2, timing.name, timing.ms);
+			}
+		}
+		ImGui::End();
+
+		ImGui::Begin("Render Queue"); {
+			const Renderer::SubmitStats& stats = pRenderer->GetSubmitStats();
+			const Shader::UniformStats& uniformStats = Shader::GetUniformStats();
+			ImGui::Text("Items: %d, draws: %d", pRenderer->GetRenderQueue()->GetCount(), stats.draws);
+
+			// CPU side of the frame: transforms, sort keys, batch filling and culling
+			JobSystem* pJobSystem = pRenderer->GetJobSystem();
+			JobSystem::Stats jobStats = pJobSystem->GetStats();
+			ImGui::Text("Jobs: %d on %d workers, %d stolen", jobStats.jobs, pJobSystem->GetWorkerCount(), jobStats.steals);
+			const TransformSystem::Stats& transformStats = pRenderer->GetTransformSystem()->GetStats();
+			ImGui::Text("Transforms: %d in %d levels, recomposed: %d", transformStats.entries, transformStats.levels, transformStats.updated);
+
+			// Issued calls, and redundant ones that were skipped
+			ImGui::Text("%-16s %5d issued %5d skipped", "Programs", stats.programBinds, stats.redundantProgramBinds);
+			ImGui::Text("%-16s %5d issued %5d skipped", "VAOs", stats.vaoBinds, stats.redundantVaoBinds);
+			ImGui::Text("%-16s %5d issued %5d skipped", "Textures", stats.textureBinds, stats.redundantTextureBinds);
+			ImGui::Text("%-16s %5d issued %5d skipped", "Uniforms", uniformStats.writes, uniformStats.redundantWrites);
+
+			// Shape passes recorded on the workers and replayed, and what submitting them costs either way
+			ImGui::Separator();
+			ImGui::Checkbox("Command Buffers", &pRenderer->mCommandBuffersOn);
+			ImGui::Text("Commands: %d, %.1f KB", stats.commands, stats.commandBytes / 1024.0f);
+			if (ImGui::Button("Benchmark Submission")) {
+				pRenderer->RequestSubmitBenchmark();
+			}
+			const Renderer::SubmitBenchmark& benchmark = pRenderer->GetSubmitBenchmark();
+			if (benchmark.iterations > 0) {
+				ImGui::Text("%d draws, average of %d runs", benchmark.draws, benchmark.iterations);
+				ImGui::Text("%-16s %6.3f ms", "Direct", benchmark.directMs);
+				ImGui::Text("%-16s %6.3f ms", "Record", benchmark.recordMs);
+				ImGui::Text("%-16s %6.3f ms", "Replay", benchmark.replayMs);
+			}
+
+			// Objects in the multi-draw indirect batches, and the draw calls they took
+			ImGui::Separator();
+			ImGui::Text("Indirect culling: %s", IndirectBatch::IsGPUCullingSupported() ? "GPU" : "CPU (no GL 4.3)");
+			const IndirectBatch::Stats& shadowStats = pRenderer->GetIndirectBatch(QueuePass::SHADOW)->GetStats();
+			const IndirectBatch::Stats& prepassStats = pRenderer->GetIndirectBatch(QueuePass::DEPTH_PREPASS)->GetStats();
+			ImGui::Text("%-16s %5d objects %5d draws", "Shadow", shadowStats.objects, shadowStats.drawCalls);
+			ImGui::Text("%-16s %5d objects %5d draws", "Depth Pre-Pass", prepassStats.objects, prepassStats.drawCalls);
+		}
+		ImGui::End();
+
+		ImGui::Begin("GL State"); {
+			// Driver calls this frame, and the ones dropped because the state was already set
+			const GLState::Stats& stats = GLState::GetStats();
+			int issued = 0, filtered = 0;
+			for (int i = 0; i < static_cast<int>(GLState::Category::NUM); i++) {
+				ImGui::Text("%-16s %5d issued %5d filtered", GLState::GetCategoryName(static_cast<GLState::Category>(i)),
+					stats.issued[i], stats.filtered[i]);
+				issued += stats.issued[i];
+				filtered += stats.filtered[i];
+			}
+			ImGui::Separator();
+			ImGui::Text("%-16s %5d issued %5d filtered", "Total", issued, filtered);
+		}
+		ImGui::End();
+
+		ImGui::Begin("Frame Graph"); {
+			FrameGraph* pFrameGraph = pRenderer->GetFrameGraph();
+			const FrameGraph::Stats& stats = pFrameGraph->GetStats();
+			ImGui::Text("Passes: %d (%d culled)", stats.passes, stats.culledPasses);
+			ImGui::Text("Transient textures: %d (%d aliased)", stats.transientTextures, stats.aliasedTextures);
+			ImGui::Text("Pooled: %d textures, %.1f MB", stats.pooledTextures, stats.pooledBytes / (1024.0f * 1024.0f));
+			ImGui::Text("Clears: %d", stats.clears);
+			ImGui::Separator();
+			for (const auto& pass : pFrameGraph->GetPasses()) {
+				if (pass.culled) {
+					ImGui::TextDisabled("%s (culled)", pass.name);
+				}
+				else {
+					ImGui::BulletText("%s", pass.name);
+				}
+			}
+		}
+		ImGui::End();
+
+		ImGui::Begin("Memory"); {
+			// A steady frame, nothing being edited or loaded, should make none
+			ImGui::Text("Heap allocations last frame: %llu", static_cast<unsigned long long>(mFrameAllocations));
+			ImGui::Text("Frames without allocations: %d", mFramesWithoutAllocations);
+
+			FrameArena* pArena = pRenderer->GetFrameArena();
+			ImGui::Separator();
+			ImGui::Text("Frame arena: %.1f KB used, %.1f KB peak, %.1f KB reserved", pArena->GetUsed() / 1024.0f,
+				pArena->GetPeak() / 1024.0f, pArena->GetCapacity() / 1024.0f);
+
+			// Scene object pools, live objects out of slots in slabs
+			ShowPoolStats("Shape", Shape::GetPool().GetStats());
+			ShowPoolStats("Transform", Transform::GetPool().GetStats());
+			ShowPoolStats("Material", Material::GetPool().GetStats());
+			ShowPoolStats("MaterialPBR", MaterialPBR::GetPool().GetStats());
+
+			// Live and peak MB by category. Red rows are over their budget
+			const float MB = 1024.0f * 1024.0f;
+			float totalMB = 0.0f;
+			ImGui::Separator();
+			if (ImGui::BeginTable("Categories", 5)) {
+				ImGui::TableSetupColumn("Category");
+				ImGui::TableSetupColumn("Heap MB");
+				ImGui::TableSetupColumn("Allocations");
+				ImGui::TableSetupColumn("GPU MB");
+				ImGui::TableSetupColumn("GPU objects");
+				ImGui::TableHeadersRow();
+				for (int i = 0; i < static_cast<int>(MemoryCategory::NUM); i++) {
+					MemoryCategory category = static_cast<MemoryCategory>(i);
+					MemoryTracker::Counter heap = MemoryTracker::GetHeap(category);
+					MemoryTracker::Counter gpu = MemoryTracker::GetGPU(category);
+					totalMB += (heap.liveBytes + gpu.liveBytes) / MB;
+
+					ImVec4 color = MemoryTracker::IsOverBudget(category) ? ImVec4(1.0f, 0.3f, 0.3f, 1.0f) : ImGui::GetStyleColorVec4(ImGuiCol_Text);
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn();
+					ImGui::TextColored(color, "%s", MemoryTracker::GetCategoryName(category));
+					ImGui::TableNextColumn();
+					ImGui::TextColored(color, "%.2f (%.2f)", heap.liveBytes / MB, heap.peakBytes / MB);
+					ImGui::TableNextColumn();
+					ImGui::Text("%lld", static_cast<long long>(heap.liveCount));
+					ImGui::TableNextColumn();
+					ImGui::TextColored(color, "%.2f (%.2f)", gpu.liveBytes / MB, gpu.peakBytes / MB);
+					ImGui::TableNextColumn();
+					ImGui::Text("%lld", static_cast<long long>(gpu.liveCount));
+				}
+				ImGui::EndTable();
+			}
+
+			for (int i = 0; i < static_cast<int>(GPUObject::NUM); i++) {
+				GPUObject type = static_cast<GPUObject>(i);
+				MemoryTracker::Counter gpu = MemoryTracker::GetGPU(type);
+				ImGui::Text("GPU %-14s %8.2f MB in %lld", MemoryTracker::GetObjectName(type), gpu.liveBytes / MB, static_cast<long long>(gpu.liveCount));
+			}
+
+			// Heap and GPU total, sampled every second. Steady growth in a still scene is a leak
+			double time = ImGui::GetTime();
+			if (time - mLastMemorySample >= 1.0) {
+				mLastMemorySample = time;
+				mMemoryHistory[mMemoryHistoryOffset] = totalMB;
+				mMemoryHistoryOffset = (mMemoryHistoryOffset + 1) % MEMORY_HISTORY_SAMPLES;
+			}
+			ImGui::PlotLines("Total MB", mMemoryHistory, MEMORY_HISTORY_SAMPLES, mMemoryHistoryOffset, nullptr, FLT_MAX, FLT_MAX, ImVec2(0.0f, 60.0f));
+
+			if (ImGui::TreeNode("Budgets (MB, 0 for none)")) {
+				for (int i = 0; i < static_cast<int>(MemoryCategory::NUM); i++) {
+					MemoryCategory category = static_cast<MemoryCategory>(i);
+					int budgets[2] = { static_cast<int>(MemoryTracker::GetHeapBudget(category) / (1024 * 1024)),
+						static_cast<int>(MemoryTracker::GetGPUBudget(category) / (1024 * 1024)) };
+					ImGui::PushID(i);
+					if (ImGui::InputInt2(MemoryTracker::GetCategoryName(category), budgets)) {
+						MemoryTracker::SetBudget(category, static_cast<size_t>(std::max(budgets[0], 0)) * 1024 * 1024,
+							static_cast<size_t>(std::max(budgets[1], 0)) * 1024 * 1024);
+					}
+					ImGui::PopID();
+				}
+				ImGui::TreePop();
+			}
+
+			if (ImGui::Button("Write memory_report.json")) {
+				MemoryTracker::WriteJSON("memory_report.json");
+			}
+		}
+		ImGui::End();
+
+		if (pRenderer->mDeferredShadingOn && pRenderer->mShowGBuffer) {
 			ImGui::Begin("G-Buffers (Def. Shading)"); {
 				int vecSize = pRenderer->mGBufferTextures.size();
 				for (int i = 0; i < vecSize; i++) {
@@ -298,14 +597,36 @@ public:
 		ImGui::ShowMetricsWindow();
 
 		ImGui::Render();
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+	}
+
+	// ImGui::GetDrawData() right after Update, or a copy of it
+	void Render(ImDrawData* pDrawData) {
+		MemoryScope memoryScope(MemoryCategory::EDITOR);
+		ImGui_ImplOpenGL3_RenderDrawData(pDrawData);
+
+		// ImGui's backend sets GL state directly
+		GLState::Invalidate();
 	}
 
 private:
+	template <typename Stats>
+	static void ShowPoolStats(const char* name, const Stats& stats) {
+		ImGui::Text("%-12s %5zu / %5zu in %zu slabs, %.1f KB", name, stats.liveCount, stats.capacity, stats.slabCount, stats.bytes / 1024.0f);
+	}
+
 	std::unordered_map <std::string, ShapeShading> mShapeShadingMap;
 	std::vector<std::string> mShapeGeometryList;
 	std::string mSelectedTexturePack = "Leather_Padded", mSelectedTrack,
 		mSelectedShape = "PBR Shape", mSelectedShapeShading = "Textured", mSelectedEnvMap = "Ditch_River";
 	int mSelectedGeometry = 0;
 	int mShapeCount = 2;
+
+	uint64_t mLastAllocationCount = 0, mFrameAllocations = 0;
+	int mFramesWithoutAllocations = 0;
+
+	// Total tracked memory over the last MEMORY_HISTORY_SAMPLES seconds, a ring buffer
+	static const int MEMORY_HISTORY_SAMPLES = 120;
+	float mMemoryHistory[MEMORY_HISTORY_SAMPLES] = {};
+	int mMemoryHistoryOffset = 0;
+	double mLastMemorySample = 0.0;
 };
@@ -0,0 +1,88 @@
+#include "FrameArena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+FrameArena::FrameArena(size_t blockSize) : mCurrent(0), mOffset(0), mBlockSize(blockSize), mUsed(0), mPeak(0), mResource(this) {
+	AddBlock(blockSize);
+}
+
+FrameArena::~FrameArena() {
+	for (Block& block : mBlocks) {
+		::operator delete(block.data);
+	}
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment) {
+	while (true) {
+		Block& block = mBlocks[mCurrent];
+		uintptr_t base = reinterpret_cast<uintptr_t>(block.data);
+		size_t offset = ((base + mOffset + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1)) - base;
+		if (offset + size <= block.size) {
+			mUsed += offset + size - mOffset;
+			mOffset = offset + size;
+			return block.data + offset;
+		}
+
+		// The rest of this block is wasted. Adding a block can move the block list, block isn't used after
+		mUsed += block.size - mOffset;
+		if (mCurrent + 1 == mBlocks.size()) {
+			// Room for it even at the worst alignment
+			AddBlock(size + alignment);
+		}
+		mCurrent++;
+		mOffset = 0;
+	}
+}
+
+const char* FrameArena::CopyString(std::string_view string) {
+	char* copy = AllocateArray<char>(string.size() + 1);
+	std::memcpy(copy, string.data(), string.size());
+	copy[string.size()] = '\0';
+	return copy;
+}
+
+void FrameArena::Reset() {
+	mPeak = std::max(mPeak, mUsed);
+
+	// The frame overflowed, next frame gets it all in one block
+	if (mBlocks.size() > 1) {
+		size_t total = 0;
+		for (Block& block : mBlocks) {
+			total += block.size;
+			::operator delete(block.data);
+		}
+		mBlocks.clear();
+		AddBlock(total);
+	}
+
+	mCurrent = 0;
+	mOffset = 0;
+	mUsed = 0;
+}
+
+std::pmr::memory_resource* FrameArena::GetResource() {
+	return &mResource;
+}
+
+size_t FrameArena::GetUsed() const {
+	return mUsed;
+}
+
+size_t FrameArena::GetPeak() const {
+	return std::max(mPeak, mUsed);
+}
+
+size_t FrameArena::GetCapacity() const {
+	size_t capacity = 0;
+	for (const Block& block : mBlocks) {
+		capacity += block.size;
+	}
+	return capacity;
+}
+
+void FrameArena::AddBlock(size_t minSize) {
+	size_t size = std::max(minSize, mBlockSize);
+	mBlocks.push_back({ static_cast<unsigned char*>(::operator new(size)), size });
+}
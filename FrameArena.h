@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+// Bump allocator for memory that only lives for one frame. Allocating moves an offset forward, nothing
+// is freed on its own, Reset rewinds everything at once. When a frame needs more than the arena holds
+// another block is added, and the next Reset merges the blocks into one, so the steady state is a
+// single block and no heap allocations. Not thread-safe, each thread building frames needs its own
+class FrameArena
+{
+public:
+	static const size_t DEFAULT_BLOCK_SIZE = 256 * 1024;
+
+	explicit FrameArena(size_t blockSize = DEFAULT_BLOCK_SIZE);
+	~FrameArena();
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+	// Uninitialized room for count Ts
+	template <typename T>
+	T* AllocateArray(size_t count) {
+		return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+	}
+
+	// Null-terminated copy
+	const char* CopyString(std::string_view string);
+
+	// Everything allocated since the last Reset is gone. Objects with destructors must be destroyed before
+	void Reset();
+
+	// For std::pmr containers. Deallocating is a no-op, the memory comes back on Reset
+	std::pmr::memory_resource* GetResource();
+
+	// Bytes handed out since the last Reset, the most handed out in one frame, and the bytes reserved
+	size_t GetUsed() const;
+	size_t GetPeak() const;
+	size_t GetCapacity() const;
+
+private:
+	class Resource : public std::pmr::memory_resource {
+	public:
+		explicit Resource(FrameArena* pArena) : mArena(pArena) {}
+
+	private:
+		void* do_allocate(size_t bytes, size_t alignment) override { return mArena->Allocate(bytes, alignment); }
+		void do_deallocate(void* p, size_t bytes, size_t alignment) override {}
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+		FrameArena* mArena;
+	};
+
+	struct Block {
+		unsigned char* data;
+		size_t size;
+	};
+
+	void AddBlock(size_t minSize);
+
+	std::vector<Block> mBlocks;
+	size_t mCurrent, mOffset;
+	size_t mBlockSize;
+	size_t mUsed, mPeak;
+	Resource mResource;
+};
@@ -0,0 +1,560 @@
+#include "FrameGraph.h"
+#include "GLState.h"
+#include "MemoryTracker.h"
+
+#include <iostream>
+#include <algorithm>
+
+FrameGraphResource FrameGraph::PassBuilder::Create(std::string_view name, const FrameGraphTextureDesc& desc) {
+	Resource resource;
+	resource.name = mGraph->mArena->CopyString(name);
+	resource.desc = desc;
+	mGraph->mResources.push_back(resource);
+
+	int index = static_cast<int>(mGraph->mResources.size()) - 1;
+	FrameGraphResource node = mGraph->AddNode(index, -1);
+	mGraph->mStats.transientTextures++;
+	return node;
+}
+
+FrameGraphResource FrameGraph::PassBuilder::Read(FrameGraphResource resource) {
+	if (resource != INVALID_RESOURCE) {
+		mGraph->mPasses[mPass].reads.push_back(resource);
+	}
+	return resource;
+}
+
+FrameGraphResource FrameGraph::PassBuilder::Write(FrameGraphResource resource) {
+	if (resource == INVALID_RESOURCE) {
+		return resource;
+	}
+
+	Pass& pass = mGraph->mPasses[mPass];
+	int index = mGraph->mNodes[resource].resource;
+	if (mGraph->mResources[index].imported) {
+		pass.sideEffect = true;
+	}
+
+	// Rendering on top of earlier contents depends on whoever produced them
+	if (mGraph->mNodes[resource].producer != -1) {
+		pass.reads.push_back(resource);
+	}
+
+	FrameGraphResource node = mGraph->AddNode(index, mPass);
+	mGraph->mPasses[mPass].writes.push_back(node);
+	return node;
+}
+
+void FrameGraph::PassBuilder::Clear(GLbitfield mask, const glm::vec4& color) {
+	mGraph->mPasses[mPass].clearMask |= mask;
+	mGraph->mPasses[mPass].clearColor = color;
+}
+
+void FrameGraph::PassBuilder::SetSideEffect() {
+	mGraph->mPasses[mPass].sideEffect = true;
+}
+
+void FrameGraph::PassBuilder::SetRenderArea(int width, int height) {
+	mGraph->mPasses[mPass].renderWidth = width;
+	mGraph->mPasses[mPass].renderHeight = height;
+}
+
+FrameGraph::FrameGraph(FrameArena* pArena) : mArena(pArena), mCurrentGroup(-1), mPassFramebuffer(0),
+	mViewportWidth(0), mViewportHeight(0), mFrame(0) {}
+
+FrameGraph::~FrameGraph() {
+	for (auto& pass : mPasses) {
+		pass.destroy(pass.execute);
+	}
+	for (auto& [attachments, framebuffer] : mFramebuffers) {
+		GLState::DeleteFramebuffers(1, &framebuffer);
+	}
+	for (auto& pooled : mPool) {
+		GLState::DeleteTextures(1, &pooled.texture);
+	}
+}
+
+void FrameGraph::Reset() {
+	for (auto& resource : mResources) {
+		Release(resource);
+	}
+
+	++mFrame;
+	RetireUnusedTextures(POOL_RETIRE_FRAMES);
+
+	// The closures' memory goes with the arena, but whatever they captured still needs destroying
+	for (auto& pass : mPasses) {
+		pass.destroy(pass.execute);
+	}
+	mPasses.clear();
+	mResources.clear();
+	mNodes.clear();
+	mGroups.clear();
+	mCurrentGroup = -1;
+
+	mPassInfos.clear();
+	mStats = Stats();
+	UpdatePoolStats();
+}
+
+void FrameGraph::Trim() {
+	RetireUnusedTextures(0);
+	UpdatePoolStats();
+}
+
+FrameGraphResource FrameGraph::Import(std::string_view name, GLuint texture, const FrameGraphTextureDesc& desc) {
+	Resource resource;
+	resource.name = mArena->CopyString(name);
+	resource.desc = desc;
+	resource.texture = texture;
+	resource.imported = true;
+	mResources.push_back(resource);
+
+	return AddNode(static_cast<int>(mResources.size()) - 1, -1);
+}
+
+FrameGraphResource FrameGraph::ImportBackbuffer(int width, int height) {
+	FrameGraphTextureDesc desc;
+	desc.width = width;
+	desc.height = height;
+	FrameGraphResource node = Import("Backbuffer", 0, desc);
+	mResources[mNodes[node].resource].backbuffer = true;
+	return node;
+}
+
+void FrameGraph::ForgetTexture(GLuint texture) {
+	// Framebuffers are only valid with all of their attachments
+	for (auto it = mFramebuffers.begin(); it != mFramebuffers.end();) {
+		if (std::find(it->first.begin(), it->first.end(), texture) != it->first.end()) {
+			GLState::DeleteFramebuffers(1, &it->second);
+			it = mFramebuffers.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+void FrameGraph::BeginGroup(std::string_view name) {
+	mGroups.push_back(mArena->CopyString(name));
+	mCurrentGroup = static_cast<int>(mGroups.size()) - 1;
+}
+
+void FrameGraph::EndGroup() {
+	mCurrentGroup = -1;
+}
+
+void FrameGraph::Extract(FrameGraphResource resource) {
+	if (resource == INVALID_RESOURCE) {
+		return;
+	}
+	mResources[mNodes[resource].resource].extracted = true;
+	mNodes[resource].refCount++;
+}
+
+void FrameGraph::Compile() {
+	// ------ CULLING ------
+	// A pass is needed if something reads one of its outputs. Unread outputs release their producer,
+	// which in turn releases everything that pass read
+
+	for (auto& pass : mPasses) {
+		pass.refCount = static_cast<int>(pass.writes.size());
+		pass.culled = false;
+		for (FrameGraphResource read : pass.reads) {
+			mNodes[read].refCount++;
+		}
+	}
+
+	std::pmr::vector<FrameGraphResource> unreferenced(mArena->GetResource());
+	unreferenced.reserve(mNodes.size());
+	for (size_t i = 0; i < mNodes.size(); ++i) {
+		if (mNodes[i].refCount == 0) {
+			unreferenced.push_back(static_cast<FrameGraphResource>(i));
+		}
+	}
+
+	auto cullPass = [&](Pass& pass) {
+		pass.culled = true;
+		for (FrameGraphResource read : pass.reads) {
+			if (--mNodes[read].refCount == 0) {
+				unreferenced.push_back(read);
+			}
+		}
+	};
+
+	for (auto& pass : mPasses) {
+		if (pass.refCount == 0 && !pass.sideEffect) {
+			cullPass(pass);
+		}
+	}
+
+	while (!unreferenced.empty()) {
+		FrameGraphResource node = unreferenced.back();
+		unreferenced.pop_back();
+
+		int producer = mNodes[node].producer;
+		if (producer == -1) {
+			continue;
+		}
+		Pass& pass = mPasses[producer];
+		if (--pass.refCount == 0 && !pass.sideEffect && !pass.culled) {
+			cullPass(pass);
+		}
+	}
+
+	// ------ LIFETIMES ------
+	// From the first pass that touches a resource to the last one, counting only passes that will run
+
+	for (int i = 0; i < static_cast<int>(mPasses.size()); ++i) {
+		const Pass& pass = mPasses[i];
+		if (pass.culled) {
+			continue;
+		}
+		for (const auto* handles : { &pass.reads, &pass.writes }) {
+			for (FrameGraphResource handle : *handles) {
+				Resource& resource = mResources[mNodes[handle].resource];
+				if (resource.firstPass == -1) {
+					resource.firstPass = i;
+				}
+				resource.lastPass = std::max(resource.lastPass, i);
+			}
+		}
+	}
+
+	mPassInfos.clear();
+	for (const auto& pass : mPasses) {
+		mPassInfos.push_back({ pass.name, pass.culled });
+		mStats.passes++;
+		if (pass.culled) {
+			mStats.culledPasses++;
+		}
+	}
+}
+
+void FrameGraph::Execute(GPUProfiler* pProfiler) {
+	mPassFramebuffer = 0;
+	mViewportWidth = 0;
+	mViewportHeight = 0;
+
+	int openGroup = -1;
+	for (int i = 0; i < static_cast<int>(mPasses.size()); ++i) {
+		Pass& pass = mPasses[i];
+		if (pass.culled) {
+			continue;
+		}
+
+		for (auto& resource : mResources) {
+			if (resource.firstPass == i) {
+				Acquire(resource);
+			}
+		}
+
+		if (pass.group != openGroup) {
+			if (openGroup != -1) {
+				pProfiler->End();
+			}
+			if (pass.group != -1) {
+				pProfiler->Begin(mGroups[pass.group]);
+			}
+			openGroup = pass.group;
+		}
+		if (pass.group == -1) {
+			pProfiler->Begin(pass.name);
+		}
+
+		BindTargets(pass);
+		if (pass.clearMask) {
+			glClearColor(pass.clearColor.r, pass.clearColor.g, pass.clearColor.b, pass.clearColor.a);
+			glClear(pass.clearMask);
+			mStats.clears++;
+		}
+
+		pass.invoke(pass.execute, *this);
+
+		if (pass.group == -1) {
+			pProfiler->End();
+		}
+
+		// Free for the next resource with the same size and format
+		for (auto& resource : mResources) {
+			if (resource.lastPass == i && !resource.extracted) {
+				Release(resource);
+			}
+		}
+	}
+
+	if (openGroup != -1) {
+		pProfiler->End();
+	}
+}
+
+GLuint FrameGraph::GetTexture(FrameGraphResource resource) {
+	if (resource == INVALID_RESOURCE) {
+		return 0;
+	}
+	return mResources[mNodes[resource].resource].texture;
+}
+
+const FrameGraphTextureDesc& FrameGraph::GetDesc(FrameGraphResource resource) {
+	return mResources[mNodes[resource].resource].desc;
+}
+
+const std::vector<FrameGraph::PassInfo>& FrameGraph::GetPasses() {
+	return mPassInfos;
+}
+
+const FrameGraph::Stats& FrameGraph::GetStats() {
+	return mStats;
+}
+
+int FrameGraph::NewPass(std::string_view name) {
+	Pass& pass = mPasses.emplace_back(mArena->GetResource());
+	pass.name = mArena->CopyString(name);
+	pass.group = mCurrentGroup;
+	return static_cast<int>(mPasses.size()) - 1;
+}
+
+FrameGraphResource FrameGraph::AddNode(int resource, int producer) {
+	mNodes.push_back({ resource, producer, 0 });
+	return static_cast<FrameGraphResource>(mNodes.size()) - 1;
+}
+
+void FrameGraph::Acquire(Resource& resource) {
+	if (resource.imported || resource.poolIndex != -1) {
+		return;
+	}
+
+	const FrameGraphTextureDesc& desc = resource.desc;
+	for (size_t i = 0; i < mPool.size(); ++i) {
+		PooledTexture& pooled = mPool[i];
+		if (pooled.inUse || pooled.desc.width != desc.width || pooled.desc.height != desc.height ||
+			pooled.desc.internalFormat != desc.internalFormat || pooled.desc.cubemap != desc.cubemap ||
+			pooled.desc.samples != desc.samples) {
+			continue;
+		}
+
+		if (pooled.lastUsedFrame == mFrame) {
+			mStats.aliasedTextures++;
+		}
+
+		// Multisampled textures have no sampler state
+		GLenum target = desc.cubemap ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+		if (pooled.desc.filter != desc.filter && desc.samples <= 1) {
+			GLState::BindTexture(target, pooled.texture);
+			glTexParameteri(target, GL_TEXTURE_MIN_FILTER, desc.filter);
+			glTexParameteri(target, GL_TEXTURE_MAG_FILTER, desc.filter);
+			pooled.desc.filter = desc.filter;
+		}
+
+		pooled.inUse = true;
+		pooled.lastUsedFrame = mFrame;
+		resource.texture = pooled.texture;
+		resource.poolIndex = static_cast<int>(i);
+		return;
+	}
+
+	// Nothing free matches, allocate
+	GLenum format = GL_RGBA, type = GL_FLOAT;
+	if (desc.internalFormat == GL_DEPTH24_STENCIL8) {
+		format = GL_DEPTH_STENCIL;
+		type = GL_UNSIGNED_INT_24_8;
+	}
+	else if (desc.internalFormat == GL_DEPTH32F_STENCIL8) {
+		format = GL_DEPTH_STENCIL;
+		type = GL_FLOAT_32_UNSIGNED_INT_24_8_REV;
+	}
+	else if (IsDepthFormat(desc.internalFormat)) {
+		format = GL_DEPTH_COMPONENT;
+	}
+
+	PooledTexture pooled;
+	pooled.desc = desc;
+	pooled.bytes = MemoryTracker::GetTextureBytes(desc.internalFormat, desc.width, desc.height, desc.cubemap ? 6 : 1, 1, desc.samples);
+	pooled.inUse = true;
+	pooled.lastUsedFrame = mFrame;
+
+	glGenTextures(1, &pooled.texture);
+	MemoryTracker::TrackGPU(GPUObject::TEXTURE, pooled.texture, pooled.bytes);
+	if (desc.samples > 1) {
+		GLState::BindTexture(GL_TEXTURE_2D_MULTISAMPLE, pooled.texture);
+		glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, desc.samples, desc.internalFormat, desc.width, desc.height, GL_TRUE);
+		mPool.push_back(pooled);
+		mStats.pooledTextures++;
+		mStats.pooledBytes += pooled.bytes;
+
+		resource.texture = pooled.texture;
+		resource.poolIndex = static_cast<int>(mPool.size()) - 1;
+		return;
+	}
+
+	GLenum target = desc.cubemap ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+	GLState::BindTexture(target, pooled.texture);
+	if (desc.cubemap) {
+		for (unsigned int face = 0; face < 6; ++face) {
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, desc.internalFormat, desc.width, desc.height, 0, format, type, NULL);
+		}
+		glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	}
+	else {
+		glTexImage2D(GL_TEXTURE_2D, 0, desc.internalFormat, desc.width, desc.height, 0, format, type, NULL);
+	}
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, desc.filter);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, desc.filter);
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	mPool.push_back(pooled);
+	mStats.pooledTextures++;
+	mStats.pooledBytes += pooled.bytes;
+
+	resource.texture = pooled.texture;
+	resource.poolIndex = static_cast<int>(mPool.size()) - 1;
+}
+
+void FrameGraph::BlitFrom(FrameGraphResource source) {
+	const Resource& resource = mResources[mNodes[source].resource];
+
+	// Creating the read framebuffer binds it, put the pass's target back
+	GLuint readFramebuffer = GetFramebuffer(&resource.texture, 1, 0, GL_DEPTH_ATTACHMENT);
+	GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, mPassFramebuffer);
+
+	GLState::BindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+	glBlitFramebuffer(0, 0, mViewportWidth, mViewportHeight, 0, 0, mViewportWidth, mViewportHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	GLState::BindFramebuffer(GL_READ_FRAMEBUFFER, mPassFramebuffer);
+}
+
+void FrameGraph::Release(Resource& resource) {
+	if (resource.poolIndex == -1) {
+		return;
+	}
+	mPool[resource.poolIndex].inUse = false;
+	resource.poolIndex = -1;
+}
+
+void FrameGraph::BindTargets(const Pass& pass) {
+	GLuint colors[MAX_COLOR_TARGETS];
+	int colorCount = 0;
+	GLuint depth = 0;
+	GLenum depthAttachment = GL_DEPTH_ATTACHMENT;
+	bool backbuffer = false;
+	int width = 0, height = 0;
+
+	for (FrameGraphResource handle : pass.writes) {
+		const Resource& resource = mResources[mNodes[handle].resource];
+		width = resource.desc.width;
+		height = resource.desc.height;
+
+		if (resource.backbuffer) {
+			backbuffer = true;
+		}
+		else if (IsDepthFormat(resource.desc.internalFormat)) {
+			depth = resource.texture;
+			bool stencil = resource.desc.internalFormat == GL_DEPTH24_STENCIL8 || resource.desc.internalFormat == GL_DEPTH32F_STENCIL8;
+			depthAttachment = stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+		}
+		else if (colorCount < MAX_COLOR_TARGETS) {
+			colors[colorCount++] = resource.texture;
+		}
+	}
+
+	// Passes that write nothing (compute, readbacks) leave the targets alone
+	if (pass.writes.empty()) {
+		return;
+	}
+
+	if (pass.renderWidth > 0 && pass.renderHeight > 0) {
+		width = pass.renderWidth;
+		height = pass.renderHeight;
+	}
+
+	// GLState drops the binds when consecutive passes share targets
+	mPassFramebuffer = backbuffer ? 0 : GetFramebuffer(colors, colorCount, depth, depthAttachment);
+	mViewportWidth = width;
+	mViewportHeight = height;
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, mPassFramebuffer);
+	GLState::Viewport(0, 0, width, height);
+}
+
+GLuint FrameGraph::GetFramebuffer(const GLuint* colors, int colorCount, GLuint depth, GLenum depthAttachment) {
+	FramebufferKey key = {};
+	std::copy(colors, colors + colorCount, key.begin());
+	key[MAX_COLOR_TARGETS] = depth;
+
+	auto it = mFramebuffers.find(key);
+	if (it != mFramebuffers.end()) {
+		return it->second;
+	}
+
+	GLuint framebuffer;
+	glGenFramebuffers(1, &framebuffer);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	// Layered for cube maps, so a geometry shader can pick the face
+	GLenum drawBuffers[MAX_COLOR_TARGETS];
+	for (int i = 0; i < colorCount; ++i) {
+		glFramebufferTexture(GL_FRAMEBUFFER, static_cast<GLenum>(GL_COLOR_ATTACHMENT0 + i), colors[i], 0);
+		drawBuffers[i] = static_cast<GLenum>(GL_COLOR_ATTACHMENT0 + i);
+	}
+	if (depth) {
+		glFramebufferTexture(GL_FRAMEBUFFER, depthAttachment, depth, 0);
+	}
+
+	if (colorCount == 0) {
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+	else {
+		glDrawBuffers(colorCount, drawBuffers);
+	}
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cout << "Frame graph framebuffer ain't complete!" << std::endl;
+	}
+
+	mFramebuffers[key] = framebuffer;
+	return framebuffer;
+}
+
+void FrameGraph::RetireUnusedTextures(uint64_t maxAge) {
+	for (size_t i = 0; i < mPool.size();) {
+		PooledTexture& pooled = mPool[i];
+		if (pooled.inUse || mFrame - pooled.lastUsedFrame <= maxAge) {
+			++i;
+			continue;
+		}
+
+		ForgetTexture(pooled.texture);
+		GLState::DeleteTextures(1, &pooled.texture);
+		mPool.erase(mPool.begin() + i);
+
+		// Extracted resources still hold indices into the pool
+		for (auto& resource : mResources) {
+			if (resource.poolIndex > static_cast<int>(i)) {
+				resource.poolIndex--;
+			}
+		}
+	}
+}
+
+void FrameGraph::UpdatePoolStats() {
+	mStats.pooledTextures = static_cast<int>(mPool.size());
+	mStats.pooledBytes = 0;
+	for (auto& pooled : mPool) {
+		mStats.pooledBytes += pooled.bytes;
+	}
+}
+
+bool FrameGraph::IsDepthFormat(GLenum internalFormat) {
+	switch (internalFormat) {
+	case GL_DEPTH_COMPONENT:
+	case GL_DEPTH_COMPONENT16:
+	case GL_DEPTH_COMPONENT24:
+	case GL_DEPTH_COMPONENT32:
+	case GL_DEPTH_COMPONENT32F:
+	case GL_DEPTH24_STENCIL8:
+	case GL_DEPTH32F_STENCIL8:
+		return true;
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string_view>
+#include <vector>
+#include <map>
+#include <array>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <cstdint>
+
+#include "GPUProfiler.h"
+#include "FrameArena.h"
+
+// Texture created by the frame graph. Filtering is sampler state and doesn't stop two resources
+// from sharing a pooled texture, size and format do
+struct FrameGraphTextureDesc {
+	int width = 0, height = 0;
+	GLenum internalFormat = GL_RGBA8;
+	GLenum filter = GL_NEAREST;
+	bool cubemap = false;
+
+	// Above 1 makes a multisampled texture, which can only be rendered to and blitted from
+	int samples = 1;
+};
+
+// Handle to one version of a resource. Every write produces a new version
+typedef int FrameGraphResource;
+
+// Passes are declared every frame together with the resources they read and render into.
+// Compiling culls passes whose results nobody uses and computes resource lifetimes, so transient
+// textures are only allocated while something needs them and textures of the same size and format
+// are shared by resources that are never alive at the same time. Executing binds each pass's
+// render targets and clears only what the pass asked to have cleared.
+// Names, pass closures and per-pass lists live in the frame arena, so declaring a frame doesn't touch the heap
+class FrameGraph
+{
+public:
+	static const FrameGraphResource INVALID_RESOURCE = -1;
+
+	// Pooled textures nothing asked for in this many frames are deleted, e.g. after switching a mode off
+	static const int POOL_RETIRE_FRAMES = 120;
+
+	static const int MAX_COLOR_TARGETS = 8;
+
+	class PassBuilder {
+	public:
+		// New transient texture. Its contents are undefined until the pass writes or clears them
+		FrameGraphResource Create(std::string_view name, const FrameGraphTextureDesc& desc);
+		FrameGraphResource Read(FrameGraphResource resource);
+
+		// Attaches the resource as a render target (color in declaration order, or depth).
+		// Existing contents are kept unless the pass clears them
+		FrameGraphResource Write(FrameGraphResource resource);
+
+		// Cleared after the targets are bound, before the pass executes
+		void Clear(GLbitfield mask, const glm::vec4& color = glm::vec4(0.0f));
+
+		// Never culled, even if nothing reads what it writes
+		void SetSideEffect();
+
+		// Renders into the bottom left width x height of the targets instead of all of them
+		void SetRenderArea(int width, int height);
+
+	private:
+		friend class FrameGraph;
+		PassBuilder(FrameGraph* pGraph, int pass) : mGraph(pGraph), mPass(pass) {}
+
+		FrameGraph* mGraph;
+		int mPass;
+	};
+
+	struct PassInfo {
+		const char* name;
+		bool culled;
+	};
+
+	struct Stats {
+		int passes = 0;
+		int culledPasses = 0;
+		int transientTextures = 0;
+
+		// Transient resources that got a texture another resource already used earlier this frame
+		int aliasedTextures = 0;
+
+		int pooledTextures = 0;
+		size_t pooledBytes = 0;
+		int clears = 0;
+	};
+
+	// The arena must outlive the graph and only be reset after the graph is
+	explicit FrameGraph(FrameArena* pArena);
+	~FrameGraph();
+
+	// Forgets last frame's passes and destroys their closures. Pooled textures and framebuffers are kept
+	void Reset();
+
+	// Deletes pooled textures the current frame didn't use, e.g. the old sizes after a resize
+	void Trim();
+
+	// Textures owned by someone else, e.g. the IBL maps. Writing one counts as a side effect
+	FrameGraphResource Import(std::string_view name, GLuint texture, const FrameGraphTextureDesc& desc);
+	FrameGraphResource ImportBackbuffer(int width, int height);
+
+	// Deletes the cached framebuffers that attach texture. Call before deleting an imported texture,
+	// GL hands its name out again and the cache would return a framebuffer holding the dead storage
+	void ForgetTexture(GLuint texture);
+
+	// Runs setup(PassBuilder&) right away, execute(FrameGraph&) later from Execute(). The execute closure
+	// is moved into the arena instead of a std::function, which would allocate for most captures
+	template <typename Setup, typename Execute>
+	void AddPass(std::string_view name, Setup&& setup, Execute&& execute) {
+		typedef std::decay_t<Execute> Closure;
+		int index = NewPass(name);
+		Pass& pass = mPasses[index];
+		pass.execute = new (mArena->Allocate(sizeof(Closure), alignof(Closure))) Closure(std::forward<Execute>(execute));
+		pass.invoke = [](void* closure, FrameGraph& graph) { (*static_cast<Closure*>(closure))(graph); };
+		pass.destroy = [](void* closure) { static_cast<Closure*>(closure)->~Closure(); };
+
+		PassBuilder builder(this, index);
+		setup(builder);
+	}
+
+	// Passes added in between are profiled as one scope instead of one each
+	void BeginGroup(std::string_view name);
+	void EndGroup();
+
+	// Keeps a transient texture (and its producers) alive until the next Reset, e.g. for the editor
+	void Extract(FrameGraphResource resource);
+
+	void Compile();
+	void Execute(GPUProfiler* pProfiler);
+
+	// Copies the color of a resource into the executing pass's first color target, over its render area.
+	// Resolves multisampled resources
+	void BlitFrom(FrameGraphResource source);
+
+	// Only valid while the pass using it executes (or until Reset for extracted resources)
+	GLuint GetTexture(FrameGraphResource resource);
+	const FrameGraphTextureDesc& GetDesc(FrameGraphResource resource);
+
+	const std::vector<PassInfo>& GetPasses();
+	const Stats& GetStats();
+
+private:
+	struct Resource {
+		const char* name;
+		FrameGraphTextureDesc desc;
+		GLuint texture = 0;
+		bool imported = false;
+		bool backbuffer = false;
+		bool extracted = false;
+		int firstPass = -1, lastPass = -1;
+		int poolIndex = -1;
+	};
+
+	struct Node {
+		int resource;
+		int producer;
+		int refCount;
+	};
+
+	struct Pass {
+		explicit Pass(std::pmr::memory_resource* pResource) : reads(pResource), writes(pResource) {}
+
+		const char* name = nullptr;
+		int group = -1;
+
+		// Closure in the arena and the functions calling and destroying it, which know its type
+		void* execute = nullptr;
+		void (*invoke)(void*, FrameGraph&) = nullptr;
+		void (*destroy)(void*) = nullptr;
+
+		std::pmr::vector<FrameGraphResource> reads, writes;
+		GLbitfield clearMask = 0;
+		glm::vec4 clearColor = glm::vec4(0.0f);
+		bool sideEffect = false;
+		int renderWidth = 0, renderHeight = 0;
+		int refCount = 0;
+		bool culled = false;
+	};
+
+	struct PooledTexture {
+		FrameGraphTextureDesc desc;
+		GLuint texture;
+		size_t bytes;
+		bool inUse;
+		uint64_t lastUsedFrame;
+	};
+
+	// Color attachments in order, zero for unused slots, then the depth attachment
+	typedef std::array<GLuint, MAX_COLOR_TARGETS + 1> FramebufferKey;
+
+	int NewPass(std::string_view name);
+	FrameGraphResource AddNode(int resource, int producer);
+	void Acquire(Resource& resource);
+	void Release(Resource& resource);
+	void BindTargets(const Pass& pass);
+	GLuint GetFramebuffer(const GLuint* colors, int colorCount, GLuint depth, GLenum depthAttachment);
+	void RetireUnusedTextures(uint64_t maxAge);
+	void UpdatePoolStats();
+	static bool IsDepthFormat(GLenum internalFormat);
+
+	FrameArena* mArena;
+
+	std::vector<Pass> mPasses;
+	std::vector<Resource> mResources;
+	std::vector<Node> mNodes;
+	std::vector<const char*> mGroups;
+	int mCurrentGroup;
+
+	std::vector<PooledTexture> mPool;
+
+	std::map<FramebufferKey, GLuint> mFramebuffers;
+
+	// Render targets and render area of the executing pass
+	GLuint mPassFramebuffer;
+	int mViewportWidth, mViewportHeight;
+
+	uint64_t mFrame;
+	std::vector<PassInfo> mPassInfos;
+	Stats mStats;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstring>
+
+#include "imgui/imgui.h"
+#include "TransformSystem.h"
+
+class Shape;
+
+// ImGui draw data that outlives the ImGui frame. ImGui reuses its own lists on the next NewFrame.
+// The copies are kept from one capture to the next and only grow, so capturing a steady UI doesn't allocate
+struct UIDrawData {
+	ImDrawData data;
+	std::vector<ImDrawList*> lists;
+
+	UIDrawData() {}
+	UIDrawData(const UIDrawData&) = delete;
+	UIDrawData& operator=(const UIDrawData&) = delete;
+	~UIDrawData() {
+		for (ImDrawList* list : lists) {
+			IM_DELETE(list);
+		}
+	}
+
+	void Capture(const ImDrawData* source) {
+		data = *source;
+		while (static_cast<int>(lists.size()) < source->CmdListsCount) {
+			lists.push_back(IM_NEW(ImDrawList)(source->CmdLists[lists.size()]->_Data));
+		}
+		for (int i = 0; i < source->CmdListsCount; i++) {
+			const ImDrawList* from = source->CmdLists[i];
+			ImDrawList* to = lists[i];
+			to->Flags = from->Flags;
+			CopyVector(to->CmdBuffer, from->CmdBuffer);
+			CopyVector(to->IdxBuffer, from->IdxBuffer);
+			CopyVector(to->VtxBuffer, from->VtxBuffer);
+		}
+		data.CmdLists = lists.data();
+	}
+
+	// ImVector's assignment frees before copying, resize keeps the capacity
+	template <typename T>
+	static void CopyVector(ImVector<T>& to, const ImVector<T>& from) {
+		to.resize(from.Size);
+		if (from.Size > 0) {
+			memcpy(to.Data, from.Data, from.Size * sizeof(T));
+		}
+	}
+};
+
+// What one frame is rendered from, built by Renderer::Prepare: everything the main thread keeps changing
+// while the frame is submitted on the render thread. Shapes themselves and the render settings are only
+// edited by the editor, which never runs during submission (RenderThread), so they aren't copied
+struct FrameSnapshot {
+	struct Light {
+		glm::vec3 position;
+		glm::vec3 color;
+	};
+
+	int windowWidth = 0, windowHeight = 0;
+
+	glm::mat4 view = glm::mat4(1.0f);
+	glm::vec3 cameraPosition = glm::vec3(0.0f);
+	float zoom = 45.0f;
+
+	// Sample of the playing song the shapes pulse with
+	short audioSample = 0;
+
+	// Shapes to draw, and their world matrices by transform handle
+	std::vector<Shape*> shapes;
+	TransformSystem::Snapshot transforms;
+
+	// The shadowed light is the "Light Source" shape
+	std::vector<Light> lights;
+	bool hasShadowLight = false;
+	glm::vec3 shadowLightPosition = glm::vec3(0.0f);
+
+	// Editor UI drawn over the frame, only used with the render thread
+	UIDrawData ui;
+};
@@ -20,8 +20,20 @@ uniform mat4 proj;
 
 uniform vec3 viewPos;
 
+// Unjittered view-projections of this and the last frame, for velocity
+layout(std140) uniform MotionVectors {
+	mat4 currViewProj;
+	mat4 prevViewProj;
+};
+uniform mat4 prevModel;
+
+out vec4 CurrClipPos;
+out vec4 PrevClipPos;
+
 void main() {
 	gl_Position = proj * view * model * vec4(aPos, 1.0);
+	CurrClipPos = currViewProj * model * vec4(aPos, 1.0);
+	PrevClipPos = prevViewProj * prevModel * vec4(aPos, 1.0);
 	TexCoords = aTexCoords;
 	Normal = transpose(inverse(mat3(model))) * aNormal;
 	FragPos = vec3(model * vec4(aPos, 1.0f));
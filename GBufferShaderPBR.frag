@@ -5,6 +5,9 @@ layout (location = 1) out vec4 gNormal;
 layout (location = 2) out vec4 gAlbedo;
 layout (location = 3) out vec4 gRoughMetalAO;
 
+// Screen-space motion since last frame in UV units, for TAA
+layout (location = 4) out vec2 gVelocity;
+
 in vec2 TexCoords;
 in vec3 FragPos;
 in vec3 Normal;
@@ -14,6 +17,9 @@ in vec3 TangentFragPos;
 
 in mat3 TBN;
 
+in vec4 CurrClipPos;
+in vec4 PrevClipPos;
+
 uniform vec3 albedo;
 
 uniform float roughness;
@@ -39,6 +45,7 @@ uniform float heightScale;
 
 void main() {
 	gPosition = vec4(FragPos, 1.0f);
+	gVelocity = 0.5 * (CurrClipPos.xy / CurrClipPos.w - PrevClipPos.xy / PrevClipPos.w);
 
 	if (packEnabled) {
 
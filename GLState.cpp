@@ -0,0 +1,343 @@
+#include "GLState.h"
+#include "MemoryTracker.h"
+
+#include <climits>
+
+// Never a valid name or enum, so the first call after Invalidate is always issued
+const GLuint UNKNOWN = UINT_MAX;
+
+void GLState::Invalidate() {
+	State& state = GetState();
+
+	state.program = UNKNOWN;
+	state.vao = UNKNOWN;
+	state.drawFramebuffer = UNKNOWN;
+	state.readFramebuffer = UNKNOWN;
+	for (GLint& value : state.viewport) {
+		value = -1;
+	}
+
+	state.depthTest = -1;
+	state.stencilTest = -1;
+	state.blend = -1;
+	state.cullFace = -1;
+	state.depthMask = -1;
+
+	state.depthFunc = UNKNOWN;
+	state.stencilFunc = UNKNOWN;
+	state.stencilRef = INT_MIN;
+	state.stencilFuncMask = UNKNOWN;
+	for (GLenum& op : state.stencilOp) {
+		op = UNKNOWN;
+	}
+	state.stencilMask = UNKNOWN;
+	state.blendSource = UNKNOWN;
+	state.blendDestination = UNKNOWN;
+	state.blendEquation = UNKNOWN;
+
+	state.activeTexture = UNKNOWN;
+	for (auto& unit : state.textures) {
+		for (GLuint& texture : unit) {
+			texture = UNKNOWN;
+		}
+	}
+}
+
+void GLState::ResetStats() {
+	GetMutableStats() = Stats();
+}
+
+const GLState::Stats& GLState::GetStats() {
+	return GetMutableStats();
+}
+
+const char* GLState::GetCategoryName(Category category) {
+	switch (category) {
+	case Category::PROGRAM: return "Program";
+	case Category::VERTEX_ARRAY: return "Vertex Array";
+	case Category::FRAMEBUFFER: return "Framebuffer";
+	case Category::VIEWPORT: return "Viewport";
+	case Category::CAPABILITY: return "Enable/Disable";
+	case Category::DEPTH: return "Depth";
+	case Category::STENCIL: return "Stencil";
+	case Category::BLEND: return "Blend";
+	case Category::TEXTURE: return "Texture";
+	default: return "";
+	}
+}
+
+void GLState::UseProgram(GLuint program) {
+	State& state = GetState();
+	if (Skip(Category::PROGRAM, state.program == program)) {
+		return;
+	}
+	glUseProgram(program);
+	state.program = program;
+}
+
+void GLState::BindVertexArray(GLuint vao) {
+	State& state = GetState();
+	if (Skip(Category::VERTEX_ARRAY, state.vao == vao)) {
+		return;
+	}
+	glBindVertexArray(vao);
+	state.vao = vao;
+}
+
+void GLState::BindFramebuffer(GLenum target, GLuint framebuffer) {
+	State& state = GetState();
+	bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+	bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+	bool unchanged = (!draw || state.drawFramebuffer == framebuffer) && (!read || state.readFramebuffer == framebuffer);
+	if (Skip(Category::FRAMEBUFFER, unchanged)) {
+		return;
+	}
+
+	glBindFramebuffer(target, framebuffer);
+	if (draw) {
+		state.drawFramebuffer = framebuffer;
+	}
+	if (read) {
+		state.readFramebuffer = framebuffer;
+	}
+}
+
+void GLState::Viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+	State& state = GetState();
+	bool unchanged = state.viewport[0] == x && state.viewport[1] == y && state.viewport[2] == width && state.viewport[3] == height;
+	if (Skip(Category::VIEWPORT, unchanged)) {
+		return;
+	}
+
+	glViewport(x, y, width, height);
+	state.viewport[0] = x;
+	state.viewport[1] = y;
+	state.viewport[2] = width;
+	state.viewport[3] = height;
+}
+
+void GLState::Enable(GLenum capability) {
+	SetCapability(capability, true);
+}
+
+void GLState::Disable(GLenum capability) {
+	SetCapability(capability, false);
+}
+
+void GLState::DepthFunc(GLenum func) {
+	State& state = GetState();
+	if (Skip(Category::DEPTH, state.depthFunc == func)) {
+		return;
+	}
+	glDepthFunc(func);
+	state.depthFunc = func;
+}
+
+void GLState::DepthMask(GLboolean flag) {
+	State& state = GetState();
+	if (Skip(Category::DEPTH, state.depthMask == flag)) {
+		return;
+	}
+	glDepthMask(flag);
+	state.depthMask = flag;
+}
+
+void GLState::StencilFunc(GLenum func, GLint ref, GLuint mask) {
+	State& state = GetState();
+	if (Skip(Category::STENCIL, state.stencilFunc == func && state.stencilRef == ref && state.stencilFuncMask == mask)) {
+		return;
+	}
+	glStencilFunc(func, ref, mask);
+	state.stencilFunc = func;
+	state.stencilRef = ref;
+	state.stencilFuncMask = mask;
+}
+
+void GLState::StencilOp(GLenum stencilFail, GLenum depthFail, GLenum depthPass) {
+	State& state = GetState();
+	bool unchanged = state.stencilOp[0] == stencilFail && state.stencilOp[1] == depthFail && state.stencilOp[2] == depthPass;
+	if (Skip(Category::STENCIL, unchanged)) {
+		return;
+	}
+	glStencilOp(stencilFail, depthFail, depthPass);
+	state.stencilOp[0] = stencilFail;
+	state.stencilOp[1] = depthFail;
+	state.stencilOp[2] = depthPass;
+}
+
+void GLState::StencilMask(GLuint mask) {
+	State& state = GetState();
+	if (Skip(Category::STENCIL, state.stencilMask == mask)) {
+		return;
+	}
+	glStencilMask(mask);
+	state.stencilMask = mask;
+}
+
+void GLState::BlendFunc(GLenum sourceFactor, GLenum destinationFactor) {
+	State& state = GetState();
+	if (Skip(Category::BLEND, state.blendSource == sourceFactor && state.blendDestination == destinationFactor)) {
+		return;
+	}
+	glBlendFunc(sourceFactor, destinationFactor);
+	state.blendSource = sourceFactor;
+	state.blendDestination = destinationFactor;
+}
+
+void GLState::BlendEquation(GLenum mode) {
+	State& state = GetState();
+	if (Skip(Category::BLEND, state.blendEquation == mode)) {
+		return;
+	}
+	glBlendEquation(mode);
+	state.blendEquation = mode;
+}
+
+void GLState::ActiveTexture(GLenum unit) {
+	State& state = GetState();
+	if (Skip(Category::TEXTURE, state.activeTexture == unit)) {
+		return;
+	}
+	glActiveTexture(unit);
+	state.activeTexture = unit;
+}
+
+void GLState::BindTexture(GLenum target, GLuint texture) {
+	State& state = GetState();
+	int targetIndex = GetTextureTarget(target);
+	int unit = static_cast<int>(state.activeTexture - GL_TEXTURE0);
+	bool tracked = state.activeTexture != UNKNOWN && unit < MAX_TEXTURE_UNITS && targetIndex != -1;
+
+	if (Skip(Category::TEXTURE, tracked && state.textures[unit][targetIndex] == texture)) {
+		return;
+	}
+	glBindTexture(target, texture);
+	if (tracked) {
+		state.textures[unit][targetIndex] = texture;
+	}
+}
+
+void GLState::DeleteProgram(GLuint program) {
+	// A deleted program stays in use until something else is bound, its name isn't freed before that
+	State& state = GetState();
+	glDeleteProgram(program);
+	if (state.program == program) {
+		state.program = UNKNOWN;
+	}
+}
+
+void GLState::DeleteVertexArrays(GLsizei count, const GLuint* vaos) {
+	State& state = GetState();
+	glDeleteVertexArrays(count, vaos);
+	for (GLsizei i = 0; i < count; i++) {
+		if (state.vao == vaos[i]) {
+			state.vao = 0;
+		}
+	}
+}
+
+void GLState::DeleteFramebuffers(GLsizei count, const GLuint* framebuffers) {
+	State& state = GetState();
+	glDeleteFramebuffers(count, framebuffers);
+	for (GLsizei i = 0; i < count; i++) {
+		if (state.drawFramebuffer == framebuffers[i]) {
+			state.drawFramebuffer = 0;
+		}
+		if (state.readFramebuffer == framebuffers[i]) {
+			state.readFramebuffer = 0;
+		}
+	}
+}
+
+void GLState::DeleteTextures(GLsizei count, const GLuint* textures) {
+	State& state = GetState();
+	glDeleteTextures(count, textures);
+	for (GLsizei i = 0; i < count; i++) {
+		MemoryTracker::UntrackGPU(GPUObject::TEXTURE, textures[i]);
+		for (auto& unit : state.textures) {
+			for (GLuint& texture : unit) {
+				if (texture == textures[i]) {
+					texture = 0;
+				}
+			}
+		}
+	}
+}
+
+void GLState::DeleteBuffers(GLsizei count, const GLuint* buffers) {
+	glDeleteBuffers(count, buffers);
+	for (GLsizei i = 0; i < count; i++) {
+		MemoryTracker::UntrackGPU(GPUObject::BUFFER, buffers[i]);
+	}
+}
+
+void GLState::DeleteRenderbuffers(GLsizei count, const GLuint* renderbuffers) {
+	glDeleteRenderbuffers(count, renderbuffers);
+	for (GLsizei i = 0; i < count; i++) {
+		MemoryTracker::UntrackGPU(GPUObject::RENDERBUFFER, renderbuffers[i]);
+	}
+}
+
+GLState::State& GLState::GetState() {
+	// Nothing is known about the context before the first call
+	static State state;
+	static bool initialized = false;
+	if (!initialized) {
+		initialized = true;
+		Invalidate();
+	}
+	return state;
+}
+
+GLState::Stats& GLState::GetMutableStats() {
+	static Stats stats;
+	return stats;
+}
+
+bool GLState::Skip(Category category, bool unchanged) {
+	Stats& stats = GetMutableStats();
+	if (unchanged) {
+		stats.filtered[static_cast<int>(category)]++;
+	}
+	else {
+		stats.issued[static_cast<int>(category)]++;
+	}
+	return unchanged;
+}
+
+int* GLState::GetCapability(GLenum capability) {
+	State& state = GetState();
+	switch (capability) {
+	case GL_DEPTH_TEST: return &state.depthTest;
+	case GL_STENCIL_TEST: return &state.stencilTest;
+	case GL_BLEND: return &state.blend;
+	case GL_CULL_FACE: return &state.cullFace;
+	default: return nullptr;
+	}
+}
+
+int GLState::GetTextureTarget(GLenum target) {
+	switch (target) {
+	case GL_TEXTURE_2D: return 0;
+	case GL_TEXTURE_2D_MULTISAMPLE: return 1;
+	case GL_TEXTURE_CUBE_MAP: return 2;
+	default: return -1;
+	}
+}
+
+void GLState::SetCapability(GLenum capability, bool enabled) {
+	int* current = GetCapability(capability);
+	if (Skip(Category::CAPABILITY, current && *current == static_cast<int>(enabled))) {
+		return;
+	}
+
+	if (enabled) {
+		glEnable(capability);
+	}
+	else {
+		glDisable(capability);
+	}
+	if (current) {
+		*current = enabled;
+	}
+}
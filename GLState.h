@@ -0,0 +1,108 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Shadow copy of the GL state the renderer changes most: program, VAO, framebuffers, viewport,
+// depth/stencil/blend state and texture bindings. Setters skip the driver call when the value is
+// already current. This only holds while everything that changes that state goes through here,
+// so call Invalidate after code that doesn't (ImGui's backend)
+class GLState
+{
+public:
+	enum class Category {
+		PROGRAM,
+		VERTEX_ARRAY,
+		FRAMEBUFFER,
+		VIEWPORT,
+		CAPABILITY,
+		DEPTH,
+		STENCIL,
+		BLEND,
+		TEXTURE,
+		NUM
+	};
+
+	// Calls made to the driver since the last ResetStats, and the ones dropped as no-ops
+	struct Stats {
+		int issued[static_cast<int>(Category::NUM)] = {};
+		int filtered[static_cast<int>(Category::NUM)] = {};
+	};
+
+	// Bindings on higher units aren't tracked, they go straight to the driver
+	static const int MAX_TEXTURE_UNITS = 16;
+
+	// Forgets everything, the next call of each kind is issued
+	static void Invalidate();
+	static void ResetStats();
+	static const Stats& GetStats();
+	static const char* GetCategoryName(Category category);
+
+	static void UseProgram(GLuint program);
+	static void BindVertexArray(GLuint vao);
+
+	// GL_FRAMEBUFFER binds both the draw and the read framebuffer
+	static void BindFramebuffer(GLenum target, GLuint framebuffer);
+	static void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+	// Depth test, stencil test, blending and face culling are tracked, other capabilities go straight through
+	static void Enable(GLenum capability);
+	static void Disable(GLenum capability);
+
+	static void DepthFunc(GLenum func);
+	static void DepthMask(GLboolean flag);
+	static void StencilFunc(GLenum func, GLint ref, GLuint mask);
+	static void StencilOp(GLenum stencilFail, GLenum depthFail, GLenum depthPass);
+	static void StencilMask(GLuint mask);
+	static void BlendFunc(GLenum sourceFactor, GLenum destinationFactor);
+	static void BlendEquation(GLenum mode);
+
+	// Binds on the active unit. 2D, multisampled 2D and cube map targets are tracked
+	static void ActiveTexture(GLenum unit);
+	static void BindTexture(GLenum target, GLuint texture);
+
+	// Deleting a bound object unbinds it, and the driver can hand its name out again right away
+	static void DeleteProgram(GLuint program);
+	static void DeleteVertexArrays(GLsizei count, const GLuint* vaos);
+	static void DeleteFramebuffers(GLsizei count, const GLuint* framebuffers);
+	static void DeleteTextures(GLsizei count, const GLuint* textures);
+
+	// Not bound through here, but deleting takes them off MemoryTracker like textures
+	static void DeleteBuffers(GLsizei count, const GLuint* buffers);
+	static void DeleteRenderbuffers(GLsizei count, const GLuint* renderbuffers);
+
+private:
+	static const int TEXTURE_TARGETS = 3;
+
+	struct State {
+		GLuint program;
+		GLuint vao;
+		GLuint drawFramebuffer, readFramebuffer;
+		GLint viewport[4];
+
+		// -1 while unknown
+		int depthTest, stencilTest, blend, cullFace;
+		int depthMask;
+
+		GLenum depthFunc;
+		GLenum stencilFunc;
+		GLint stencilRef;
+		GLuint stencilFuncMask;
+		GLenum stencilOp[3];
+		GLuint stencilMask;
+		GLenum blendSource, blendDestination;
+		GLenum blendEquation;
+
+		GLenum activeTexture;
+		GLuint textures[MAX_TEXTURE_UNITS][TEXTURE_TARGETS];
+	};
+
+	static State& GetState();
+	static Stats& GetMutableStats();
+
+	// Counts the call either way. True if it can be dropped
+	static bool Skip(Category category, bool unchanged);
+
+	static int* GetCapability(GLenum capability);
+	static int GetTextureTarget(GLenum target);
+	static void SetCapability(GLenum capability, bool enabled);
+};
@@ -0,0 +1,130 @@
+#include "GPUProfiler.h"
+
+// Weight of the newest sample in the moving average shown in the editor
+const float SMOOTHING = 0.1f;
+
+GPUProfiler::GPUProfiler() : mCurrentFrame(0), mFrameTime(0.0f) {}
+
+GPUProfiler::~GPUProfiler() {
+	for (auto& frame : mFrames) {
+		if (!frame.queryPool.empty()) {
+			glDeleteQueries(static_cast<GLsizei>(frame.queryPool.size()), frame.queryPool.data());
+		}
+	}
+}
+
+void GPUProfiler::BeginFrame() {
+	mCurrentFrame = (mCurrentFrame + 1) % FRAMES_IN_FLIGHT;
+	Frame& frame = mFrames[mCurrentFrame];
+
+	// The slot we are about to reuse was submitted FRAMES_IN_FLIGHT frames ago
+	if (frame.pending) {
+		CollectFrame(frame);
+	}
+
+	frame.scopes.clear();
+	frame.queriesUsed = 0;
+	mOpenScopes.clear();
+
+	Begin("Frame");
+}
+
+void GPUProfiler::EndFrame() {
+	End();
+	mFrames[mCurrentFrame].pending = true;
+}
+
+void GPUProfiler::Begin(std::string_view name) {
+	Frame& frame = mFrames[mCurrentFrame];
+
+	Scope scope;
+	scope.name = Intern(name);
+	scope.depth = static_cast<int>(mOpenScopes.size());
+	scope.startQuery = NextQuery(frame);
+	scope.endQuery = NextQuery(frame);
+	glQueryCounter(scope.startQuery, GL_TIMESTAMP);
+
+	mOpenScopes.push_back(static_cast<int>(frame.scopes.size()));
+	frame.scopes.push_back(scope);
+}
+
+void GPUProfiler::End() {
+	if (mOpenScopes.empty()) {
+		return;
+	}
+
+	Frame& frame = mFrames[mCurrentFrame];
+	glQueryCounter(frame.scopes[mOpenScopes.back()].endQuery, GL_TIMESTAMP);
+	mOpenScopes.pop_back();
+}
+
+const std::vector<GPUProfiler::Timing>& GPUProfiler::GetTimings() {
+	return mTimings;
+}
+
+float GPUProfiler::GetTiming(std::string_view name) {
+	auto it = mNameIDs.find(name);
+	if (it == mNameIDs.end()) {
+		return 0.0f;
+	}
+	float ms = mSmoothedTimings[it->second];
+	return ms >= 0.0f ? ms : 0.0f;
+}
+
+float GPUProfiler::GetFrameTime() {
+	return mFrameTime;
+}
+
+int GPUProfiler::Intern(std::string_view name) {
+	auto it = mNameIDs.find(name);
+	if (it != mNameIDs.end()) {
+		return it->second;
+	}
+
+	int id = static_cast<int>(mNames.size());
+	mNameIDs[mNames.emplace_back(name)] = id;
+	mSmoothedTimings.push_back(-1.0f);
+	return id;
+}
+
+GLuint GPUProfiler::NextQuery(Frame& frame) {
+	if (frame.queriesUsed == static_cast<int>(frame.queryPool.size())) {
+		GLuint query;
+		glGenQueries(1, &query);
+		frame.queryPool.push_back(query);
+	}
+	return frame.queryPool[frame.queriesUsed++];
+}
+
+void GPUProfiler::CollectFrame(Frame& frame) {
+	frame.pending = false;
+
+	// If the driver is still behind, skip this sample instead of stalling
+	if (!frame.scopes.empty()) {
+		GLint available = 0;
+		glGetQueryObjectiv(frame.scopes.back().endQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			return;
+		}
+	}
+
+	mTimings.clear();
+	for (const auto& scope : frame.scopes) {
+		GLuint64 start, end;
+		glGetQueryObjectui64v(scope.startQuery, GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(scope.endQuery, GL_QUERY_RESULT, &end);
+		float ms = static_cast<float>(end - start) / 1000000.0f;
+
+		float& smoothed = mSmoothedTimings[scope.name];
+		if (smoothed < 0.0f) {
+			smoothed = ms;
+		}
+		else {
+			smoothed += (ms - smoothed) * SMOOTHING;
+		}
+
+		mTimings.push_back({ mNames[scope.name].c_str(), smoothed, scope.depth });
+	}
+
+	mFrameTime = GetTiming("Frame");
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+
+// Measures GPU time of named render stages with timestamp queries.
+// Results are read back a few frames late so the CPU never waits on the GPU.
+// Names are interned the first time they are seen, after that profiling a scope doesn't allocate.
+class GPUProfiler
+{
+public:
+	struct Timing {
+		const char* name;
+		float ms;
+		int depth;
+	};
+
+	GPUProfiler();
+	~GPUProfiler();
+
+	void BeginFrame();
+	void EndFrame();
+
+	// Scopes can be nested
+	void Begin(std::string_view name);
+	void End();
+
+	// Smoothed timings of the latest frame that finished on the GPU, in submission order
+	const std::vector<Timing>& GetTimings();
+	float GetTiming(std::string_view name);
+	float GetFrameTime();
+
+private:
+	static const int FRAMES_IN_FLIGHT = 3;
+
+	struct Scope {
+		int name;
+		GLuint startQuery, endQuery;
+		int depth;
+	};
+
+	struct Frame {
+		std::vector<Scope> scopes;
+		std::vector<GLuint> queryPool;
+		int queriesUsed = 0;
+		bool pending = false;
+	};
+
+	// Index of the name in mNames, added if it is new
+	int Intern(std::string_view name);
+	GLuint NextQuery(Frame& frame);
+	void CollectFrame(Frame& frame);
+
+	Frame mFrames[FRAMES_IN_FLIGHT];
+	int mCurrentFrame;
+	std::vector<int> mOpenScopes;
+
+	// Keys point into mNames, whose strings never move
+	std::unordered_map<std::string_view, int> mNameIDs;
+	std::deque<std::string> mNames;
+
+	std::vector<Timing> mTimings;
+	// Indexed by name, negative until the scope has been measured once
+	std::vector<float> mSmoothedTimings;
+	float mFrameTime;
+};
+
+// Profiles everything between construction and the end of the enclosing block
+struct GPUProfileScope {
+	GPUProfileScope(GPUProfiler* profiler, std::string_view name) : mProfiler(profiler) { mProfiler->Begin(name); }
+	~GPUProfileScope() { mProfiler->End(); }
+
+	GPUProfiler* mProfiler;
+};
@@ -0,0 +1,86 @@
+#include "GaussianBlur.h"
+#include "GLState.h"
+
+#include <cmath>
+#include <algorithm>
+#include <string>
+
+// Radius one pass may cover at its own resolution before dropping to the next lower one
+const float MAX_RADIUS_PER_LEVEL = 12.0f;
+
+// Full, half and quarter resolution
+const int LEVEL_COUNT = 3;
+
+GaussianBlur::GaussianBlur() : mBlurShader(new Shader("ScreenShader.vert", "GaussianBlur.frag", nullptr,
+	{ "MAX_TAPS " + std::to_string(MAX_TAPS) })), mTapCount(0) {
+	mBlurShader->Use();
+	mBlurShader->SetInt("sourceTexture", 0);
+}
+
+GaussianBlur::~GaussianBlur() {
+	delete mBlurShader;
+}
+
+void GaussianBlur::Downsample(GLuint sourceTexture, QuadMesh* pQuadMesh) {
+	// The center tap alone, at the corner shared by the four source texels
+	const GLfloat weight = 1.0f;
+	mBlurShader->Use();
+	mBlurShader->SetInt("tapCount", 1);
+	mBlurShader->SetFloatArray("weights", &weight, 1);
+
+	pQuadMesh->BindVAO();
+	GLState::ActiveTexture(GL_TEXTURE0);
+	GLState::BindTexture(GL_TEXTURE_2D, sourceTexture);
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+}
+
+void GaussianBlur::Pass(GLuint sourceTexture, float texelX, float texelY, QuadMesh* pQuadMesh) {
+	mBlurShader->Use();
+	mBlurShader->SetInt("tapCount", mTapCount);
+	mBlurShader->SetFloatArray("offsets", mOffsets, mTapCount);
+	mBlurShader->SetFloatArray("weights", mWeights, mTapCount);
+	mBlurShader->SetVec2("direction", texelX, texelY);
+
+	pQuadMesh->BindVAO();
+	GLState::ActiveTexture(GL_TEXTURE0);
+	GLState::BindTexture(GL_TEXTURE_2D, sourceTexture);
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+}
+
+int GaussianBlur::SetRadius(float radius) {
+	int levelIndex = 0;
+	while (levelIndex < LEVEL_COUNT - 1 && radius > MAX_RADIUS_PER_LEVEL) {
+		radius *= 0.5f;
+		++levelIndex;
+	}
+
+	// Discrete Gaussian over [-r, r] with the radius at 3 sigma
+	int r = std::min(static_cast<int>(std::ceil(radius)), 2 * (MAX_TAPS - 1));
+	r = std::max(r, 1);
+	float sigma = std::max(radius, 1.0f) / 3.0f;
+
+	// Called every frame the blur is on, so the weights stay on the stack
+	float weights[2 * MAX_TAPS - 1];
+	float sum = 0.0f;
+	for (int i = 0; i <= r; ++i) {
+		weights[i] = std::exp(-0.5f * i * i / (sigma * sigma));
+		sum += i == 0 ? weights[i] : 2.0f * weights[i];
+	}
+	for (int i = 0; i <= r; ++i) {
+		weights[i] /= sum;
+	}
+
+	// Fold neighbouring taps (i, i + 1) into one bilinear fetch placed at their weighted center
+	mOffsets[0] = 0.0f;
+	mWeights[0] = weights[0];
+	mTapCount = 1;
+	for (int i = 1; i <= r; i += 2) {
+		float w0 = weights[i];
+		float w1 = i + 1 <= r ? weights[i + 1] : 0.0f;
+		mWeights[mTapCount] = w0 + w1;
+		mOffsets[mTapCount] = (i * w0 + (i + 1) * w1) / (w0 + w1);
+		++mTapCount;
+	}
+
+	return 1 << levelIndex;
+}
@@ -0,0 +1,28 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// MAX_TAPS is defined by GaussianBlur.cpp
+
+uniform sampler2D sourceTexture;
+
+// One texel of sourceTexture along the blur axis, in UV. Source and target have the same size
+uniform vec2 direction;
+
+// Tap 0 is the center, the others are mirrored. Offsets sit between texel pairs so the
+// bilinear filter returns both texels already weighted
+uniform int tapCount;
+uniform float offsets[MAX_TAPS];
+uniform float weights[MAX_TAPS];
+
+void main()
+{
+	vec4 color = texture(sourceTexture, TexCoords) * weights[0];
+	for (int i = 1; i < tapCount; i++) {
+		vec2 offset = direction * offsets[i];
+		color += texture(sourceTexture, TexCoords + offset) * weights[i];
+		color += texture(sourceTexture, TexCoords - offset) * weights[i];
+	}
+	FragColor = color;
+}
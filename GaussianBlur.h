@@ -0,0 +1,40 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <vector>
+
+#include "Shader.h"
+#include "QuadMesh.h"
+
+// Separable Gaussian blur: a horizontal and a vertical pass, with pairs of taps folded into single
+// bilinear fetches. Large radii run at half or quarter resolution: the source is first box-filtered
+// down to that size in 2x steps, both passes then blur that level, and whoever samples the result
+// upsamples it with linear filtering. Targets are owned by the frame graph.
+class GaussianBlur
+{
+public:
+	// Most taps per side of one pass after folding. GaussianBlur.frag gets it as a define
+	static const int MAX_TAPS = 16;
+
+	GaussianBlur();
+	~GaussianBlur();
+
+	// Computes the folded weights for a radius in full resolution pixels (3 sigma).
+	// Returns how much the targets should be downscaled (1, 2 or 4)
+	int SetRadius(float radius);
+
+	// Halves sourceTexture into the bound target, one bilinear fetch per pixel averaging a 2x2 block.
+	// Run once per halving before the passes when SetRadius asks for a downscale
+	void Downsample(GLuint sourceTexture, QuadMesh* pQuadMesh);
+
+	// One direction into the bound target, which has the size of sourceTexture. texelX/texelY is one
+	// texel of it in UV units, (1 / width, 0) or (0, 1 / height)
+	void Pass(GLuint sourceTexture, float texelX, float texelY, QuadMesh* pQuadMesh);
+
+private:
+	Shader* mBlurShader;
+
+	int mTapCount;
+	GLfloat mOffsets[MAX_TAPS], mWeights[MAX_TAPS];
+};
@@ -0,0 +1,384 @@
+#include "IBLCache.h"
+#include "GLState.h"
+#include "MemoryTracker.h"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <algorithm>
+
+// Bump whenever the bake or the file layout changes so stale caches get re-baked
+const uint32_t CACHE_VERSION = 1;
+
+namespace {
+	struct FileHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t envSize;
+		uint32_t prefilterSize;
+		uint32_t prefilterMips;
+	};
+
+	// Face images are stored for env mip 0, then every prefilter mip, six faces each
+	const int IMAGE_COUNT = 6 * (1 + IBLCache::PREFILTER_MIP_LEVELS);
+
+	struct ImageInfo {
+		bool prefilter;
+		int face, mip, size;
+	};
+
+	ImageInfo GetImageInfo(int index) {
+		ImageInfo info;
+		info.prefilter = index >= 6;
+		info.face = index % 6;
+		info.mip = info.prefilter ? index / 6 - 1 : 0;
+		info.size = info.prefilter ? IBLCache::PREFILTER_MAP_SIZE >> info.mip : IBLCache::ENV_CUBEMAP_SIZE;
+		return info;
+	}
+
+	size_t GetImageElements(int size, int channels) {
+		return static_cast<size_t>(size) * size * channels;
+	}
+
+	FileHeader MakeHeader(const char* magic) {
+		FileHeader header;
+		std::memcpy(header.magic, magic, 4);
+		header.version = CACHE_VERSION;
+		header.envSize = IBLCache::ENV_CUBEMAP_SIZE;
+		header.prefilterSize = IBLCache::PREFILTER_MAP_SIZE;
+		header.prefilterMips = IBLCache::PREFILTER_MIP_LEVELS;
+		return header;
+	}
+
+	bool ReadHeader(std::ifstream& file, const char* magic) {
+		FileHeader header, expected = MakeHeader(magic);
+		file.read(reinterpret_cast<char*>(&header), sizeof(header));
+		return file && std::memcmp(&header, &expected, sizeof(header)) == 0;
+	}
+
+	// RGB16F cube with storage for mipLevels levels
+	GLuint CreateCubemap(int size, int mipLevels) {
+		MemoryScope scope(MemoryCategory::TEXTURES);
+		GLuint cubemap;
+		glGenTextures(1, &cubemap);
+		GLState::BindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+		for (int mip = 0; mip < mipLevels; ++mip) {
+			int mipSize = std::max(1, size >> mip);
+			for (int i = 0; i < 6; ++i) {
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, mip, GL_RGB16F, mipSize, mipSize, 0, GL_RGB, GL_FLOAT, nullptr);
+			}
+		}
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, mipLevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, mipLevels - 1);
+		MemoryTracker::TrackGPU(GPUObject::TEXTURE, cubemap, MemoryTracker::GetTextureBytes(GL_RGB16F, size, size, 6, mipLevels));
+		return cubemap;
+	}
+
+	int GetMipCount(int size) {
+		int mips = 1;
+		while (size > 1) {
+			size >>= 1;
+			++mips;
+		}
+		return mips;
+	}
+}
+
+IBLCache::IBLCache(const std::string& directory, size_t maxResident) : mDirectory(directory), mMaxResident(maxResident), mActive(nullptr) {}
+
+IBLCache::~IBLCache() {
+	for (auto& write : mWrites) {
+		write.wait();
+	}
+	for (auto& load : mLoads) {
+		load.second.wait();
+	}
+	for (auto& upload : mUploads) {
+		Destroy(upload.environment);
+	}
+	for (IBLEnvironment* environment : mResident) {
+		Destroy(environment);
+	}
+}
+
+IBLEnvironment* IBLCache::CreateEnvironment(const std::string& name) {
+	IBLEnvironment* environment = new IBLEnvironment();
+	environment->name = name;
+	environment->envCubemap = CreateCubemap(ENV_CUBEMAP_SIZE, GetMipCount(ENV_CUBEMAP_SIZE));
+	environment->prefilterMap = CreateCubemap(PREFILTER_MAP_SIZE, PREFILTER_MIP_LEVELS);
+
+	// RGB16F, full mip chain on the environment cube
+	for (int mip = 0; mip < GetMipCount(ENV_CUBEMAP_SIZE); ++mip) {
+		environment->gpuBytes += GetImageElements(std::max(1, ENV_CUBEMAP_SIZE >> mip), 3) * sizeof(uint16_t) * 6;
+	}
+	for (int mip = 0; mip < PREFILTER_MIP_LEVELS; ++mip) {
+		environment->gpuBytes += GetImageElements(PREFILTER_MAP_SIZE >> mip, 3) * sizeof(uint16_t) * 6;
+	}
+	return environment;
+}
+
+IBLEnvironment* IBLCache::Find(const std::string& name) {
+	auto it = mLookup.find(name);
+	if (it == mLookup.end()) {
+		return nullptr;
+	}
+
+	mResident.splice(mResident.begin(), mResident, it->second);
+	return mResident.front();
+}
+
+void IBLCache::Insert(IBLEnvironment* environment) {
+	auto it = mLookup.find(environment->name);
+	if (it != mLookup.end()) {
+		Destroy(*it->second);
+		mResident.erase(it->second);
+	}
+
+	mResident.push_front(environment);
+	mLookup[environment->name] = mResident.begin();
+	Evict();
+}
+
+void IBLCache::SetActive(IBLEnvironment* environment) {
+	mActive = environment;
+}
+
+bool IBLCache::RequestLoad(const std::string& name, const std::string& sourcePath) {
+	if (IsLoading(name)) {
+		return true;
+	}
+
+	std::string path = GetPath(name);
+	std::error_code error;
+	if (!std::filesystem::exists(path, error)) {
+		return false;
+	}
+	if (std::filesystem::exists(sourcePath, error) &&
+		std::filesystem::last_write_time(sourcePath, error) > std::filesystem::last_write_time(path, error)) {
+		return false;
+	}
+
+	// Reject files from an older bake before going to a worker thread
+	std::ifstream file(path, std::ios::binary);
+	if (!ReadHeader(file, "IBLC")) {
+		return false;
+	}
+
+	mLoads[name] = std::async(std::launch::async, ReadFile, path, name);
+	return true;
+}
+
+bool IBLCache::IsLoading(const std::string& name) {
+	if (mLoads.find(name) != mLoads.end()) {
+		return true;
+	}
+	for (auto& upload : mUploads) {
+		if (upload.data.name == name) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void IBLCache::WaitForLoad(const std::string& name) {
+	auto it = mLoads.find(name);
+	if (it != mLoads.end()) {
+		it->second.wait();
+	}
+}
+
+IBLEnvironment* IBLCache::Update(std::vector<std::string>& failedLoads, size_t budgetBytes) {
+	// Files that finished reading start uploading
+	for (auto it = mLoads.begin(); it != mLoads.end();) {
+		if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			++it;
+			continue;
+		}
+
+		PendingLoad data = it->second.get();
+		if (data.valid) {
+			PendingUpload upload;
+			upload.environment = CreateEnvironment(data.name);
+			upload.environment->irradianceSH = data.irradianceSH;
+			upload.data = std::move(data);
+			mUploads.push_back(std::move(upload));
+		}
+		else {
+			// Drop the broken file so the caller's bake writes a fresh one
+			std::cout << "Failed to read IBL cache for " << it->first << ", it will be re-baked." << '\n';
+			std::error_code error;
+			std::filesystem::remove(GetPath(it->first), error);
+			failedLoads.push_back(it->first);
+		}
+		it = mLoads.erase(it);
+	}
+
+	for (auto it = mWrites.begin(); it != mWrites.end();) {
+		if (it->wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+			it = mWrites.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	if (mUploads.empty()) {
+		return nullptr;
+	}
+
+	// One environment streams at a time, oldest request first
+	PendingUpload& upload = mUploads.front();
+	size_t uploadedBytes = 0;
+	while (upload.nextImage < upload.data.images.size() && uploadedBytes < budgetBytes) {
+		ImageInfo info = GetImageInfo(static_cast<int>(upload.nextImage));
+		const std::vector<uint16_t>& image = upload.data.images[upload.nextImage];
+
+		GLState::BindTexture(GL_TEXTURE_CUBE_MAP, info.prefilter ? upload.environment->prefilterMap : upload.environment->envCubemap);
+		glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + info.face, info.mip, 0, 0, info.size, info.size, GL_RGB, GL_HALF_FLOAT, image.data());
+
+		uploadedBytes += image.size() * sizeof(uint16_t);
+		++upload.nextImage;
+	}
+
+	if (upload.nextImage < upload.data.images.size()) {
+		return nullptr;
+	}
+
+	// Only mip 0 of the environment is stored, the rest is cheap to rebuild
+	IBLEnvironment* environment = upload.environment;
+	GLState::BindTexture(GL_TEXTURE_CUBE_MAP, environment->envCubemap);
+	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+
+	mUploads.erase(mUploads.begin());
+	Insert(environment);
+	return environment;
+}
+
+void IBLCache::Save(const IBLEnvironment& environment) {
+	std::vector<std::vector<uint16_t>> images(IMAGE_COUNT);
+	for (int i = 0; i < IMAGE_COUNT; ++i) {
+		ImageInfo info = GetImageInfo(i);
+		images[i].resize(GetImageElements(info.size, 3));
+
+		GLState::BindTexture(GL_TEXTURE_CUBE_MAP, info.prefilter ? environment.prefilterMap : environment.envCubemap);
+		glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + info.face, info.mip, GL_RGB, GL_HALF_FLOAT, images[i].data());
+	}
+
+	mWrites.push_back(std::async(std::launch::async, WriteFile, GetPath(environment.name), environment.irradianceSH, std::move(images)));
+}
+
+bool IBLCache::LoadBRDFLUT(GLuint texture) {
+	std::ifstream file(mDirectory + "/BRDF_LUT.bin", std::ios::binary);
+	if (!file.is_open() || !ReadHeader(file, "BRDF")) {
+		return false;
+	}
+
+	std::vector<uint16_t> data(GetImageElements(BRDF_LUT_SIZE, 2));
+	file.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(uint16_t));
+	if (!file) {
+		return false;
+	}
+
+	GLState::BindTexture(GL_TEXTURE_2D, texture);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, BRDF_LUT_SIZE, BRDF_LUT_SIZE, GL_RG, GL_HALF_FLOAT, data.data());
+	return true;
+}
+
+void IBLCache::SaveBRDFLUT(GLuint texture) {
+	std::vector<uint16_t> data(GetImageElements(BRDF_LUT_SIZE, 2));
+	GLState::BindTexture(GL_TEXTURE_2D, texture);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_HALF_FLOAT, data.data());
+
+	std::error_code error;
+	std::filesystem::create_directories(mDirectory, error);
+
+	std::ofstream file(mDirectory + "/BRDF_LUT.bin", std::ios::binary);
+	FileHeader header = MakeHeader("BRDF");
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(uint16_t));
+}
+
+const std::list<IBLEnvironment*>& IBLCache::GetResident() {
+	return mResident;
+}
+
+size_t IBLCache::GetResidentBytes() {
+	size_t bytes = 0;
+	for (IBLEnvironment* environment : mResident) {
+		bytes += environment->gpuBytes;
+	}
+	return bytes;
+}
+
+std::string IBLCache::GetPath(const std::string& name) {
+	return mDirectory + "/" + name + ".iblc";
+}
+
+IBLCache::PendingLoad IBLCache::ReadFile(std::string path, std::string name) {
+	PendingLoad data;
+	data.name = name;
+
+	std::ifstream file(path, std::ios::binary);
+	if (!ReadHeader(file, "IBLC")) {
+		return data;
+	}
+
+	file.read(reinterpret_cast<char*>(&data.irradianceSH), sizeof(SHIrradiance));
+	data.images.resize(IMAGE_COUNT);
+	for (int i = 0; i < IMAGE_COUNT; ++i) {
+		data.images[i].resize(GetImageElements(GetImageInfo(i).size, 3));
+		file.read(reinterpret_cast<char*>(data.images[i].data()), data.images[i].size() * sizeof(uint16_t));
+	}
+
+	data.valid = static_cast<bool>(file);
+	return data;
+}
+
+void IBLCache::WriteFile(std::string path, SHIrradiance irradianceSH, std::vector<std::vector<uint16_t>> images) {
+	std::error_code error;
+	std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+	// Write to a temporary and rename, so a crash mid-write never leaves a truncated cache behind
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary);
+		if (!file.is_open()) {
+			std::cout << "Failed to write IBL cache " << path << '\n';
+			return;
+		}
+
+		FileHeader header = MakeHeader("IBLC");
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(&irradianceSH), sizeof(SHIrradiance));
+		for (const auto& image : images) {
+			file.write(reinterpret_cast<const char*>(image.data()), image.size() * sizeof(uint16_t));
+		}
+	}
+	std::filesystem::rename(tempPath, path, error);
+}
+
+void IBLCache::Evict() {
+	auto it = mResident.end();
+	while (mResident.size() > mMaxResident && it != mResident.begin()) {
+		--it;
+		if (*it == mActive) {
+			continue;
+		}
+
+		IBLEnvironment* environment = *it;
+		mLookup.erase(environment->name);
+		it = mResident.erase(it);
+		Destroy(environment);
+	}
+}
+
+void IBLCache::Destroy(IBLEnvironment* environment) {
+	GLuint textures[] = { environment->envCubemap, environment->prefilterMap };
+	GLState::DeleteTextures(2, textures);
+	delete environment;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <future>
+#include <cstdint>
+
+#include "SphericalHarmonics.h"
+
+// Baked IBL products of one environment. Textures are owned by the IBLCache
+struct IBLEnvironment {
+	std::string name;
+	GLuint envCubemap = 0;
+	GLuint prefilterMap = 0;
+	SHIrradiance irradianceSH = {};
+	size_t gpuBytes = 0;
+};
+
+// Keeps baked environments resident on the GPU (least recently used are evicted past a cap)
+// and persists them to disk, so switching environments never has to re-bake.
+// Disk files store the environment cube (mip 0) and the whole prefiltered mip chain as half floats.
+class IBLCache
+{
+public:
+	static const int ENV_CUBEMAP_SIZE = 1024;
+	static const int PREFILTER_MAP_SIZE = 128;
+	static const int PREFILTER_MIP_LEVELS = 5;
+	static const int BRDF_LUT_SIZE = 512;
+
+	// Texture data uploaded per frame while an environment streams in from disk
+	static const size_t UPLOAD_BUDGET_BYTES = 8 * 1024 * 1024;
+
+	IBLCache(const std::string& directory, size_t maxResident);
+	~IBLCache();
+
+	// Allocates empty textures for an environment that is about to be baked or uploaded
+	IBLEnvironment* CreateEnvironment(const std::string& name);
+
+	// Resident environment or nullptr. Marks it as most recently used
+	IBLEnvironment* Find(const std::string& name);
+
+	// Takes ownership of a fully baked environment and evicts past the cap
+	void Insert(IBLEnvironment* environment);
+
+	// The environment being rendered with is never evicted
+	void SetActive(IBLEnvironment* environment);
+
+	// Starts reading the cache file on a worker thread. False if there is no file newer than the source HDR
+	bool RequestLoad(const std::string& name, const std::string& sourcePath);
+	bool IsLoading(const std::string& name);
+
+	// Blocks until the file read has finished, e.g. at startup when nothing is on screen yet
+	void WaitForLoad(const std::string& name);
+
+	// Call once per frame on the GL thread. Uploads at most budgetBytes of pending texture data
+	// and returns the environment that finished uploading this frame, if any.
+	// Names whose file couldn't be read are added to failedLoads, their file is deleted so they get re-baked
+	IBLEnvironment* Update(std::vector<std::string>& failedLoads, size_t budgetBytes = UPLOAD_BUDGET_BYTES);
+
+	// Reads the baked textures back and writes the cache file on a worker thread
+	void Save(const IBLEnvironment& environment);
+
+	// BRDF LUT is shared by all environments. Load returns false if it has to be baked
+	bool LoadBRDFLUT(GLuint texture);
+	void SaveBRDFLUT(GLuint texture);
+
+	const std::list<IBLEnvironment*>& GetResident();
+	size_t GetResidentBytes();
+
+private:
+	// CPU-side contents of a cache file, one entry per (mip, face) in upload order
+	struct PendingLoad {
+		std::string name;
+		bool valid = false;
+		SHIrradiance irradianceSH = {};
+		std::vector<std::vector<uint16_t>> images;
+	};
+
+	struct PendingUpload {
+		IBLEnvironment* environment = nullptr;
+		PendingLoad data;
+		size_t nextImage = 0;
+	};
+
+	std::string GetPath(const std::string& name);
+	static PendingLoad ReadFile(std::string path, std::string name);
+	static void WriteFile(std::string path, SHIrradiance irradianceSH, std::vector<std::vector<uint16_t>> images);
+	void Evict();
+	void Destroy(IBLEnvironment* environment);
+
+	std::string mDirectory;
+	size_t mMaxResident;
+	IBLEnvironment* mActive;
+
+	// Front is the most recently used
+	std::list<IBLEnvironment*> mResident;
+	std::unordered_map<std::string, std::list<IBLEnvironment*>::iterator> mLookup;
+
+	std::unordered_map<std::string, std::future<PendingLoad>> mLoads;
+	std::vector<PendingUpload> mUploads;
+	std::vector<std::future<void>> mWrites;
+};
@@ -0,0 +1,231 @@
+#include "IndirectDraw.h"
+#include "GLState.h"
+#include "MemoryTracker.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+
+// Must match local_size_x in IndirectCull.comp
+const GLuint CULL_GROUP_SIZE = 64;
+
+// First of the four attribute locations holding the instanced model matrix
+const GLuint MODEL_ATTRIBUTE = 5;
+
+// Objects a job culls on the CPU path
+const size_t CULL_OBJECTS_PER_JOB = 512;
+
+IndirectGeometry::IndirectGeometry() {
+	glGenBuffers(1, &mVBO);
+	glGenBuffers(1, &mEBO);
+}
+
+IndirectGeometry::~IndirectGeometry() {
+	GLState::DeleteBuffers(1, &mVBO);
+	GLState::DeleteBuffers(1, &mEBO);
+}
+
+unsigned int IndirectGeometry::AddMesh(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices) {
+	MeshRange range;
+	range.firstIndex = static_cast<GLuint>(mIndices.size());
+	range.indexCount = static_cast<GLuint>(indices.size());
+	range.baseVertex = static_cast<GLint>(mPositions.size());
+
+	// Sphere around the box center, loose but cheap to test
+	glm::vec3 minPosition(0.0f), maxPosition(0.0f);
+	if (!positions.empty()) {
+		minPosition = maxPosition = positions[0];
+	}
+	for (const glm::vec3& position : positions) {
+		minPosition = glm::min(minPosition, position);
+		maxPosition = glm::max(maxPosition, position);
+	}
+	glm::vec3 center = (minPosition + maxPosition) * 0.5f;
+	float radius = 0.0f;
+	for (const glm::vec3& position : positions) {
+		radius = std::max(radius, glm::length(position - center));
+	}
+	range.bounds = glm::vec4(center, radius);
+
+	mPositions.insert(mPositions.end(), positions.begin(), positions.end());
+	mIndices.insert(mIndices.end(), indices.begin(), indices.end());
+	mMeshes.push_back(range);
+	return static_cast<unsigned int>(mMeshes.size()) - 1;
+}
+
+void IndirectGeometry::Upload() {
+	glBindBuffer(GL_ARRAY_BUFFER, mVBO);
+	glBufferData(GL_ARRAY_BUFFER, mPositions.size() * sizeof(glm::vec3), mPositions.data(), GL_STATIC_DRAW);
+	MemoryTracker::TrackGPU(GPUObject::BUFFER, mVBO, mPositions.size() * sizeof(glm::vec3));
+
+	// Through the array buffer target, the element buffer binding belongs to whichever VAO is bound
+	glBindBuffer(GL_ARRAY_BUFFER, mEBO);
+	glBufferData(GL_ARRAY_BUFFER, mIndices.size() * sizeof(GLuint), mIndices.data(), GL_STATIC_DRAW);
+	MemoryTracker::TrackGPU(GPUObject::BUFFER, mEBO, mIndices.size() * sizeof(GLuint));
+}
+
+const IndirectGeometry::MeshRange& IndirectGeometry::GetMesh(unsigned int mesh) {
+	return mMeshes[mesh];
+}
+
+GLuint IndirectGeometry::GetVertexBuffer() {
+	return mVBO;
+}
+
+GLuint IndirectGeometry::GetIndexBuffer() {
+	return mEBO;
+}
+
+bool IndirectBatch::IsGPUCullingSupported() {
+	return GLAD_GL_VERSION_4_3;
+}
+
+void IndirectBatch::GetFrustumPlanes(const glm::mat4& viewProj, glm::vec4 planes[6]) {
+	// Rows of the matrix, glm is column major
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++) {
+		rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+	}
+
+	// Left, right, bottom, top, near, far
+	for (int i = 0; i < 3; i++) {
+		planes[i * 2] = rows[3] + rows[i];
+		planes[i * 2 + 1] = rows[3] - rows[i];
+	}
+	for (int i = 0; i < 6; i++) {
+		planes[i] = planes[i] / glm::length(glm::vec3(planes[i]));
+	}
+}
+
+IndirectBatch::IndirectBatch(IndirectGeometry* pGeometry, JobSystem* pJobSystem) : mGeometry(pGeometry), mJobSystem(pJobSystem), mCapacity(0), mVAO(0),
+	mObjectBuffer(0), mCommandBuffer(0) {
+
+	glGenVertexArrays(1, &mVAO);
+	GLState::BindVertexArray(mVAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, mGeometry->GetVertexBuffer());
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mGeometry->GetIndexBuffer());
+
+	if (IsGPUCullingSupported()) {
+		glGenBuffers(1, &mObjectBuffer);
+		glGenBuffers(1, &mCommandBuffer);
+
+		// One model matrix per instance, and each command draws one instance starting at its object
+		glBindBuffer(GL_ARRAY_BUFFER, mObjectBuffer);
+		for (GLuint column = 0; column < 4; column++) {
+			glEnableVertexAttribArray(MODEL_ATTRIBUTE + column);
+			glVertexAttribPointer(MODEL_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, sizeof(Object),
+				(void*)(offsetof(Object, model) + column * sizeof(glm::vec4)));
+			glVertexAttribDivisor(MODEL_ATTRIBUTE + column, 1);
+		}
+	}
+
+	GLState::BindVertexArray(0);
+}
+
+IndirectBatch::~IndirectBatch() {
+	GLState::DeleteVertexArrays(1, &mVAO);
+	if (mObjectBuffer) {
+		GLState::DeleteBuffers(1, &mObjectBuffer);
+		GLState::DeleteBuffers(1, &mCommandBuffer);
+	}
+}
+
+void IndirectBatch::Resize(size_t count) {
+	mObjects.resize(count);
+}
+
+void IndirectBatch::Set(size_t index, unsigned int mesh, const glm::mat4& model, unsigned int material) {
+	const IndirectGeometry::MeshRange& range = mGeometry->GetMesh(mesh);
+	mObjects[index] = { model, range.bounds, range.firstIndex, range.indexCount, range.baseVertex, material };
+}
+
+void IndirectBatch::Draw(Shader* shader, Shader* cullShader, const glm::vec4* planes, int planeCount, const glm::vec4& range) {
+	mStats.objects = static_cast<int>(mObjects.size());
+	mStats.drawCalls = 0;
+	if (mObjects.empty()) {
+		return;
+	}
+
+	GLState::BindVertexArray(mVAO);
+
+	if (cullShader) {
+		// Orphaned when it grows, otherwise overwritten in place
+		GLsizeiptr objectBytes = static_cast<GLsizeiptr>(mObjects.size() * sizeof(Object));
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mObjectBuffer);
+		if (mObjects.size() > mCapacity) {
+			mCapacity = mObjects.size();
+			glBufferData(GL_SHADER_STORAGE_BUFFER, objectBytes, mObjects.data(), GL_DYNAMIC_DRAW);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandBuffer);
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, mCapacity * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_COPY);
+			MemoryTracker::TrackGPU(GPUObject::BUFFER, mObjectBuffer, objectBytes);
+			MemoryTracker::TrackGPU(GPUObject::BUFFER, mCommandBuffer, mCapacity * sizeof(DrawElementsIndirectCommand));
+		}
+		else {
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, objectBytes, mObjects.data());
+		}
+
+		cullShader->Use();
+		cullShader->SetInt("objectCount", static_cast<GLint>(mObjects.size()));
+		cullShader->SetInt("planeCount", planeCount);
+		char uniform[16];
+		for (int i = 0; i < planeCount; i++) {
+			snprintf(uniform, sizeof(uniform), "planes[%d]", i);
+			cullShader->SetVec4(uniform, planes[i]);
+		}
+		cullShader->SetVec4("range", range);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mObjectBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, mCommandBuffer);
+		glDispatchCompute((static_cast<GLuint>(mObjects.size()) + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+
+		shader->Use();
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandBuffer);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, static_cast<GLsizei>(mObjects.size()), 0);
+		mStats.drawCalls = 1;
+		return;
+	}
+
+	// Same commands built on the CPU, drawn one by one
+	mCommands.resize(mObjects.size());
+	mJobSystem->ParallelFor(mObjects.size(), CULL_OBJECTS_PER_JOB, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			const Object& object = mObjects[i];
+			GLuint instances = IsVisible(object, planes, planeCount, range) ? 1 : 0;
+			mCommands[i] = { object.indexCount, instances, object.firstIndex, object.baseVertex, static_cast<GLuint>(i) };
+		}
+	});
+
+	shader->Use();
+	for (const DrawElementsIndirectCommand& command : mCommands) {
+		if (command.instanceCount == 0) {
+			continue;
+		}
+		shader->SetMat4("model", mObjects[command.baseInstance].model);
+		glDrawElementsBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+			(void*)(command.firstIndex * sizeof(GLuint)), command.baseVertex);
+		mStats.drawCalls++;
+	}
+}
+
+const IndirectBatch::Stats& IndirectBatch::GetStats() {
+	return mStats;
+}
+
+bool IndirectBatch::IsVisible(const Object& object, const glm::vec4* planes, int planeCount, const glm::vec4& range) {
+	// Same test as IndirectCull.comp
+	glm::vec3 center = glm::vec3(object.model * glm::vec4(glm::vec3(object.bounds), 1.0f));
+	float scale = std::max(glm::length(glm::vec3(object.model[0])),
+		std::max(glm::length(glm::vec3(object.model[1])), glm::length(glm::vec3(object.model[2]))));
+	float radius = object.bounds.w * scale;
+
+	for (int i = 0; i < planeCount; i++) {
+		if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius) {
+			return false;
+		}
+	}
+	return range.w <= 0.0f || glm::length(center - glm::vec3(range)) - radius <= range.w;
+}
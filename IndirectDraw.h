@@ -0,0 +1,109 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "Shader.h"
+#include "JobSystem.h"
+
+// Layout glMultiDrawElementsIndirect reads
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// Position-only copies of the shape meshes, merged into one vertex and one index buffer,
+// so any mix of them can be drawn with one multi-draw
+class IndirectGeometry
+{
+public:
+	// Where a mesh lies in the merged buffers, and its bounding sphere (center, radius)
+	struct MeshRange {
+		GLuint firstIndex;
+		GLuint indexCount;
+		GLint baseVertex;
+		glm::vec4 bounds;
+	};
+
+	IndirectGeometry();
+	~IndirectGeometry();
+
+	// Indices are a triangle list. Returns the mesh's index, in the order meshes were added
+	unsigned int AddMesh(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices);
+
+	// Call once after adding every mesh
+	void Upload();
+
+	const MeshRange& GetMesh(unsigned int mesh);
+	GLuint GetVertexBuffer();
+	GLuint GetIndexBuffer();
+
+private:
+	std::vector<glm::vec3> mPositions;
+	std::vector<GLuint> mIndices;
+	std::vector<MeshRange> mMeshes;
+	GLuint mVBO, mEBO;
+};
+
+// Objects of one depth-only pass, drawn with a single glMultiDrawElementsIndirect. Every frame the CPU
+// only writes each object's transform, mesh range and bounds. A compute shader culls them and writes one
+// command per object, with no instances when culled. The command's base instance is the object's index,
+// which is how the vertex shader (built with INDIRECT) finds its model matrix: an instanced attribute
+// reading the object buffer. Without GL 4.3 the CPU culls into the same commands and draws the visible
+// ones one by one, with the model matrix as a uniform
+class IndirectBatch
+{
+public:
+	// std430, matches IndirectCull.comp
+	struct Object {
+		glm::mat4 model;
+		glm::vec4 bounds;
+		GLuint firstIndex;
+		GLuint indexCount;
+		GLint baseVertex;
+		GLuint material;
+	};
+
+	struct Stats {
+		int objects = 0;
+		int drawCalls = 0;
+	};
+
+	// Compute shaders, storage buffers and multi-draw indirect all came with GL 4.3
+	static bool IsGPUCullingSupported();
+
+	// Planes of a view-projection matrix, normal pointing inside. A point p is inside when dot(plane.xyz, p) + plane.w >= 0
+	static void GetFrustumPlanes(const glm::mat4& viewProj, glm::vec4 planes[6]);
+
+	// Without GPU culling, the CPU cull is spread over pJobSystem
+	IndirectBatch(IndirectGeometry* pGeometry, JobSystem* pJobSystem);
+	~IndirectBatch();
+
+	// Makes room for count objects, which jobs then fill in by index. Every slot must be set before drawing
+	void Resize(size_t count);
+	void Set(size_t index, unsigned int mesh, const glm::mat4& model, unsigned int material);
+
+	// Culls against planeCount planes and, if range.w > 0, the sphere range (e.g. a light's reach), then draws.
+	// shader must be built with INDIRECT when cullShader is set, and without it otherwise
+	void Draw(Shader* shader, Shader* cullShader, const glm::vec4* planes, int planeCount, const glm::vec4& range);
+
+	const Stats& GetStats();
+
+private:
+	static bool IsVisible(const Object& object, const glm::vec4* planes, int planeCount, const glm::vec4& range);
+
+	IndirectGeometry* mGeometry;
+	JobSystem* mJobSystem;
+	std::vector<Object> mObjects;
+	std::vector<DrawElementsIndirectCommand> mCommands;
+
+	// Object buffer capacity in objects, it only grows
+	size_t mCapacity;
+	GLuint mVAO, mObjectBuffer, mCommandBuffer;
+	Stats mStats;
+};
@@ -0,0 +1,204 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+
+// Chunks per thread ParallelFor aims for, so threads that finish early can steal the rest
+const size_t CHUNKS_PER_THREAD = 4;
+
+// Capacity of a queue the first time it grows
+const size_t MIN_QUEUE_CAPACITY = 16;
+
+// Queue the current thread owns, -1 on threads that aren't workers. Only one JobSystem exists
+static thread_local int tWorkerIndex = -1;
+
+JobSystem::JobSystem(int workerCount) : mQueuedTasks(0), mStop(false), mJobsRun(0), mSteals(0) {
+	if (workerCount <= 0) {
+		workerCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+	}
+
+	for (int i = 0; i <= workerCount; i++) {
+		mQueues.push_back(std::make_unique<Queue>());
+	}
+	for (int i = 0; i < workerCount; i++) {
+		mWorkers.emplace_back(&JobSystem::WorkerLoop, this, i);
+	}
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mStop = true;
+	}
+	mWake.notify_all();
+	for (std::thread& worker : mWorkers) {
+		worker.join();
+	}
+}
+
+void JobSystem::Run(Job job, Counter* signal, Counter* dependency) {
+	if (signal) {
+		signal->mPending++;
+		signal->mUnfinished++;
+	}
+
+	Task task = { std::move(job), signal };
+	if (dependency) {
+		// The counter's mutex orders this against the job that brings it to zero releasing its continuations
+		std::lock_guard<std::mutex> lock(dependency->mMutex);
+		if (dependency->mPending.load() > 0) {
+			dependency->mContinuations.push_back([this, task]() { Push(task); });
+			return;
+		}
+	}
+	Push(std::move(task));
+}
+
+void JobSystem::ParallelFor(size_t count, size_t minChunk, RangeFunction function, const void* context) {
+	size_t threads = mWorkers.size() + 1;
+	size_t chunk = std::max(std::max<size_t>(minChunk, 1), (count + threads * CHUNKS_PER_THREAD - 1) / (threads * CHUNKS_PER_THREAD));
+	if (count <= chunk) {
+		if (count > 0) {
+			function(context, 0, count);
+		}
+		return;
+	}
+
+	// Chunk jobs only capture a pointer to this and their index, small enough to be stored inline in the Job
+	struct Range {
+		RangeFunction function;
+		const void* context;
+		size_t count, chunk;
+	} range = { function, context, count, chunk };
+
+	Counter counter;
+	for (size_t index = 0; index * chunk < count; index++) {
+		Run([&range, index]() {
+			size_t begin = index * range.chunk;
+			range.function(range.context, begin, std::min(range.count, begin + range.chunk));
+		}, &counter);
+	}
+	Wait(counter);
+}
+
+void JobSystem::Wait(Counter& counter) {
+	while (!counter.IsDone()) {
+		Task task;
+		if (Pop(task)) {
+			Execute(task);
+		}
+		else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+int JobSystem::GetWorkerCount() const {
+	return static_cast<int>(mWorkers.size());
+}
+
+JobSystem::Stats JobSystem::GetStats() const {
+	Stats stats;
+	stats.jobs = mJobsRun.load();
+	stats.steals = mSteals.load();
+	return stats;
+}
+
+void JobSystem::ResetStats() {
+	mJobsRun = 0;
+	mSteals = 0;
+}
+
+void JobSystem::WorkerLoop(int index) {
+	tWorkerIndex = index;
+	while (true) {
+		Task task;
+		if (Pop(task)) {
+			Execute(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(mSleepMutex);
+		mWake.wait(lock, [this]() { return mStop || mQueuedTasks.load() > 0; });
+		if (mStop) {
+			return;
+		}
+	}
+}
+
+void JobSystem::Push(Task task) {
+	Queue& queue = *mQueues[tWorkerIndex == -1 ? mQueues.size() - 1 : tWorkerIndex];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.count == queue.tasks.size()) {
+			std::vector<Task> tasks(std::max(MIN_QUEUE_CAPACITY, queue.tasks.size() * 2));
+			for (size_t i = 0; i < queue.count; i++) {
+				tasks[i] = std::move(queue.tasks[(queue.head + i) % queue.tasks.size()]);
+			}
+			queue.tasks.swap(tasks);
+			queue.head = 0;
+		}
+		queue.tasks[(queue.head + queue.count) % queue.tasks.size()] = std::move(task);
+		queue.count++;
+	}
+	mQueuedTasks++;
+
+	// Taking the lock orders the push against a worker checking for work right before it sleeps
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+	}
+	mWake.notify_one();
+}
+
+bool JobSystem::Pop(Task& task) {
+	size_t own = tWorkerIndex == -1 ? mQueues.size() - 1 : tWorkerIndex;
+
+	// Own queue from the back, then steal from the front of the others
+	for (size_t i = 0; i < mQueues.size(); i++) {
+		size_t index = (own + i) % mQueues.size();
+		Queue& queue = *mQueues[index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.count == 0) {
+			continue;
+		}
+
+		size_t slot = queue.head;
+		if (i == 0) {
+			slot = (queue.head + queue.count - 1) % queue.tasks.size();
+		}
+		else {
+			queue.head = (queue.head + 1) % queue.tasks.size();
+			mSteals++;
+		}
+		task = std::move(queue.tasks[slot]);
+		queue.tasks[slot].job = nullptr;
+		queue.count--;
+		mQueuedTasks--;
+		return true;
+	}
+	return false;
+}
+
+void JobSystem::Execute(Task& task) {
+	task.job();
+	mJobsRun++;
+
+	Counter* signal = task.signal;
+	if (!signal) {
+		return;
+	}
+
+	// Last job of the counter, start whatever waited on it
+	if (--signal->mPending == 0) {
+		std::vector<std::function<void()>> continuations;
+		{
+			std::lock_guard<std::mutex> lock(signal->mMutex);
+			continuations.swap(signal->mContinuations);
+		}
+		for (auto& continuation : continuations) {
+			continuation();
+		}
+	}
+
+	// Wait may return and destroy the counter from here on
+	signal->mUnfinished--;
+}
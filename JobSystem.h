@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing job scheduler. Every worker thread has its own deque: it pushes and pops its own jobs
+// at the back (newest first, still warm in cache) and idle workers steal from the front of the others'.
+// Threads that aren't workers (the main thread) submit into a shared queue and help run jobs while they wait.
+// Jobs can signal a Counter when done and wait for one before they start, which is how dependencies are built.
+// Queues keep their storage, so once warmed up scheduling jobs small enough for std::function's inline buffer doesn't allocate
+class JobSystem
+{
+public:
+	typedef std::function<void()> Job;
+
+	// Incremented when a job signalling it is submitted, decremented when it finishes.
+	// Done only once the last job has also released the continuations, so a waiter may destroy it right away
+	class Counter {
+	public:
+		Counter() : mPending(0), mUnfinished(0) {}
+		bool IsDone() const { return mUnfinished.load() == 0; }
+
+	private:
+		friend class JobSystem;
+		struct Task;
+
+		// Reaching zero releases the continuations. mUnfinished follows once that is over,
+		// it is the last thing a job touches of the counter
+		std::atomic<int> mPending;
+		std::atomic<int> mUnfinished;
+
+		// Jobs submitted with this counter as their dependency, started when it reaches zero
+		std::mutex mMutex;
+		std::vector<std::function<void()>> mContinuations;
+	};
+
+	// Jobs run and jobs taken from another thread's deque since the last ResetStats
+	struct Stats {
+		int jobs = 0;
+		int steals = 0;
+	};
+
+	// 0 workers picks one per hardware thread, minus the main thread
+	explicit JobSystem(int workerCount = 0);
+	~JobSystem();
+
+	// signal (optional) is done once the job has run. The job only starts once dependency (optional) is done
+	void Run(Job job, Counter* signal = nullptr, Counter* dependency = nullptr);
+
+	// Calls body(begin, end) over [0, count) in chunks of at least minChunk items, spread over the workers
+	// and the calling thread. Returns once every chunk has run. Small ranges run inline.
+	// body is called through a pointer instead of being wrapped in a std::function, which would allocate for larger captures
+	template <typename Body>
+	void ParallelFor(size_t count, size_t minChunk, const Body& body) {
+		ParallelFor(count, minChunk, [](const void* context, size_t begin, size_t end) {
+			(*static_cast<const Body*>(context))(begin, end);
+		}, &body);
+	}
+
+	// Runs other jobs until the counter is done, so waiting never idles a thread
+	void Wait(Counter& counter);
+
+	int GetWorkerCount() const;
+	Stats GetStats() const;
+	void ResetStats();
+
+private:
+	struct Task {
+		Job job;
+		Counter* signal;
+	};
+
+	// Ring buffer. It grows when full and never shrinks, where a deque would allocate and free blocks as it drains
+	struct Queue {
+		std::mutex mutex;
+		std::vector<Task> tasks;
+		size_t head = 0, count = 0;
+	};
+
+	typedef void (*RangeFunction)(const void* context, size_t begin, size_t end);
+	void ParallelFor(size_t count, size_t minChunk, RangeFunction function, const void* context);
+
+	void WorkerLoop(int index);
+	void Push(Task task);
+	bool Pop(Task& task);
+	void Execute(Task& task);
+
+	std::vector<std::thread> mWorkers;
+
+	// One per worker, and a last one shared by every thread that isn't a worker
+	std::vector<std::unique_ptr<Queue>> mQueues;
+
+	// Sleeping workers wake when something is queued
+	std::atomic<int> mQueuedTasks;
+	std::mutex mSleepMutex;
+	std::condition_variable mWake;
+	bool mStop;
+
+	std::atomic<int> mJobsRun, mSteals;
+};
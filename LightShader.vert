@@ -2,10 +2,24 @@
 
 layout (location = 0) in vec3 aPos;
 
+// Must match the depth pre-pass exactly
+invariant gl_Position;
+
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 proj;
 
+layout(std140) uniform MotionVectors {
+	mat4 currViewProj;
+	mat4 prevViewProj;
+};
+uniform mat4 prevModel;
+
+out vec4 CurrClipPos;
+out vec4 PrevClipPos;
+
 void main() {
 	gl_Position = proj * view * model * vec4(aPos, 1.0);
+	CurrClipPos = currViewProj * model * vec4(aPos, 1.0);
+	PrevClipPos = prevViewProj * prevModel * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,253 @@
+#include "MemoryTracker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+
+const int CATEGORY_COUNT = static_cast<int>(MemoryCategory::NUM);
+const int OBJECT_TYPE_COUNT = static_cast<int>(GPUObject::NUM);
+
+// Untagged allocations, e.g. everything before main and on threads that never open a scope
+static thread_local MemoryCategory tCategory = MemoryCategory::OTHER;
+
+// Plain atomics, updated from operator new on any thread. Zero-initialized before anything can allocate
+struct AtomicCounter {
+	std::atomic<size_t> liveBytes;
+	std::atomic<size_t> peakBytes;
+	std::atomic<int64_t> liveCount;
+	std::atomic<uint64_t> totalCount;
+};
+
+static AtomicCounter sHeap[CATEGORY_COUNT];
+static std::atomic<size_t> sHeapBudgets[CATEGORY_COUNT];
+static std::atomic<size_t> sGPUBudgets[CATEGORY_COUNT];
+
+// GPU objects are only created and deleted on the GL thread, but the editor may read from another
+struct GPUState {
+	struct Entry {
+		size_t bytes;
+		MemoryCategory category;
+	};
+
+	std::mutex mutex;
+	std::unordered_map<GLuint, Entry> objects[OBJECT_TYPE_COUNT];
+	MemoryTracker::Counter byCategory[CATEGORY_COUNT];
+	MemoryTracker::Counter byType[OBJECT_TYPE_COUNT];
+};
+
+static GPUState& GetGPUState() {
+	static GPUState state;
+	return state;
+}
+
+static void Add(MemoryTracker::Counter& counter, size_t bytes) {
+	counter.liveBytes += bytes;
+	counter.peakBytes = std::max(counter.peakBytes, counter.liveBytes);
+	counter.liveCount++;
+	counter.totalCount++;
+}
+
+static void Remove(MemoryTracker::Counter& counter, size_t bytes) {
+	counter.liveBytes -= bytes;
+	counter.liveCount--;
+}
+
+MemoryScope::MemoryScope(MemoryCategory category) : mPrevious(tCategory) {
+	tCategory = category;
+}
+
+MemoryScope::~MemoryScope() {
+	tCategory = mPrevious;
+}
+
+const char* MemoryTracker::GetCategoryName(MemoryCategory category) {
+	switch (category) {
+	case MemoryCategory::TEXTURES: return "Textures";
+	case MemoryCategory::MESHES: return "Meshes";
+	case MemoryCategory::SCENE: return "Scene";
+	case MemoryCategory::RENDERER: return "Renderer";
+	case MemoryCategory::EDITOR: return "Editor";
+	case MemoryCategory::OTHER: return "Other";
+	default: return "";
+	}
+}
+
+const char* MemoryTracker::GetObjectName(GPUObject type) {
+	switch (type) {
+	case GPUObject::TEXTURE: return "Textures";
+	case GPUObject::RENDERBUFFER: return "Renderbuffers";
+	case GPUObject::BUFFER: return "Buffers";
+	default: return "";
+	}
+}
+
+MemoryCategory MemoryTracker::GetCurrentCategory() {
+	return tCategory;
+}
+
+void MemoryTracker::OnAllocate(MemoryCategory category, size_t bytes) {
+	AtomicCounter& counter = sHeap[static_cast<int>(category)];
+	size_t live = counter.liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	counter.liveCount.fetch_add(1, std::memory_order_relaxed);
+	counter.totalCount.fetch_add(1, std::memory_order_relaxed);
+
+	size_t peak = counter.peakBytes.load(std::memory_order_relaxed);
+	while (live > peak && !counter.peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+}
+
+void MemoryTracker::OnFree(MemoryCategory category, size_t bytes) {
+	AtomicCounter& counter = sHeap[static_cast<int>(category)];
+	counter.liveBytes.fetch_sub(bytes, std::memory_order_relaxed);
+	counter.liveCount.fetch_sub(1, std::memory_order_relaxed);
+}
+
+MemoryTracker::Counter MemoryTracker::GetHeap(MemoryCategory category) {
+	const AtomicCounter& counter = sHeap[static_cast<int>(category)];
+	Counter result;
+	result.liveBytes = counter.liveBytes.load(std::memory_order_relaxed);
+	result.peakBytes = counter.peakBytes.load(std::memory_order_relaxed);
+	result.liveCount = counter.liveCount.load(std::memory_order_relaxed);
+	result.totalCount = counter.totalCount.load(std::memory_order_relaxed);
+	return result;
+}
+
+void MemoryTracker::TrackGPU(GPUObject type, GLuint object, size_t bytes) {
+	if (object == 0) {
+		return;
+	}
+
+	UntrackGPU(type, object);
+
+	GPUState& state = GetGPUState();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	state.objects[static_cast<int>(type)][object] = { bytes, tCategory };
+	Add(state.byCategory[static_cast<int>(tCategory)], bytes);
+	Add(state.byType[static_cast<int>(type)], bytes);
+}
+
+void MemoryTracker::UntrackGPU(GPUObject type, GLuint object) {
+	GPUState& state = GetGPUState();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	auto& objects = state.objects[static_cast<int>(type)];
+	auto it = objects.find(object);
+	if (it == objects.end()) {
+		return;
+	}
+
+	Remove(state.byCategory[static_cast<int>(it->second.category)], it->second.bytes);
+	Remove(state.byType[static_cast<int>(type)], it->second.bytes);
+	objects.erase(it);
+}
+
+MemoryTracker::Counter MemoryTracker::GetGPU(MemoryCategory category) {
+	GPUState& state = GetGPUState();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	return state.byCategory[static_cast<int>(category)];
+}
+
+MemoryTracker::Counter MemoryTracker::GetGPU(GPUObject type) {
+	GPUState& state = GetGPUState();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	return state.byType[static_cast<int>(type)];
+}
+
+size_t MemoryTracker::GetTextureBytes(GLenum internalFormat, int width, int height, int layers, int levels, int samples) {
+	size_t bytesPerPixel = GetBytesPerPixel(internalFormat);
+	size_t bytes = 0;
+	for (int level = 0; level < levels; level++) {
+		bytes += bytesPerPixel * std::max(width >> level, 1) * std::max(height >> level, 1);
+	}
+	return bytes * std::max(layers, 1) * std::max(samples, 1);
+}
+
+int MemoryTracker::GetMipLevels(int width, int height) {
+	int levels = 1;
+	for (int size = std::max(width, height); size > 1; size /= 2) {
+		levels++;
+	}
+	return levels;
+}
+
+void MemoryTracker::SetBudget(MemoryCategory category, size_t heapBytes, size_t gpuBytes) {
+	sHeapBudgets[static_cast<int>(category)] = heapBytes;
+	sGPUBudgets[static_cast<int>(category)] = gpuBytes;
+}
+
+size_t MemoryTracker::GetHeapBudget(MemoryCategory category) {
+	return sHeapBudgets[static_cast<int>(category)];
+}
+
+size_t MemoryTracker::GetGPUBudget(MemoryCategory category) {
+	return sGPUBudgets[static_cast<int>(category)];
+}
+
+bool MemoryTracker::IsOverBudget(MemoryCategory category) {
+	size_t heapBudget = GetHeapBudget(category), gpuBudget = GetGPUBudget(category);
+	return (heapBudget > 0 && GetHeap(category).liveBytes > heapBudget) ||
+		(gpuBudget > 0 && GetGPU(category).liveBytes > gpuBudget);
+}
+
+static void WriteCounter(std::ofstream& file, const char* name, const MemoryTracker::Counter& counter, size_t budget, bool last) {
+	file << "\t\t\"" << name << "\": { \"liveBytes\": " << counter.liveBytes << ", \"peakBytes\": " << counter.peakBytes
+		<< ", \"liveCount\": " << counter.liveCount << ", \"totalCount\": " << counter.totalCount;
+	if (budget > 0) {
+		file << ", \"budget\": " << budget << ", \"overBudget\": " << (counter.liveBytes > budget ? "true" : "false");
+	}
+	file << " }" << (last ? "\n" : ",\n");
+}
+
+bool MemoryTracker::WriteJSON(const std::string& path) {
+	std::ofstream file(path);
+	if (!file.is_open()) {
+		std::cout << "Couldn't write the memory report to " << path << '\n';
+		return false;
+	}
+
+	file << "{\n\t\"heap\": {\n";
+	for (int i = 0; i < CATEGORY_COUNT; i++) {
+		MemoryCategory category = static_cast<MemoryCategory>(i);
+		WriteCounter(file, GetCategoryName(category), GetHeap(category), GetHeapBudget(category), i == CATEGORY_COUNT - 1);
+	}
+	file << "\t},\n\t\"gpu\": {\n";
+	for (int i = 0; i < CATEGORY_COUNT; i++) {
+		MemoryCategory category = static_cast<MemoryCategory>(i);
+		WriteCounter(file, GetCategoryName(category), GetGPU(category), GetGPUBudget(category), i == CATEGORY_COUNT - 1);
+	}
+	file << "\t},\n\t\"gpuObjects\": {\n";
+	for (int i = 0; i < OBJECT_TYPE_COUNT; i++) {
+		GPUObject type = static_cast<GPUObject>(i);
+		WriteCounter(file, GetObjectName(type), GetGPU(type), 0, i == OBJECT_TYPE_COUNT - 1);
+	}
+	file << "\t}\n}\n";
+	return true;
+}
+
+size_t MemoryTracker::GetBytesPerPixel(GLenum internalFormat) {
+	switch (internalFormat) {
+	case GL_RED:
+	case GL_R8:
+		return 1;
+	case GL_RG8:
+	case GL_R16F:
+	case GL_DEPTH_COMPONENT16:
+		return 2;
+	case GL_RGB:
+	case GL_RGB8:
+		return 3;
+	case GL_RG32F:
+	case GL_RGBA16F:
+	case GL_DEPTH32F_STENCIL8:
+	// Drivers pad three 16-bit channels to four
+	case GL_RGB16F:
+		return 8;
+	case GL_RGB32F:
+		return 12;
+	case GL_RGBA32F:
+		return 16;
+	default:
+		return 4;
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// What memory is for. Heap allocations take the category of the innermost MemoryScope of the thread
+// making them, GPU objects the one current when they are tracked
+enum class MemoryCategory {
+	TEXTURES,
+	MESHES,
+	SCENE,
+	RENDERER,
+	EDITOR,
+	OTHER,
+	NUM
+};
+
+enum class GPUObject {
+	TEXTURE,
+	RENDERBUFFER,
+	BUFFER,
+	NUM
+};
+
+// Tags what the current thread allocates until the end of the enclosing block
+class MemoryScope
+{
+public:
+	explicit MemoryScope(MemoryCategory category);
+	~MemoryScope();
+	MemoryScope(const MemoryScope&) = delete;
+	MemoryScope& operator=(const MemoryScope&) = delete;
+
+private:
+	MemoryCategory mPrevious;
+};
+
+// Live and peak memory by category, of the heap (fed by AllocationCounter's operator new) and of the GPU
+// objects the framework creates. Texture, buffer and renderbuffer sizes are computed from what was asked
+// of the driver, which may pad or compress them
+class MemoryTracker
+{
+public:
+	struct Counter {
+		size_t liveBytes = 0;
+		size_t peakBytes = 0;
+		int64_t liveCount = 0;
+		uint64_t totalCount = 0;
+	};
+
+	static const char* GetCategoryName(MemoryCategory category);
+	static const char* GetObjectName(GPUObject type);
+	static MemoryCategory GetCurrentCategory();
+
+	// Called for every heap allocation, from any thread. Must not allocate
+	static void OnAllocate(MemoryCategory category, size_t bytes);
+	static void OnFree(MemoryCategory category, size_t bytes);
+	static Counter GetHeap(MemoryCategory category);
+
+	// Tracking an object again replaces its size, e.g. a buffer specified anew with more room.
+	// GLState's delete functions untrack what they delete
+	static void TrackGPU(GPUObject type, GLuint object, size_t bytes);
+	static void UntrackGPU(GPUObject type, GLuint object);
+	static Counter GetGPU(MemoryCategory category);
+	static Counter GetGPU(GPUObject type);
+
+	// Size of a texture with every layer (cube faces), mip level and sample
+	static size_t GetTextureBytes(GLenum internalFormat, int width, int height, int layers = 1, int levels = 1, int samples = 1);
+	static int GetMipLevels(int width, int height);
+
+	// Live bytes above which a category shows as over budget, 0 for no budget
+	static void SetBudget(MemoryCategory category, size_t heapBytes, size_t gpuBytes);
+	static size_t GetHeapBudget(MemoryCategory category);
+	static size_t GetGPUBudget(MemoryCategory category);
+	static bool IsOverBudget(MemoryCategory category);
+
+	// Every counter and budget, for comparing sessions or finding what grows over a long one
+	static bool WriteJSON(const std::string& path);
+
+private:
+	static size_t GetBytesPerPixel(GLenum internalFormat);
+};
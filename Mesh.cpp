@@ -1,7 +1,11 @@
 #include "Mesh.h"
+#include "GLState.h"
+#include "MemoryTracker.h"
+#include <cstdio>
 
 Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture*> textures)
 {
+	MemoryScope memoryScope(MemoryCategory::MESHES);
 	mVertices = vertices;
 	mIndices = indices;
 	mTextures = textures;
@@ -17,27 +21,33 @@ void Mesh::Draw(Shader* shader)
     unsigned int heightNr = 1;
     for (unsigned int i = 0; i < mTextures.size(); i++)
     {
-        glActiveTexture(GL_TEXTURE0 + i);
-        std::string number;
-        std::string name = mTextures[i]->GetType();
+        GLState::ActiveTexture(GL_TEXTURE0 + i);
+        const std::string& name = mTextures[i]->GetType();
+        unsigned int number = 0;
         if (name == "texture_diffuse")
-            number = std::to_string(diffuseNr++);
+            number = diffuseNr++;
         else if (name == "texture_specular")
-            number = std::to_string(specularNr++); 
+            number = specularNr++;
         else if (name == "texture_normal")
-            number = std::to_string(normalNr++); 
+            number = normalNr++;
         else if (name == "texture_height")
-            number = std::to_string(heightNr++);
-
-        shader->SetInt((name + number).c_str(), i);
+            number = heightNr++;
+
+        // Formatted on the stack, building the name with std::string allocated for every texture of every draw
+        char uniform[64];
+        if (number > 0)
+            snprintf(uniform, sizeof(uniform), "%s%u", name.c_str(), number);
+        else
+            snprintf(uniform, sizeof(uniform), "%s", name.c_str());
+        shader->SetInt(uniform, i);
         mTextures[i]->Bind();
     }
 
-    glBindVertexArray(mVAO);
+    GLState::BindVertexArray(mVAO);
     glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(mIndices.size()), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    GLState::BindVertexArray(0);
 
-    glActiveTexture(GL_TEXTURE0);
+    GLState::ActiveTexture(GL_TEXTURE0);
 }
 
 void Mesh::SetupMesh()
@@ -46,13 +56,15 @@ void Mesh::SetupMesh()
 	glGenBuffers(1, &mVBO);
 	glGenBuffers(1, &mEBO);
 
-	glBindVertexArray(mVAO);
+	GLState::BindVertexArray(mVAO);
 
 	glBindBuffer(GL_ARRAY_BUFFER, mVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(mVertices), &mVertices[0], GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, mVertices.size() * sizeof(Vertex), mVertices.data(), GL_STATIC_DRAW);
+	MemoryTracker::TrackGPU(GPUObject::BUFFER, mVBO, mVertices.size() * sizeof(Vertex));
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(mIndices), &mIndices[0], GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mIndices.size() * sizeof(GLuint), mIndices.data(), GL_STATIC_DRAW);
+	MemoryTracker::TrackGPU(GPUObject::BUFFER, mEBO, mIndices.size() * sizeof(GLuint));
 
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
@@ -69,6 +81,6 @@ void Mesh::SetupMesh()
 	//glEnableVertexAttribArray(4);
 	//glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, bitangent));
 
-	glBindVertexArray(0);
+	GLState::BindVertexArray(0);
 
 }
@@ -4,13 +4,30 @@ Model::Model(std::string path, ResourceManager* pResourceManager) {
 	loadModel(path, pResourceManager);
 }
 
-void Model::Draw(Shader* shader)
+void Model::AddToSceneGraph(TransformSystem* pTransforms, TransformSystem::Handle parent)
 {
-	for (unsigned int i = 0; i < meshes.size(); i++) {
-		meshes[i].Draw(shader);
+	nodeHandles.clear();
+	for (const Node& node : nodes) {
+		TransformSystem::Handle nodeParent = node.parent < 0 ? parent : nodeHandles[node.parent];
+		nodeHandles.push_back(pTransforms->Add(node.transform, nodeParent));
 	}
 }
 
+void Model::Draw(Shader* shader, const TransformSystem* pTransforms)
+{
+	for (unsigned int i = 0; i < nodes.size(); i++) {
+		shader->SetMat4("model", pTransforms->GetWorld(nodeHandles[i]));
+		for (unsigned int mesh : nodes[i].meshes) {
+			meshes[mesh].Draw(shader);
+		}
+	}
+}
+
+const std::vector<Model::Node>& Model::GetNodes() const
+{
+	return nodes;
+}
+
 void Model::loadModel(std::string path, ResourceManager* pResourceManager)
 {
 	Assimp::Importer importer;
@@ -23,19 +40,33 @@ void Model::loadModel(std::string path, ResourceManager* pResourceManager)
 	}
 
 	directory = path.substr(0, path.find_last_of('/'));
-	processNode(scene->mRootNode, scene, pResourceManager);
+	processNode(scene->mRootNode, scene, pResourceManager, -1);
 
 }
 
-void Model::processNode(aiNode* node, const aiScene* scene, ResourceManager* pResourceManager)
+void Model::processNode(aiNode* node, const aiScene* scene, ResourceManager* pResourceManager, int parent)
 {
+	// Assimp matrices are row-major (a1..a4 is the first row), glm's are column-major
+	Node modelNode;
+	const ai_real* transform = &node->mTransformation.a1;
+	for (int row = 0; row < 4; row++) {
+		for (int column = 0; column < 4; column++) {
+			modelNode.transform[column][row] = static_cast<float>(transform[row * 4 + column]);
+		}
+	}
+	modelNode.parent = parent;
+
+	int index = static_cast<int>(nodes.size());
+	nodes.push_back(modelNode);
+
 	for (unsigned int i = 0; i < node->mNumMeshes; i++) {
 		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+		nodes[index].meshes.push_back(static_cast<unsigned int>(meshes.size()));
 		meshes.push_back(processMesh(mesh, scene, pResourceManager));
 	}
 
 	for (unsigned int i = 0; i < node->mNumChildren; i++) {
-		processNode(node->mChildren[i], scene, pResourceManager);
+		processNode(node->mChildren[i], scene, pResourceManager, index);
 	}
 }
 
@@ -7,23 +7,39 @@
 #include "ResourceManager.h"
 #include "Shader.h"
 #include "Mesh.h"
+#include "TransformSystem.h"
 
 #include <string>
 
 class Model
 {
 public:
+	// Imported node hierarchy, parents before children. transform is relative to the parent node
+	struct Node {
+		glm::mat4 transform;
+		int parent;
+		std::vector<unsigned int> meshes;
+	};
+
 	Model(std::string path, ResourceManager* pResourceManager);
 
-	void Draw(Shader* shader);
+	// Adds every node to the scene graph under parent, keeping the imported hierarchy
+	void AddToSceneGraph(TransformSystem* pTransforms, TransformSystem::Handle parent = TransformSystem::NO_PARENT);
+
+	// Draws each node's meshes with the node's world matrix as "model". Needs AddToSceneGraph first
+	void Draw(Shader* shader, const TransformSystem* pTransforms);
+
+	const std::vector<Node>& GetNodes() const;
 
 private:
 	std::vector<Texture*> texturesLoaded;
 	std::vector<Mesh> meshes;
+	std::vector<Node> nodes;
+	std::vector<TransformSystem::Handle> nodeHandles;
 	std::string directory;
 
 	void loadModel(std::string path, ResourceManager* pResourceManager);
-	void processNode(aiNode* node, const aiScene* scene, ResourceManager* pResourceManager);
+	void processNode(aiNode* node, const aiScene* scene, ResourceManager* pResourceManager, int parent);
 	Mesh processMesh(aiMesh* mesh, const aiScene* scene, ResourceManager* pResourceManager);
 	std::vector<Texture*> loadMaterialTextures(aiMaterial* mat,
 		aiTextureType type, std::string typeName, ResourceManager* pResourceManager);
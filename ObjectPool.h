@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+
+// Fixed-size slots for one type, carved out of slabs of SLAB_SIZE. Each slab keeps its own free-list and
+// slabs with free slots are linked together, so allocating and freeing are O(1) and objects created
+// together sit next to each other. A slab that empties out is given back to the heap, except for one kept
+// spare so adding and removing around a slab boundary doesn't allocate every time.
+// Locked, shapes are created on the main thread and may be deleted on the render thread
+template <typename T, size_t SLAB_SIZE = 64>
+class ObjectPool
+{
+public:
+	struct Stats {
+		size_t liveCount = 0;
+		size_t slabCount = 0;
+		size_t capacity = 0;
+		size_t bytes = 0;
+	};
+
+	ObjectPool() = default;
+	~ObjectPool() {
+		while (mPartial) {
+			Slab* next = mPartial->next;
+			delete mPartial;
+			mPartial = next;
+		}
+		// Full slabs aren't linked anywhere, objects still alive at exit are left to the OS
+	}
+	ObjectPool(const ObjectPool&) = delete;
+	ObjectPool& operator=(const ObjectPool&) = delete;
+
+	// Uninitialized room for one T
+	void* Allocate() {
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (!mPartial) {
+			AddSlab();
+		}
+
+		Slab* slab = mPartial;
+		Slot* slot = slab->freeList;
+		slab->freeList = slot->next;
+		slab->liveCount++;
+		mLiveCount++;
+
+		if (slab == mSpare) {
+			mSpare = nullptr;
+		}
+		if (!slab->freeList) {
+			Unlink(slab);
+		}
+		return slot->storage;
+	}
+
+	void Free(void* p) {
+		if (!p) {
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		Slot* slot = reinterpret_cast<Slot*>(static_cast<unsigned char*>(p) - offsetof(Slot, storage));
+		Slab* slab = slot->slab;
+
+		// A full slab wasn't in the list
+		if (!slab->freeList) {
+			Link(slab);
+		}
+		slot->next = slab->freeList;
+		slab->freeList = slot;
+		slab->liveCount--;
+		mLiveCount--;
+
+		if (slab->liveCount == 0) {
+			if (mSpare) {
+				Unlink(slab);
+				delete slab;
+				mSlabCount--;
+			}
+			else {
+				mSpare = slab;
+			}
+		}
+	}
+
+	Stats GetStats() {
+		std::lock_guard<std::mutex> lock(mMutex);
+		Stats stats;
+		stats.liveCount = mLiveCount;
+		stats.slabCount = mSlabCount;
+		stats.capacity = mSlabCount * SLAB_SIZE;
+		stats.bytes = mSlabCount * sizeof(Slab);
+		return stats;
+	}
+
+private:
+	struct Slab;
+
+	struct Slot {
+		Slab* slab;
+		Slot* next;
+		alignas(T) unsigned char storage[sizeof(T)];
+	};
+
+	struct Slab {
+		Slot slots[SLAB_SIZE];
+		Slot* freeList;
+		size_t liveCount;
+		Slab* prev;
+		Slab* next;
+	};
+
+	void AddSlab() {
+		Slab* slab = new Slab;
+		for (size_t i = 0; i < SLAB_SIZE; i++) {
+			slab->slots[i].slab = slab;
+			slab->slots[i].next = i + 1 < SLAB_SIZE ? &slab->slots[i + 1] : nullptr;
+		}
+		slab->freeList = &slab->slots[0];
+		slab->liveCount = 0;
+		Link(slab);
+		mSlabCount++;
+	}
+
+	// Pushed to the front, so the slab just freed into is the next one allocated from
+	void Link(Slab* slab) {
+		slab->prev = nullptr;
+		slab->next = mPartial;
+		if (mPartial) {
+			mPartial->prev = slab;
+		}
+		mPartial = slab;
+	}
+
+	void Unlink(Slab* slab) {
+		if (slab->prev) {
+			slab->prev->next = slab->next;
+		}
+		else {
+			mPartial = slab->next;
+		}
+		if (slab->next) {
+			slab->next->prev = slab->prev;
+		}
+	}
+
+	std::mutex mMutex;
+	Slab* mPartial = nullptr;
+	Slab* mSpare = nullptr;
+	size_t mSlabCount = 0;
+	size_t mLiveCount = 0;
+};
+
+// Base that makes new and delete of T go through a pool shared by every T, e.g.
+// struct Transform : Pooled<Transform>. Types deriving from T further can't use it
+template <typename T>
+class Pooled
+{
+public:
+	static void* operator new(size_t size) {
+		return GetPool().Allocate();
+	}
+
+	static void operator delete(void* p) {
+		GetPool().Free(p);
+	}
+
+	static ObjectPool<T>& GetPool() {
+		static ObjectPool<T> pool;
+		return pool;
+	}
+};
@@ -9,7 +9,19 @@ uniform mat4 proj;
 
 uniform float outlining;
 
+layout(std140) uniform MotionVectors {
+	mat4 currViewProj;
+	mat4 prevViewProj;
+};
+uniform mat4 prevModel;
+
+out vec4 CurrClipPos;
+out vec4 PrevClipPos;
+
 void main()
 {
-	gl_Position = proj * view * model * vec4(aPos + aNormal * outlining, 1.0);
+	vec4 position = vec4(aPos + aNormal * outlining, 1.0);
+	gl_Position = proj * view * model * position;
+	CurrClipPos = currViewProj * model * position;
+	PrevClipPos = prevViewProj * prevModel * position;
 }
\ No newline at end of file
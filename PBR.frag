@@ -1,6 +1,10 @@
 #version 330 core
 
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec2 Velocity;
+
+in vec4 CurrClipPos;
+in vec4 PrevClipPos;
 
 in vec2 TexCoords;
 in vec3 Normal;
@@ -35,8 +39,13 @@ uniform sampler2D metallicMap;
 uniform sampler2D depthMap;
 uniform sampler2D aoMap;
 
-// Irradiance map for IBL
-uniform samplerCube irradianceMap;
+// Split-sum IBL: L2 spherical harmonics irradiance for diffuse, prefiltered environment and BRDF LUT for specular
+layout(std140) uniform IrradianceSH {
+	vec4 shCoefficients[9];
+};
+uniform samplerCube prefilterMap;
+uniform sampler2D brdfLUT;
+uniform float prefilterMaxLod;
 
 uniform bool iblOn;
 
@@ -79,6 +88,28 @@ vec3 FresnelSchlick(float cosTheta, vec3 F0)
 	return F0 + (1.0 - F0) * pow(1.0 - cosTheta, 5.0);
 }
 
+// Irradiance (already divided by PI) from the SH coefficients, the cosine convolution is baked in on the CPU
+vec3 IrradianceSHEval(vec3 n)
+{
+	vec3 irradiance = shCoefficients[0].rgb * 0.282095
+		+ shCoefficients[1].rgb * 0.488603 * n.y
+		+ shCoefficients[2].rgb * 0.488603 * n.z
+		+ shCoefficients[3].rgb * 0.488603 * n.x
+		+ shCoefficients[4].rgb * 1.092548 * n.x * n.y
+		+ shCoefficients[5].rgb * 1.092548 * n.y * n.z
+		+ shCoefficients[6].rgb * 0.315392 * (3.0 * n.z * n.z - 1.0)
+		+ shCoefficients[7].rgb * 1.092548 * n.x * n.z
+		+ shCoefficients[8].rgb * 0.546274 * (n.x * n.x - n.y * n.y);
+	// L2 ringing can dip below zero around small, very bright lights
+	return max(irradiance, vec3(0.0));
+}
+
+// Rough surfaces reflect less at grazing angles, used for the ambient term
+vec3 FresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness)
+{
+	return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+}
+
 vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir) {
 	float height = texture(depthMap, texCoords).r;
 	return texCoords - ((viewDir.xy / viewDir.z) * height * heightScale);
@@ -154,12 +185,19 @@ void main() {
 	vec3 ambient; 
 
 	if(iblOn) {
-		vec3 kS = FresnelSchlick(max(dot(N, V), 0.0), F0);
+		float NdotV = max(dot(N, V), 0.0);
+		vec3 kS = FresnelSchlickRoughness(NdotV, F0, roughness);
 		vec3 kD = 1.0 - kS;
 		kD *= 1.0 - metalness;	  
-		vec3 irradiance = texture(irradianceMap, N).rgb;
+		vec3 irradiance = IrradianceSHEval(N);
 		vec3 diffuse  = irradiance * albedo;
-		ambient = (kD * diffuse) * ao;
+
+		vec3 R = reflect(-V, N);
+		vec3 prefilteredColor = textureLod(prefilterMap, R, roughness * prefilterMaxLod).rgb;
+		vec2 envBRDF = texture(brdfLUT, vec2(NdotV, roughness)).rg;
+		vec3 specular = prefilteredColor * (kS * envBRDF.x + envBRDF.y);
+
+		ambient = (kD * diffuse + specular) * ao;
 	}
 	else {
 		ambient = vec3(0.03) * albedo * ao;
@@ -169,6 +207,7 @@ void main() {
     vec3 color = ambient + Lo;
 
     FragColor = vec4(color, 1.0);
+	Velocity = 0.5 * (CurrClipPos.xy / CurrClipPos.w - PrevClipPos.xy / PrevClipPos.w);
 }
 
 
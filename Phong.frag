@@ -31,7 +31,11 @@ uniform int numberOfLights;
 
 uniform sampler2D myTexture;
 
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec2 Velocity;
+
+in vec4 CurrClipPos;
+in vec4 PrevClipPos;
 
 void main() {
 	vec3 result = vec3(0);
@@ -65,4 +69,5 @@ void main() {
 		//FragColor = vec4(color, 1.0f);
 	}
 	FragColor = vec4(result, 1.0f);
+	Velocity = 0.5 * (CurrClipPos.xy / CurrClipPos.w - PrevClipPos.xy / PrevClipPos.w);
 }
@@ -12,16 +12,31 @@ out vec3 FragPos;
 //out vec3 TangentFragPos;
 //out vec3 TangentViewPos;
 
+// Must match the depth pre-pass exactly
+invariant gl_Position;
+
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 proj;
 
+// Unjittered view-projections of this and the last frame, for velocity
+layout(std140) uniform MotionVectors {
+	mat4 currViewProj;
+	mat4 prevViewProj;
+};
+uniform mat4 prevModel;
+
+out vec4 CurrClipPos;
+out vec4 PrevClipPos;
+
 //uniform vec3 viewPos;
 
 out mat3 TBN;
 
 void main() {
 	gl_Position = proj * view * model * vec4(aPos, 1.0);
+	CurrClipPos = currViewProj * model * vec4(aPos, 1.0);
+	PrevClipPos = prevViewProj * prevModel * vec4(aPos, 1.0);
 	FragPos = vec3(model * vec4(aPos, 1.0f));
 	TexCoords = aTexCoords;
 	Normal = transpose(inverse(mat3(model))) * aNormal;
@@ -1,7 +1,11 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
+#ifdef INDIRECT
+layout (location = 5) in mat4 model;
+#else
 uniform mat4 model;
+#endif
 
 void main() {
     gl_Position = model * vec4(aPos, 1.0);
@@ -1,20 +1,26 @@
 #pragma once
 
-#pragma once
-
 #include <glad/glad.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "GLState.h"
+#include "MemoryTracker.h"
 
 class QuadMesh
 {
 public:
     QuadMesh() {
+        MemoryScope memoryScope(MemoryCategory::MESHES);
         glGenVertexArrays(1, &mVAO);
         glGenBuffers(1, &mVBO);
 
-        glBindVertexArray(mVAO);
+        GLState::BindVertexArray(mVAO);
 
         glBindBuffer(GL_ARRAY_BUFFER, mVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(mVertices), mVertices, GL_STATIC_DRAW);
+        MemoryTracker::TrackGPU(GPUObject::BUFFER, mVBO, sizeof(mVertices));
 
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (void*)0);
         glEnableVertexAttribArray(0);
@@ -25,11 +31,33 @@ public:
         glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (void*)(sizeof(GLfloat) * 5));
         glEnableVertexAttribArray(2);
 
-        glBindVertexArray(0);
+        GLState::BindVertexArray(0);
+    }
+
+    ~QuadMesh() {
+        GLState::DeleteVertexArrays(1, &mVAO);
+        GLState::DeleteBuffers(1, &mVBO);
     }
 
     void BindVAO() {
-        glBindVertexArray(mVAO);
+        GLState::BindVertexArray(mVAO);
+    }
+
+    // Positions as an indexed triangle list, for the merged geometry of the indirect path
+    std::vector<glm::vec3> GetPositions() {
+        std::vector<glm::vec3> positions;
+        for (int i = 0; i < 6; i++) {
+            positions.push_back(glm::vec3(mVertices[i * 8], mVertices[i * 8 + 1], mVertices[i * 8 + 2]));
+        }
+        return positions;
+    }
+
+    std::vector<GLuint> GetTriangleIndices() {
+        std::vector<GLuint> indices;
+        for (GLuint i = 0; i < 6; i++) {
+            indices.push_back(i);
+        }
+        return indices;
     }
 
 private:
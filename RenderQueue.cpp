@@ -0,0 +1,77 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+
+// Precision of the depth field in the keys
+const uint64_t DEPTH_BITS = 24;
+const uint64_t DEPTH_MAX = (1ull << DEPTH_BITS) - 1;
+
+static uint64_t QuantizeDepth(float depth) {
+	return static_cast<uint64_t>(std::clamp(depth, 0.0f, 1.0f) * static_cast<float>(DEPTH_MAX));
+}
+
+uint64_t RenderQueue::MakeStateKey(QueuePass pass, unsigned int program, unsigned int material, unsigned int mesh, float depth) {
+	return (static_cast<uint64_t>(pass) << PASS_SHIFT)
+		| (static_cast<uint64_t>(program & 0x3F) << 54)
+		| (static_cast<uint64_t>(material & 0xFFFF) << 38)
+		| (static_cast<uint64_t>(mesh & 0xF) << 34)
+		| (QuantizeDepth(depth) << 10);
+}
+
+uint64_t RenderQueue::MakeDepthKey(QueuePass pass, float depth) {
+	return (static_cast<uint64_t>(pass) << PASS_SHIFT) | (QuantizeDepth(depth) << (PASS_SHIFT - DEPTH_BITS));
+}
+
+void RenderQueue::Resize(size_t count) {
+	mItems.assign(count, { static_cast<uint64_t>(QueuePass::NUM) << PASS_SHIFT, nullptr });
+}
+
+void RenderQueue::Set(size_t index, uint64_t key, Shape* pShape) {
+	mItems[index] = { key, pShape };
+}
+
+void RenderQueue::Sort() {
+	mScratch.resize(mItems.size());
+
+	for (int shift = 0; shift < 64; shift += 8) {
+		size_t counts[256] = {};
+		for (const RenderItem& item : mItems) {
+			counts[(item.key >> shift) & 0xFF]++;
+		}
+
+		// Every key has the same byte here, the order wouldn't change
+		if (mItems.empty() || counts[(mItems[0].key >> shift) & 0xFF] == mItems.size()) {
+			continue;
+		}
+
+		size_t offset = 0;
+		for (size_t& count : counts) {
+			size_t next = offset + count;
+			count = offset;
+			offset = next;
+		}
+
+		// Stable scatter, so earlier rounds' order is kept among equal bytes
+		for (const RenderItem& item : mItems) {
+			mScratch[counts[(item.key >> shift) & 0xFF]++] = item;
+		}
+		mItems.swap(mScratch);
+	}
+}
+
+RenderQueue::Range RenderQueue::GetPass(QueuePass pass) const {
+	uint64_t passBits = static_cast<uint64_t>(pass);
+	auto first = std::lower_bound(mItems.begin(), mItems.end(), passBits, [](const RenderItem& item, uint64_t value) {
+		return (item.key >> PASS_SHIFT) < value;
+	});
+	auto last = std::upper_bound(first, mItems.end(), passBits, [](uint64_t value, const RenderItem& item) {
+		return value < (item.key >> PASS_SHIFT);
+	});
+
+	const RenderItem* data = mItems.data();
+	return Range(data + (first - mItems.begin()), data + (last - mItems.begin()));
+}
+
+int RenderQueue::GetCount() const {
+	return static_cast<int>(GetPass(QueuePass::NUM).begin() - mItems.data());
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Shape;
+
+// Passes that draw shapes, in the order their items end up after sorting
+enum class QueuePass {
+	SHADOW,
+	DEPTH_PREPASS,
+	GBUFFER,
+	FORWARD,
+	LIGHT_SOURCES,
+	NUM
+};
+
+struct RenderItem {
+	uint64_t key;
+	Shape* shape;
+};
+
+// Shape draws of a frame, sorted by a 64-bit key so consecutive draws share as much GL state as possible.
+// State keys, most significant bits first:
+//   4 pass | 6 program | 16 material | 4 mesh | 24 depth | 10 unused
+// Depth keys put the depth right after the pass, for front-to-back order where overdraw costs more than state changes.
+// Unused slots have pass NUM
+class RenderQueue
+{
+public:
+	class Range {
+	public:
+		Range(const RenderItem* first, const RenderItem* last) : mFirst(first), mLast(last) {}
+		const RenderItem* begin() const { return mFirst; }
+		const RenderItem* end() const { return mLast; }
+
+	private:
+		const RenderItem* mFirst;
+		const RenderItem* mLast;
+	};
+
+	// Depth is the normalized view depth, 0 at the near plane and 1 at the far plane
+	static uint64_t MakeStateKey(QueuePass pass, unsigned int program, unsigned int material, unsigned int mesh, float depth);
+	static uint64_t MakeDepthKey(QueuePass pass, float depth);
+
+	// Makes room for count items, which jobs then fill in by index. Slots left unset sort after every pass
+	void Resize(size_t count);
+	void Set(size_t index, uint64_t key, Shape* pShape);
+
+	// LSD radix sort, a byte per round. Rounds where every key has the same byte are skipped
+	void Sort();
+
+	// Items of one pass, contiguous once sorted
+	Range GetPass(QueuePass pass) const;
+
+	// Items set, leaving out unused slots. Only valid once sorted
+	int GetCount() const;
+
+private:
+	static const int PASS_SHIFT = 60;
+
+	std::vector<RenderItem> mItems, mScratch;
+};
@@ -0,0 +1,82 @@
+#include "RenderThread.h"
+#include "Renderer.h"
+#include "Editor.h"
+
+RenderThread::RenderThread(GLFWwindow* window, Renderer* pRenderer, Editor* pEditor, int snapshotCount) :
+	mWindow(window), mRenderer(pRenderer), mEditor(pEditor), mStop(false) {
+
+	for (int i = 0; i < snapshotCount; i++) {
+		mSnapshots.push_back(std::make_unique<FrameSnapshot>());
+		mFree.push_back(mSnapshots.back().get());
+	}
+
+	// A context is current on one thread at a time
+	glfwMakeContextCurrent(NULL);
+	mThread = std::thread(&RenderThread::Run, this);
+}
+
+RenderThread::~RenderThread() {
+	{
+		std::lock_guard<std::mutex> lock(mQueueMutex);
+		mStop = true;
+	}
+	mReadyChanged.notify_one();
+	mThread.join();
+
+	glfwMakeContextCurrent(mWindow);
+}
+
+FrameSnapshot* RenderThread::BeginFrame() {
+	std::unique_lock<std::mutex> lock(mQueueMutex);
+	mFreeChanged.wait(lock, [this]() { return !mFree.empty(); });
+
+	FrameSnapshot* frame = mFree.front();
+	mFree.pop_front();
+	return frame;
+}
+
+void RenderThread::EndFrame(FrameSnapshot* frame) {
+	{
+		std::lock_guard<std::mutex> lock(mQueueMutex);
+		mReady.push_back(frame);
+	}
+	mReadyChanged.notify_one();
+}
+
+std::mutex& RenderThread::GetRendererMutex() {
+	return mRendererMutex;
+}
+
+void RenderThread::Run() {
+	glfwMakeContextCurrent(mWindow);
+
+	while (true) {
+		FrameSnapshot* frame;
+		{
+			std::unique_lock<std::mutex> lock(mQueueMutex);
+			mReadyChanged.wait(lock, [this]() { return mStop || !mReady.empty(); });
+			if (mReady.empty()) {
+				break;
+			}
+			frame = mReady.front();
+			mReady.pop_front();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mRendererMutex);
+			mRenderer->Submit(*frame);
+			mEditor->Render(&frame->ui.data);
+		}
+
+		// Everything was read from the snapshot, the main thread can fill it again while this waits on the swap
+		{
+			std::lock_guard<std::mutex> lock(mQueueMutex);
+			mFree.push_back(frame);
+		}
+		mFreeChanged.notify_one();
+
+		glfwSwapBuffers(mWindow);
+	}
+
+	glfwMakeContextCurrent(NULL);
+}
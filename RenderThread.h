@@ -0,0 +1,54 @@
+#pragma once
+
+#include <glfw/glfw3.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "FrameSnapshot.h"
+
+class Renderer;
+class Editor;
+
+// Optional threading mode. The render thread owns the GL context: it submits frame snapshots, draws the
+// editor UI over them and swaps, while the main thread polls events, runs the editor and prepares the next
+// snapshot. With N snapshots the main thread gets up to N - 1 frames ahead of the one being submitted.
+// The editor reads and edits renderer state directly, so the main thread holds the renderer mutex while
+// it runs, as the render thread does while submitting. Preparing and swapping happen outside it and overlap
+class RenderThread
+{
+public:
+	// Takes the window's context from the calling thread
+	RenderThread(GLFWwindow* window, Renderer* pRenderer, Editor* pEditor, int snapshotCount);
+
+	// Submits the frames already handed over, then gives the context back to the calling thread
+	~RenderThread();
+
+	// A snapshot to prepare. Waits while every snapshot is in flight
+	FrameSnapshot* BeginFrame();
+
+	// Hands a prepared snapshot to the render thread
+	void EndFrame(FrameSnapshot* frame);
+
+	std::mutex& GetRendererMutex();
+
+private:
+	void Run();
+
+	GLFWwindow* mWindow;
+	Renderer* mRenderer;
+	Editor* mEditor;
+
+	std::vector<std::unique_ptr<FrameSnapshot>> mSnapshots;
+	std::deque<FrameSnapshot*> mFree, mReady;
+	std::mutex mQueueMutex;
+	std::condition_variable mFreeChanged, mReadyChanged;
+	bool mStop;
+
+	std::mutex mRendererMutex;
+	std::thread mThread;
+};
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Renderer.h"
+#include "GLState.h"
+#include "MemoryTracker.h"
 
 #include "ResourceManager.h"
 #include "CubeMesh.h"
@@ -17,11 +19,91 @@
 #include <glm/gtx/quaternion.hpp>
 
 #include <vector>
+#include <random>
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
 #include <irrklang/irrKlang.h>
 
 
-const int SHADOW_MAP_WIDTH = 2048;
-const int SHADOW_MAP_HEIGHT = 2048;
+// Camera clip planes, also used to normalize the depth in draw sort keys
+const float CAMERA_NEAR_PLANE = 0.1f;
+const float CAMERA_FAR_PLANE = 100.0f;
+
+// Shapes a job handles at once in the per-frame transform, sort key and batch work. Fewer run inline
+const size_t SHAPES_PER_JOB = 256;
+
+// Queue items recorded into one command buffer, by one job
+const size_t ITEMS_PER_COMMAND_BUFFER = 128;
+
+// Runs of each submission path the editor's benchmark averages over
+const int SUBMIT_BENCHMARK_ITERATIONS = 100;
+
+// Seconds the window size has to stay the same before screen-sized targets are reallocated
+const double RESIZE_DEBOUNCE_SECONDS = 0.25;
+
+// Face size of the point light's shadow cube
+const int SHADOW_MAP_SIZE = 1024;
+
+// Sizes of the precomputed shadow filter tables. Must match the ShadowSamples block in DeferredLightingShaderPBR.frag
+const int SHADOW_PCF_SAMPLES = 20;
+const int SHADOW_POISSON_SAMPLES = 32;
+const int SHADOW_BLOCKER_SAMPLES = 16;
+const GLuint SHADOW_SAMPLES_BINDING = 0;
+const GLuint IRRADIANCE_SH_BINDING = 1;
+const GLuint MOTION_VECTORS_BINDING = 2;
+
+// Sizes of the SSAO hemisphere kernel and noise tile. Must match the SSAOKernel block in SSAO.frag
+const int SSAO_KERNEL_SIZE = 32;
+const int SSAO_NOISE_SIZE = 4;
+const GLuint SSAO_KERNEL_BINDING = 3;
+
+// Length of the TAA jitter sequence, and the sample count of the MSAA mode
+const unsigned int TAA_JITTER_PHASES = 8;
+const int MSAA_SAMPLES = 4;
+
+// Baked environments kept on the GPU, least recently used are evicted past this
+const size_t IBL_CACHE_MAX_RESIDENT = 3;
+const std::string IBL_CACHE_DIRECTORY = "../resources/IBL/cache";
+const std::string DEFAULT_ENVIRONMENT = "Ditch_River";
+
+// Blur radius in pixels at full resolution when the Blur slider is at 1
+const float MAX_BLUR_RADIUS = 32.0f;
+
+const float SHADOW_NEAR_PLANE = 1.0f;
+const float SHADOW_FAR_PLANE = 25.0f;
+
+// std140 layout of the ShadowSamples uniform block
+struct ShadowSamplesBlock {
+	glm::vec4 pcfOffsets[SHADOW_PCF_SAMPLES];
+	glm::vec4 poissonDisk[SHADOW_POISSON_SAMPLES];
+	GLint sampleCounts[4];
+};
+
+// std140 layout of the SSAOKernel uniform block
+struct SSAOKernelBlock {
+	glm::vec4 kernel[SSAO_KERNEL_SIZE];
+	glm::vec4 noise[SSAO_NOISE_SIZE * SSAO_NOISE_SIZE];
+};
+
+// std140 layout of the MotionVectors uniform block
+struct MotionVectorsBlock {
+	glm::mat4 currViewProj;
+	glm::mat4 prevViewProj;
+};
+
+// Low-discrepancy sequence in [0, 1), index starts at 1
+float Halton(unsigned int index, unsigned int base) {
+	float result = 0.0f;
+	float fraction = 1.0f;
+	while (index > 0) {
+		fraction /= static_cast<float>(base);
+		result += fraction * static_cast<float>(index % base);
+		index /= base;
+	}
+	return result;
+}
 
 // error checking code - taken from LearnOpenGL
 GLenum glCheckError_(const char* file, int line)
@@ -49,23 +131,46 @@ GLenum glCheckError_(const char* file, int line)
 Renderer::Renderer(const int SCREEN_WIDTH, const int SCREEN_HEIGHT, Cubemap* _cubemap, ResourceManager* pResourceManager) :
 	mCubeMesh(new CubeMesh()), mSphereMesh(new SphereMesh()), mQuadMesh(new QuadMesh()),
 	//proj(glm::ortho(-2.0f, 2.0f, -1.5f, 1.5f, 0.1f, 100.0f)),
-	mProj(glm::perspective(glm::radians(45.0f), static_cast<float>(SCREEN_WIDTH) / static_cast<float>(SCREEN_HEIGHT), 0.1f, 100.0f)),
-	mCubemap(_cubemap), mSkyVAO(0), mSkyVBO(0), mFBO(0), mRBO(0), mTextureColorBuffer(0), mImageFilters(new ImageFilters),
+	mProj(glm::perspective(glm::radians(45.0f), static_cast<float>(SCREEN_WIDTH) / static_cast<float>(SCREEN_HEIGHT), CAMERA_NEAR_PLANE, CAMERA_FAR_PLANE)),
+	mCubemap(_cubemap), mSkyVAO(0), mSkyVBO(0), mImageFilters(new ImageFilters),
 	mScreenShader(new Shader("ScreenShader.vert", "ScreenShader.frag")),
 	mOutlineShader(new Shader("Outlining.vert", "Outlining.frag")),
 	mGBufferShader(new Shader("GBufferShader.vert", "GBufferShader.frag")),
 	mGBufferShaderPBR(new Shader("GBufferShader.vert", "GBufferShaderPBR.frag")),
 	mDeferredShadingLightingShader(new Shader("DeferredLightingShader.vert", "DeferredLightingShader.frag")),
 	mDeferredShadingLightingShaderPBR(new Shader("DeferredLightingShader.vert", "DeferredLightingShaderPBR.frag")),
-	mHDRShader(new Shader("HDR.vert", "HDR.frag")),
 	mSkyboxShader(new Shader("Skybox.vert", "Skybox.frag")),
 	mModelShader(new Shader("PhongModel.vert", "PhongModel.frag")),
 	mPointShadowDepthShader(new Shader("PointShadowDepth.vert", "PointShadowDepth.frag", "PointShadowDepth.geom")),
 	mEquiRecToCubeMapShader(new Shader("EquiRecToCubemap.vert", "EquiRecToCubemap.frag")),
-	mSkyboxOn(true), mDeferredShadingOn(true), mHDROn(false), mExposure(1.0f), mClearColor(glm::vec3(0)), mGBufferTextures(4),
-	mShadowTransforms(6), mShadowProj(glm::perspective(glm::radians(90.0f), static_cast<float>(1024.0f)/1024.0f, 1.0f, 25.0f)),
+	mPrefilterShader(new Shader("EquiRecToCubemap.vert", "PrefilterEnvMap.frag")),
+	mBRDFShader(new Shader("DeferredLightingShader.vert", "BRDFIntegration.frag")),
+	mUpscaleShader(new Shader("ScreenShader.vert", "Upscale.frag")),
+	mTAAShader(new Shader("ScreenShader.vert", "TAA.frag")),
+	mSSAOShader(new Shader("ScreenShader.vert", "SSAO.frag")),
+	mSSAOBlurShader(new Shader("ScreenShader.vert", "SSAOBlur.frag")),
+	mDepthPrepassShader(new Shader("DepthPrepass.vert", "DepthPrepass.frag")),
+	mIndirectCullShader(nullptr), mIndirectShadowShader(nullptr), mIndirectPrepassShader(nullptr),
+	mSkyboxOn(true), mDeferredShadingOn(true), mDepthPrepassOn(true), mGPUDrivenOn(true), mCommandBuffersOn(true), mExposure(1.0f), mTonemapper(Tonemapper::NONE),
+	mBloomOn(false), mBloomIntensity(0.04f), mBloom(new Bloom()),
+	mGaussianBlur(new GaussianBlur()), mClearColor(glm::vec3(0)), mShowGBuffer(false),
+	mDynamicResolutionOn(false), mUpscaleSharpness(0.2f), mDynamicResolution(new DynamicResolution()),
+	mAntiAliasing(AntiAliasing::NONE), mTAAHistoryWeight(0.9f), mGBufferTextures(4),
+	mSSAOOn(true), mSSAOHalfResolution(true), mSSAORadius(0.5f), mSSAOBias(0.025f), mSSAOIntensity(1.0f),
+	mShadowTransforms(6), mShadowProj(glm::perspective(glm::radians(90.0f), 1.0f, SHADOW_NEAR_PLANE, SHADOW_FAR_PLANE)),
+	mShadowFilter(ShadowFilter::POISSON_PCF), mShadowBias(0.05f), mShadowFilterRadius(0.05f), mShadowLightSize(0.25f),
+	mLastShadowFilter(ShadowFilter::POISSON_PCF), mShadowFilterFrames(0), mSSAOKernelUBO(0), mLastSSAOHalfResolution(true), mSSAOFrames(0),
+	mTransforms(nullptr), mFrame(nullptr), mPreparedFrames(0), mSubmittedFrames(0), mPrevViewProj(1.0f), mMotionVectorsUBO(0),
+	mHistoryTextures{ 0, 0 }, mHistoryWidth(0), mHistoryHeight(0), mHistoryIndex(0), mHistoryValid(false), mHistoryUVScale(1.0f),
+	mJitterIndex(0), mLastAntiAliasing(AntiAliasing::NONE), mAntiAliasingFrames(0),
+	mProfiler(new GPUProfiler()), mFrameArena(new FrameArena()), mFrameGraph(new FrameGraph(mFrameArena)), mRenderQueue(new RenderQueue()),
+	mIndirectGeometry(nullptr), mShadowBatch(nullptr), mPrepassBatch(nullptr), mJobSystem(new JobSystem()), mSubmitState(),
+	mCommandBufferCounts(), mSubmitBenchmarkRequested(false),
+	mTargetWidth(SCREEN_WIDTH), mTargetHeight(SCREEN_HEIGHT), mPendingWidth(SCREEN_WIDTH), mPendingHeight(SCREEN_HEIGHT), mResizeTime(0.0),
+	mIBLCache(new IBLCache(IBL_CACHE_DIRECTORY, IBL_CACHE_MAX_RESIDENT)), mEnvironment(nullptr), mPendingEnvironmentSource(nullptr), mRequestedEnvironmentSource(nullptr),
 	mCaptureProj(glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f)), mCaptureViews(6)
 {
+	mTransforms = new TransformSystem(mJobSystem);
 	mShapeShaders.push_back(new Shader("Shader.vert", "Shader.frag"));
 	mShapeShaders.push_back(new Shader("PhongPBR.vert", "Phong.frag"));
 	mShapeShaders.push_back(new Shader("PhongPBR.vert", "PBR.frag"));
@@ -85,7 +190,10 @@ Renderer::Renderer(const int SCREEN_WIDTH, const int SCREEN_HEIGHT, Cubemap* _cu
 	mShapeShaders[static_cast<int>(ShapeShading::PBR)]->SetInt("metallicMap", 3);
 	mShapeShaders[static_cast<int>(ShapeShading::PBR)]->SetInt("depthMap", 4);
 	mShapeShaders[static_cast<int>(ShapeShading::PBR)]->SetInt("aoMap", 5);
-	mShapeShaders[static_cast<int>(ShapeShading::PBR)]->SetInt("irradianceMap", 6);
+	mShapeShaders[static_cast<int>(ShapeShading::PBR)]->SetUniformBlockBinding("IrradianceSH", IRRADIANCE_SH_BINDING);
+	mShapeShaders[static_cast<int>(ShapeShading::PBR)]->SetInt("prefilterMap", 7);
+	mShapeShaders[static_cast<int>(ShapeShading::PBR)]->SetInt("brdfLUT", 8);
+	mShapeShaders[static_cast<int>(ShapeShading::PBR)]->SetFloat("prefilterMaxLod", static_cast<float>(IBLCache::PREFILTER_MIP_LEVELS - 1));
 
 	//mModelShader->SetFloat("constant", 1.0f);
 	//mModelShader->SetFloat("linear", 0.35f);
@@ -118,9 +226,50 @@ Renderer::Renderer(const int SCREEN_WIDTH, const int SCREEN_HEIGHT, Cubemap* _cu
 	mDeferredShadingLightingShaderPBR->SetInt("gAlbedo", 2);
 	mDeferredShadingLightingShaderPBR->SetInt("gRoughMetalAO", 3);
 	mDeferredShadingLightingShaderPBR->SetInt("shadowDepthCubeMap", 4);
+	mDeferredShadingLightingShaderPBR->SetInt("shadowCompareCubeMap", 5);
+	mDeferredShadingLightingShaderPBR->SetUniformBlockBinding("ShadowSamples", SHADOW_SAMPLES_BINDING);
+	mDeferredShadingLightingShaderPBR->SetUniformBlockBinding("IrradianceSH", IRRADIANCE_SH_BINDING);
+	mDeferredShadingLightingShaderPBR->SetInt("prefilterMap", 7);
+	mDeferredShadingLightingShaderPBR->SetInt("brdfLUT", 8);
+	mDeferredShadingLightingShaderPBR->SetInt("ssaoTexture", 6);
+	mDeferredShadingLightingShaderPBR->SetFloat("prefilterMaxLod", static_cast<float>(IBLCache::PREFILTER_MIP_LEVELS - 1));
 
 	mScreenShader->Use();
 	mScreenShader->SetInt("screenTexture", 0);
+	mScreenShader->SetInt("bloomTexture", 1);
+	mScreenShader->SetInt("blurTexture", 2);
+
+	mUpscaleShader->Use();
+	mUpscaleShader->SetInt("sourceTexture", 0);
+
+	mTAAShader->Use();
+	mTAAShader->SetInt("currentTexture", 0);
+	mTAAShader->SetInt("historyTexture", 1);
+	mTAAShader->SetInt("velocityTexture", 2);
+	mTAAShader->SetInt("depthTexture", 3);
+
+	mSSAOShader->Use();
+	mSSAOShader->SetInt("gPosition", 0);
+	mSSAOShader->SetInt("gNormal", 1);
+	mSSAOShader->SetInt("depthTexture", 2);
+	mSSAOShader->SetUniformBlockBinding("SSAOKernel", SSAO_KERNEL_BINDING);
+
+	mSSAOBlurShader->Use();
+	mSSAOBlurShader->SetInt("ssaoTexture", 0);
+
+	// Everything that renders scene geometry writes velocity
+	mGBufferShaderPBR->SetUniformBlockBinding("MotionVectors", MOTION_VECTORS_BINDING);
+	mOutlineShader->SetUniformBlockBinding("MotionVectors", MOTION_VECTORS_BINDING);
+	for (Shader* shader : mShapeShaders) {
+		shader->SetUniformBlockBinding("MotionVectors", MOTION_VECTORS_BINDING);
+	}
+
+	glGenBuffers(1, &mMotionVectorsUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, mMotionVectorsUBO);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(MotionVectorsBlock), nullptr, GL_DYNAMIC_DRAW);
+	MemoryTracker::TrackGPU(GPUObject::BUFFER, mMotionVectorsUBO, sizeof(MotionVectorsBlock));
+	glBindBufferBase(GL_UNIFORM_BUFFER, MOTION_VECTORS_BINDING, mMotionVectorsUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
 	//mCaptureViews[0] = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f));
 	//mCaptureViews[1] = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f));
@@ -134,39 +283,214 @@ Renderer::Renderer(const int SCREEN_WIDTH, const int SCREEN_HEIGHT, Cubemap* _cu
 	mImageFilters->outline = 0.0f;
 	mImageFilters->invert = false;
 
+	for (int i = 0; i < static_cast<int>(ShadowFilter::NUM); i++) {
+		mShadowFilterCost[i] = 0.0f;
+	}
+	for (int i = 0; i < static_cast<int>(AntiAliasing::NUM); i++) {
+		mAntiAliasingCost[i] = 0.0f;
+	}
+	mSSAOCost[0] = mSSAOCost[1] = 0.0f;
+
 	SetupSkybox();
 	SetupForIBL(pResourceManager);
-	SetupForShadows();
-	SetupForHDR(SCREEN_WIDTH, SCREEN_HEIGHT);
-	SetupForDeferredShading(SCREEN_WIDTH, SCREEN_HEIGHT);
-	SetupFBO(SCREEN_WIDTH, SCREEN_HEIGHT);
+	SetupShadowSamples();
+	SetupSSAO();
+	SetupIndirectDraw();
+	SetupCommandBuffers();
 
-	glEnable(GL_STENCIL_TEST);
-	glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+	GLState::Enable(GL_STENCIL_TEST);
+	GLState::StencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
 }
 
 Renderer::~Renderer() {
+	for (auto& [name, shape] : mShapeDS) {
+		delete shape;
+	}
+	for (RetiredShape& retired : mRetiredShapes) {
+		delete retired.shape;
+	}
+	for (auto& [name, model] : mModelDS) {
+		delete model;
+	}
+
 	delete mCubeMesh;
-	delete mScreenShader;
-	delete mSkyboxShader;
+	delete mSphereMesh;
+	delete mQuadMesh;
+
+	for (Shader* shader : { mScreenShader, mSkyboxShader, mOutlineShader, mGBufferShader, mGBufferShaderPBR,
+		mDeferredShadingLightingShader, mDeferredShadingLightingShaderPBR, mModelShader, mPointShadowDepthShader,
+		mEquiRecToCubeMapShader, mPrefilterShader, mBRDFShader, mUpscaleShader, mTAAShader,
+		mSSAOShader, mSSAOBlurShader, mDepthPrepassShader, mIndirectCullShader, mIndirectShadowShader, mIndirectPrepassShader }) {
+		delete shader;
+	}
+	for (Shader* shader : mShapeShaders) {
+		delete shader;
+	}
+
 	delete mImageFilters;
 	delete mCubemap;
+	delete mProfiler;
+
+	// Every render target lives in the frame graph's pool, except the TAA history
+	UpdateHistoryTextures(0, 0);
+	delete mFrameGraph;
+	delete mFrameArena;
+	delete mRenderQueue;
+	delete mShadowBatch;
+	delete mPrepassBatch;
+	delete mIndirectGeometry;
+	delete mTransforms;
+	delete mJobSystem;
+	delete mBloom;
+	delete mGaussianBlur;
+	delete mDynamicResolution;
+
+	GLState::DeleteVertexArrays(1, &mSkyVAO);
+	GLState::DeleteBuffers(1, &mSkyVBO);
+	glDeleteSamplers(1, &mShadowCompareSampler);
+
+	delete mIBLCache;
+	GLState::DeleteTextures(1, &mBRDFLUT);
+	GLState::DeleteBuffers(1, &mIrradianceSHUBO);
+	GLState::DeleteFramebuffers(1, &mCaptureFBO);
+	GLState::DeleteBuffers(1, &mShadowSamplesUBO);
+	GLState::DeleteBuffers(1, &mMotionVectorsUBO);
+	GLState::DeleteBuffers(1, &mSSAOKernelUBO);
+}
+
+void Renderer::Draw(const int windowWidth, const int windowHeight, Camera* pCamera, AudioPlayer* pAudioPlayer) {
+	Prepare(mSnapshot, windowWidth, windowHeight, pCamera, pAudioPlayer);
+	Submit(mSnapshot);
 }
 
-void Renderer::Draw(const int SCREEN_WIDTH, const int SCREEN_HEIGHT, Camera* pCamera, AudioPlayer* pAudioPlayer) {
+void Renderer::Prepare(FrameSnapshot& frame, const int windowWidth, const int windowHeight, Camera* pCamera, AudioPlayer* pAudioPlayer) {
+	MemoryScope memoryScope(MemoryCategory::RENDERER);
+	mPreparedFrames++;
+
+	frame.windowWidth = windowWidth;
+	frame.windowHeight = windowHeight;
+	frame.view = pCamera->GetViewMatrix();
+	frame.cameraPosition = pCamera->mPosition;
+	frame.zoom = pCamera->mZoom;
+
+	// Read once, every shape pulses by the same amount
+	frame.audioSample = pAudioPlayer->GetData();
+
+	frame.shapes.clear();
+	frame.lights.clear();
+	frame.hasShadowLight = false;
+	for (auto& [name, shape] : mShapeDS) {
+		frame.shapes.push_back(shape);
+		if (shape->mShading == ShapeShading::LIGHT) {
+			frame.lights.push_back({ shape->mTransform->position, shape->mMaterial->ambient });
+		}
+	}
+
+	// using only one point light source right now
+	auto light = mShapeDS.find("Light Source");
+	if (light != mShapeDS.end()) {
+		frame.hasShadowLight = true;
+		frame.shadowLightPosition = light->second->mTransform->position;
+	}
+
+	// Every pass draws with these, so a shape's matrix is the same in all of them. While the audio sample
+	// changes, every matrix is recomposed
+	mTransforms->SetScaleOffset(static_cast<float>(frame.audioSample) / 100000);
+	mTransforms->Update();
+	mTransforms->Capture(frame.transforms);
+}
 
-	glEnable(GL_DEPTH_TEST);
+void Renderer::Submit(const FrameSnapshot& frame) {
+	MemoryScope memoryScope(MemoryCategory::RENDERER);
+	mFrame = &frame;
+	const int windowWidth = frame.windowWidth;
+	const int windowHeight = frame.windowHeight;
+
+	mProfiler->BeginFrame();
+	mSubmitStats = SubmitStats();
+	GLState::ResetStats();
+	mJobSystem->ResetStats();
+	Shader::GetUniformStats() = Shader::UniformStats();
+
+	// Environments picked in the editor since last frame. Streams in the ones loading, a slice per frame
+	if (!mRequestedEnvironment.empty()) {
+		LoadEnvironment(mRequestedEnvironment, mRequestedEnvironmentSource);
+		mRequestedEnvironment = "";
+	}
+	UpdateEnvironment(IBLCache::UPLOAD_BUDGET_BYTES);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, mHDRFBO);
+	// Screen-sized targets follow the window once it has kept its size for a moment, so dragging a window
+	// edge doesn't allocate a new set every frame. Until then the old targets are stretched over the window
+	bool resized = UpdateTargetSize(windowWidth, windowHeight);
+	const int targetWidth = mTargetWidth;
+	const int targetHeight = mTargetHeight;
 
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-	glClearColor(mClearColor.r, mClearColor.y, mClearColor.z, 1.0f);
+	GLState::Enable(GL_DEPTH_TEST);
 
-	
 	// Shape Drawing Pass
-	mProj = glm::perspective(glm::radians(pCamera->mZoom),
-		static_cast<float>(SCREEN_WIDTH) / static_cast<float>(SCREEN_HEIGHT), 0.1f, 100.0f);
+	mProj = glm::perspective(glm::radians(frame.zoom),
+		static_cast<float>(windowWidth) / static_cast<float>(windowHeight), CAMERA_NEAR_PLANE, CAMERA_FAR_PLANE);
+
+	// Dynamic resolution renders the scene into the bottom left of full size targets, so a new scale
+	// never reallocates anything. The upscale pass stretches it back over the window
+	float renderScale = 1.0f;
+	if (mDynamicResolutionOn) {
+		renderScale = mDynamicResolution->Update(mProfiler->GetFrameTime());
+	}
+	else {
+		mDynamicResolution->Reset();
+	}
+	const int renderWidth = std::max(1, static_cast<int>(targetWidth * renderScale + 0.5f));
+	const int renderHeight = std::max(1, static_cast<int>(targetHeight * renderScale + 0.5f));
+
+	// Velocity comes from the unjittered matrices, so history follows the scene and not the jitter.
+	// The sky writes no velocity, TAA reprojects it with the camera motion alone
+	const glm::mat4 viewProj = mProj * mFrame->view;
+	const glm::mat4 currToPrevClip = mPrevViewProj * glm::inverse(viewProj);
+	UpdateMotionVectors(viewProj);
+	BuildRenderQueue();
+	if (mSubmitBenchmarkRequested) {
+		RunSubmitBenchmark();
+		mSubmitBenchmarkRequested = false;
+	}
+	if (mCommandBuffersOn) {
+		RecordCommandBuffers();
+	}
 
+	AntiAliasing antiAliasing = mAntiAliasing;
+	if (antiAliasing == AntiAliasing::MSAA_4X && mDeferredShadingOn) {
+		antiAliasing = AntiAliasing::NONE;
+	}
+	const bool taaOn = antiAliasing == AntiAliasing::TAA;
+	const bool msaaOn = antiAliasing == AntiAliasing::MSAA_4X;
+
+	if (taaOn) {
+		// Sub-pixel offset from the (2, 3) Halton sequence, in pixels of the render area
+		mJitterIndex = mJitterIndex % TAA_JITTER_PHASES + 1;
+		mProj[2][0] += (Halton(mJitterIndex, 2) - 0.5f) * 2.0f / renderWidth;
+		mProj[2][1] += (Halton(mJitterIndex, 3) - 0.5f) * 2.0f / renderHeight;
+		UpdateHistoryTextures(targetWidth, targetHeight);
+	}
+	else {
+		UpdateHistoryTextures(0, 0);
+	}
+
+	// Passes and their targets are declared anew every frame. Targets of modes that are off are never
+	// created, and the graph hands out pooled textures, framebuffers, binds and clears as needed.
+	// Last frame's passes point into the arena, so the graph lets go of them first
+	mFrameGraph->Reset();
+	mFrameArena->Reset();
+
+	const glm::vec4 clearColor = glm::vec4(mClearColor, 1.0f);
+	const FrameGraphTextureDesc colorDesc = { targetWidth, targetHeight, GL_RGBA16F, GL_LINEAR };
+	const FrameGraphTextureDesc depthDesc = { targetWidth, targetHeight, GL_DEPTH24_STENCIL8, GL_NEAREST };
+
+	FrameGraphResource sceneColor = FrameGraph::INVALID_RESOURCE;
+	FrameGraphResource sceneDepth = FrameGraph::INVALID_RESOURCE;
+
+	// Only rendered for TAA. It is only read where geometry was drawn, so clearing it to the background color is harmless
+	const FrameGraphTextureDesc velocityDesc = { targetWidth, targetHeight, GL_RG16F, GL_NEAREST };
+	FrameGraphResource velocity = FrameGraph::INVALID_RESOURCE;
 
 	// if doing deferred shading
 	// Only for PBR. (And light cubes obviously)
@@ -175,7 +499,7 @@ void Renderer::Draw(const int SCREEN_WIDTH, const int SCREEN_HEIGHT, Camera* pCa
 		// --------- SHADOW PASS ---------
 
 		// using only one point light source right now
-		glm::vec3 lightPos = mShapeDS["Light Source"]->mTransform->position;
+		glm::vec3 lightPos = mFrame->shadowLightPosition;
 
 		// Setting up shadow transforms for each face of the Cubemap
 		mShadowTransforms[0] = mShadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0));
@@ -186,282 +510,697 @@ void Renderer::Draw(const int SCREEN_WIDTH, const int SCREEN_HEIGHT, Camera* pCa
 		mShadowTransforms[5] = mShadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0, 0.0, -1.0), glm::vec3(0.0, -1.0, 0.0));
 
 		// Draw to cubemap depth texture to create shadow map
-		glViewport(0, 0, 1024, 1024);
-		glBindFramebuffer(GL_FRAMEBUFFER, mShadowDepthMapFBO);
-		glClear(GL_DEPTH_BUFFER_BIT);
-		mPointShadowDepthShader->Use();
-		for (unsigned int i = 0; i < 6; ++i)
-			mPointShadowDepthShader->SetMat4("shadowMatrices[" + std::to_string(i) + "]", mShadowTransforms[i]);
-		mPointShadowDepthShader->SetFloat("farPlane", 25.0f);
-		mPointShadowDepthShader->SetVec3("lightPos", lightPos);
-		for (auto& [name, shape] : mShapeDS) {
-			if (shape->mShading != ShapeShading::LIGHT) {
-				glm::mat4 model = CreateModelMatrix(shape, pAudioPlayer);
-				mPointShadowDepthShader->SetMat4("model", model);
-				SetShapeAndDraw(shape);
+		FrameGraphResource shadowMap;
+		mFrameGraph->AddPass("Shadow Map", [&](FrameGraph::PassBuilder& builder) {
+			FrameGraphTextureDesc shadowDesc = { SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, GL_DEPTH_COMPONENT24, GL_NEAREST, true };
+			shadowMap = builder.Write(builder.Create("Shadow Cube", shadowDesc));
+			builder.Clear(GL_DEPTH_BUFFER_BIT);
+		}, [this, lightPos](FrameGraph& graph) {
+			ResetSubmitState();
+			Shader* shader = mGPUDrivenOn && mIndirectShadowShader ? mIndirectShadowShader : mPointShadowDepthShader;
+			UseProgram(shader);
+			char uniform[32];
+			for (unsigned int i = 0; i < 6; ++i) {
+				snprintf(uniform, sizeof(uniform), "shadowMatrices[%u]", i);
+				shader->SetMat4(uniform, mShadowTransforms[i]);
 			}
-		}
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			shader->SetFloat("farPlane", SHADOW_FAR_PLANE);
+			shader->SetVec3("lightPos", lightPos);
+			if (mGPUDrivenOn) {
+				// Nothing past the shadow map's far plane can cast into it
+				mShadowBatch->Draw(shader, mIndirectCullShader, nullptr, 0, glm::vec4(lightPos, SHADOW_FAR_PLANE));
+				return;
+			}
+			SubmitQueuePass(QueuePass::SHADOW, mPointShadowDepthShader);
+		});
 
 
 		// --------- GEOMETRY PASS ---------
 
-		// First bind G-Buffer Framebuffer
-		glBindFramebuffer(GL_FRAMEBUFFER, mGBuffer);
+		// Load all geometry info of PBR-lit spheres into the FBO (multiple render targets)
+		FrameGraphResource gBuffer[4];
+		mFrameGraph->AddPass("G-Buffer", [&](FrameGraph::PassBuilder& builder) {
+			// Position, normal, albedo and roughness/metalness/AO
+			gBuffer[0] = builder.Write(builder.Create("G-Buffer Position", { targetWidth, targetHeight, GL_RGBA16F, GL_NEAREST }));
+			gBuffer[1] = builder.Write(builder.Create("G-Buffer Normal", { targetWidth, targetHeight, GL_RGBA16F, GL_NEAREST }));
+			gBuffer[2] = builder.Write(builder.Create("G-Buffer Albedo", { targetWidth, targetHeight, GL_RGBA8, GL_NEAREST }));
+			gBuffer[3] = builder.Write(builder.Create("G-Buffer RMA", { targetWidth, targetHeight, GL_RGBA8, GL_NEAREST }));
+			if (taaOn) {
+				velocity = builder.Write(builder.Create("Velocity", velocityDesc));
+			}
+			sceneDepth = builder.Write(builder.Create("Scene Depth", depthDesc));
+			builder.Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, clearColor);
+			builder.SetRenderArea(renderWidth, renderHeight);
+		}, [this](FrameGraph& graph) {
+			ResetSubmitState();
+			SubmitQueuePass(QueuePass::GBUFFER, nullptr);
+		});
+
+		// ------ AMBIENT OCCLUSION ------
+
+		// Occlusion and a depth-aware blur at half resolution by default, upsampled in the lighting pass
+		FrameGraphResource ssao = FrameGraph::INVALID_RESOURCE;
+		const int ssaoScale = mSSAOHalfResolution ? 2 : 1;
+		const int ssaoWidth = (renderWidth + ssaoScale - 1) / ssaoScale;
+		const int ssaoHeight = (renderHeight + ssaoScale - 1) / ssaoScale;
+		if (mSSAOOn) {
+			const FrameGraphTextureDesc ssaoDesc = { (targetWidth + ssaoScale - 1) / ssaoScale, (targetHeight + ssaoScale - 1) / ssaoScale, GL_RG16F, GL_NEAREST };
+
+			mFrameGraph->BeginGroup("SSAO");
+			FrameGraphResource occlusion;
+			FrameGraphResource depth = sceneDepth;
+			mFrameGraph->AddPass("SSAO Occlusion", [&](FrameGraph::PassBuilder& builder) {
+				builder.Read(gBuffer[0]);
+				builder.Read(gBuffer[1]);
+				builder.Read(depth);
+				occlusion = builder.Write(builder.Create("SSAO Occlusion", ssaoDesc));
+				builder.SetRenderArea(ssaoWidth, ssaoHeight);
+			}, [this, gBuffer, depth, renderWidth, renderHeight, ssaoScale](FrameGraph& graph) {
+				GLState::Disable(GL_DEPTH_TEST);
+				mSSAOShader->Use();
+				mSSAOShader->SetMat4("view", mFrame->view);
+				mSSAOShader->SetMat4("proj", mProj);
+				mSSAOShader->SetVec2("renderSize", static_cast<float>(renderWidth), static_cast<float>(renderHeight));
+				mSSAOShader->SetInt("scale", ssaoScale);
+				mSSAOShader->SetFloat("radius", mSSAORadius);
+				mSSAOShader->SetFloat("bias", mSSAOBias);
+				mSSAOShader->SetFloat("intensity", mSSAOIntensity);
+				mQuadMesh->BindVAO();
+				GLState::ActiveTexture(GL_TEXTURE0);
+				GLState::BindTexture(GL_TEXTURE_2D, graph.GetTexture(gBuffer[0]));
+				GLState::ActiveTexture(GL_TEXTURE1);
+				GLState::BindTexture(GL_TEXTURE_2D, graph.GetTexture(gBuffer[1]));
+				GLState::ActiveTexture(GL_TEXTURE2);
+				GLState::BindTexture(GL_TEXTURE_2D, graph.GetTexture(depth));
+				glDrawArrays(GL_TRIANGLES, 0, 6);
+				GLState::Enable(GL_DEPTH_TEST);
+			});
+			mFrameGraph->AddPass("SSAO Blur", [&](FrameGraph::PassBuilder& builder) {
+				builder.Read(occlusion);
+				ssao = builder.Write(builder.Create("SSAO", ssaoDesc));
+				builder.SetRenderArea(ssaoWidth, ssaoHeight);
+			}, [this, occlusion, ssaoWidth, ssaoHeight](FrameGraph& graph) {
+				GLState::Disable(GL_DEPTH_TEST);
+				mSSAOBlurShader->Use();
+				mSSAOBlurShader->SetVec2("renderSize", static_cast<float>(ssaoWidth), static_cast<float>(ssaoHeight));
+				mQuadMesh->BindVAO();
+				GLState::ActiveTexture(GL_TEXTURE0);
+				GLState::BindTexture(GL_TEXTURE_2D, graph.GetTexture(occlusion));
+				glDrawArrays(GL_TRIANGLES, 0, 6);
+				GLState::Enable(GL_DEPTH_TEST);
+			});
+			mFrameGraph->EndGroup();
+		}
+
+		// ------ LIGHTING/COLOR PASS ------
+
+		// Use the G-Buffer textures for info on how to light the scene, all drawn on a screen-sized quad.
+		// The G-Buffer depth stays attached (untouched by the quad) so the passes after it can depth test
+		// against the scene without a depth blit
+		mFrameGraph->AddPass("Lighting", [&](FrameGraph::PassBuilder& builder) {
+			for (FrameGraphResource texture : gBuffer) {
+				builder.Read(texture);
+			}
+			builder.Read(shadowMap);
+			builder.Read(ssao);
+			sceneColor = builder.Write(builder.Create("Scene Color", colorDesc));
+			sceneDepth = builder.Write(sceneDepth);
+			builder.SetRenderArea(renderWidth, renderHeight);
+		}, [this, gBuffer, shadowMap, ssao, ssaoScale, ssaoWidth, ssaoHeight, lightPos](FrameGraph& graph) {
+			GLState::Disable(GL_DEPTH_TEST);
+			mQuadMesh->BindVAO();
+			mDeferredShadingLightingShaderPBR->Use();
+
+			// Bind all G-Buffer textures
+			for (int i = 0; i < 4; ++i) {
+				GLState::ActiveTexture(GL_TEXTURE0 + i);
+				GLState::BindTexture(GL_TEXTURE_2D, graph.GetTexture(gBuffer[i]));
+			}
 
-		// Clear all color buffers and depth buffer
-		glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glClearColor(mClearColor.r, mClearColor.y, mClearColor.z, 1.0f);
+			GLState::ActiveTexture(GL_TEXTURE4);
+			GLState::BindTexture(GL_TEXTURE_CUBE_MAP, graph.GetTexture(shadowMap));
+
+			// Same shadow map again, read through the comparison sampler
+			GLState::ActiveTexture(GL_TEXTURE5);
+			GLState::BindTexture(GL_TEXTURE_CUBE_MAP, graph.GetTexture(shadowMap));
+			glBindSampler(5, mShadowCompareSampler);
+
+			// Set up shader vars
+			SetLightVarsInShader(mDeferredShadingLightingShaderPBR);
+			mDeferredShadingLightingShaderPBR->SetVec3("viewPos", mFrame->cameraPosition);
+			mDeferredShadingLightingShaderPBR->SetVec3("lightPos", lightPos);
+			mDeferredShadingLightingShaderPBR->SetFloat("farPlane", SHADOW_FAR_PLANE);
+			mDeferredShadingLightingShaderPBR->SetFloat("nearPlane", SHADOW_NEAR_PLANE);
+			mDeferredShadingLightingShaderPBR->SetInt("shadowFilter", static_cast<int>(mShadowFilter));
+			mDeferredShadingLightingShaderPBR->SetFloat("shadowBias", mShadowBias);
+			mDeferredShadingLightingShaderPBR->SetFloat("shadowFilterRadius", mShadowFilterRadius);
+			mDeferredShadingLightingShaderPBR->SetFloat("shadowLightSize", mShadowLightSize);
+			mDeferredShadingLightingShaderPBR->SetInt("iblOn", mSkyboxOn && mEnvironment);
+			if (mSkyboxOn && mEnvironment) {
+				BindIBLMaps();
+			}
+			mDeferredShadingLightingShaderPBR->SetInt("ssaoOn", mSSAOOn);
+			if (mSSAOOn) {
+				mDeferredShadingLightingShaderPBR->SetInt("ssaoScale", ssaoScale);
+				mDeferredShadingLightingShaderPBR->SetVec2("ssaoSize", static_cast<float>(ssaoWidth), static_cast<float>(ssaoHeight));
+				mDeferredShadingLightingShaderPBR->SetMat4("view", mFrame->view);
+				GLState::ActiveTexture(GL_TEXTURE6);
+				GLState::BindTexture(GL_TEXTURE_2D, graph.GetTexture(ssao));
+			}
+
+			glDrawArrays(GL_TRIANGLES, 0, 6);
 
-		// Load all geometry info of PBR-lit spheres into the FBO (multiple render targets) 
-		for (auto& [name, shape] : mShapeDS) {
-			if (shape->mShading == ShapeShading::PBR) {
-				SetVertexShaderVarsForDeferredShadingAndUse(shape, pCamera, pAudioPlayer);
-					//SetShapeAndDraw(shape, mDeferredShadingOn, pCamera, pAudioPlayer);
-						//if (pShape->mShading == ShapeShading::PBR) {
-				SetShapeAndDraw(shape);
+			glBindSampler(5, 0);
+			GLState::Enable(GL_DEPTH_TEST);
+		});
+
+		// The editor's G-Buffer view needs the textures after the frame, which stops later passes from reusing them
+		if (mShowGBuffer) {
+			for (FrameGraphResource texture : gBuffer) {
+				mFrameGraph->Extract(texture);
 			}
 		}
 
-		// ------ LIGHTING/COLOR PASS ------ 
+		// Render light spheres on top of scene
+		mFrameGraph->AddPass("Light Sources", [&](FrameGraph::PassBuilder& builder) {
+			sceneColor = builder.Write(sceneColor);
+			if (taaOn) {
+				velocity = builder.Write(velocity);
+			}
+			sceneDepth = builder.Write(sceneDepth);
+			builder.SetRenderArea(renderWidth, renderHeight);
+		}, [this](FrameGraph& graph) {
+			ResetSubmitState();
+			SubmitQueuePass(QueuePass::LIGHT_SOURCES, nullptr);
+		});
+
+		for (int i = 0; i < 4; ++i) {
+			mGBufferResources[i] = gBuffer[i];
+		}
+	}
+	else {
+		FrameGraphTextureDesc forwardColorDesc = colorDesc;
+		FrameGraphTextureDesc forwardDepthDesc = depthDesc;
+		if (msaaOn) {
+			forwardColorDesc.samples = MSAA_SAMPLES;
+			forwardDepthDesc.samples = MSAA_SAMPLES;
+		}
 
-		glBindFramebuffer(GL_FRAMEBUFFER, mHDRFBO);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		// Depth only, so the forward pass shades each pixel once, with an equal depth test.
+		// Stencil stays untouched until the forward pass marks the selected shapes
+		if (mDepthPrepassOn) {
+			mFrameGraph->AddPass("Depth Pre-Pass", [&](FrameGraph::PassBuilder& builder) {
+				sceneDepth = builder.Write(builder.Create(msaaOn ? "Scene Depth MSAA" : "Scene Depth", forwardDepthDesc));
+				builder.Clear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+				builder.SetRenderArea(renderWidth, renderHeight);
+			}, [this, viewProj](FrameGraph& graph) {
+				GLState::StencilMask(0x00);
+				ResetSubmitState();
+				Shader* shader = mGPUDrivenOn && mIndirectPrepassShader ? mIndirectPrepassShader : mDepthPrepassShader;
+				UseProgram(shader);
+				shader->SetMat4("view", mFrame->view);
+				shader->SetMat4("proj", mProj);
+				if (mGPUDrivenOn) {
+					// Planes of the unjittered frustum, the bounds are loose enough to cover the jitter
+					glm::vec4 planes[6];
+					IndirectBatch::GetFrustumPlanes(viewProj, planes);
+					mPrepassBatch->Draw(shader, mIndirectCullShader, planes, 6, glm::vec4(0.0f));
+				}
+				else {
+					SubmitQueuePass(QueuePass::DEPTH_PREPASS, mDepthPrepassShader);
+				}
+				GLState::StencilMask(0xFF);
+			});
+		}
 
-		// Use the G-Buffer textures for info on how to light the scene 
-		// All drawn on a screen-sized quad
-		mQuadMesh->BindVAO();
-		mDeferredShadingLightingShaderPBR->Use();
+		mFrameGraph->AddPass("Forward", [&](FrameGraph::PassBuilder& builder) {
+			sceneColor = builder.Write(builder.Create(msaaOn ? "Scene Color MSAA" : "Scene Color", forwardColorDesc));
+			if (taaOn) {
+				velocity = builder.Write(builder.Create("Velocity", velocityDesc));
+			}
+			if (mDepthPrepassOn) {
+				sceneDepth = builder.Write(sceneDepth);
+				builder.Clear(GL_COLOR_BUFFER_BIT, clearColor);
+			}
+			else {
+				sceneDepth = builder.Write(builder.Create(msaaOn ? "Scene Depth MSAA" : "Scene Depth", forwardDepthDesc));
+				builder.Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, clearColor);
+			}
+			builder.SetRenderArea(renderWidth, renderHeight);
+		}, [this](FrameGraph& graph) {
+			// Depth is final after the pre-pass, only the front-most fragment of each pixel passes
+			if (mDepthPrepassOn) {
+				GLState::DepthFunc(GL_EQUAL);
+				GLState::DepthMask(GL_FALSE);
+			}
 
+			ResetSubmitState();
+			SubmitQueuePass(QueuePass::FORWARD, nullptr);
+
+			// The outline is extruded, so it isn't in the pre-pass depth
+			GLState::DepthFunc(GL_LESS);
+			GLState::DepthMask(GL_TRUE);
+
+			// draw the outline for the selected cube
+			UseProgram(mOutlineShader);
+			mOutlineShader->SetMat4("view", mFrame->view);
+			mOutlineShader->SetMat4("proj", mProj);
+			mOutlineShader->SetFloat("outlining", mSelectedShapeThickness);
+			mOutlineShader->SetVec3("outlineColor", mSelectedShapeOutlineColor);
+
+			for (const RenderItem& item : mRenderQueue->GetPass(QueuePass::FORWARD)) {
+				if (item.shape->mIsSelected) {
+					mOutlineShader->SetMat4("model", mFrame->transforms.GetWorld(item.shape->mTransformHandle));
+					mOutlineShader->SetMat4("prevModel", mFrame->transforms.GetPrevWorld(item.shape->mTransformHandle));
+					SetShapeAndDraw(item.shape);
+				}
+			}
 
-		// Bind all G-Buffer textures
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, mGBufferTextures[0]);
+			GLState::StencilMask(0xFF);
+			GLState::StencilFunc(GL_ALWAYS, 1, 0xFF);
+		});
+	}
 
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, mGBufferTextures[1]);
+	// ------ Draw BG ------
 
-		glActiveTexture(GL_TEXTURE2);
-		glBindTexture(GL_TEXTURE_2D, mGBufferTextures[2]);
+	if (mSkyboxOn && mEnvironment) {
+		mFrameGraph->AddPass("Skybox", [&](FrameGraph::PassBuilder& builder) {
+			sceneColor = builder.Write(sceneColor);
+			sceneDepth = builder.Write(sceneDepth);
+			builder.SetRenderArea(renderWidth, renderHeight);
+		}, [this](FrameGraph& graph) {
+			GLState::DepthFunc(GL_LEQUAL);
+			mSkyboxShader->Use();
+			glm::mat4 view = glm::mat4(glm::mat3(mFrame->view));
+			mSkyboxShader->SetMat4("view", view);
+			mSkyboxShader->SetMat4("proj", mProj);
+			GLState::ActiveTexture(GL_TEXTURE0);
+			GLState::BindTexture(GL_TEXTURE_CUBE_MAP, mEnvironment->envCubemap);
+			GLState::BindVertexArray(mSkyVAO);
+			glDrawArrays(GL_TRIANGLES, 0, 36);
+			GLState::BindVertexArray(0);
+			GLState::DepthFunc(GL_LESS);
+		});
+	}
+
+	if (msaaOn) {
+		FrameGraphResource multisampledColor = sceneColor;
+		mFrameGraph->AddPass("MSAA Resolve", [&](FrameGraph::PassBuilder& builder) {
+			builder.Read(multisampledColor);
+			sceneColor = builder.Write(builder.Create("Scene Color", colorDesc));
+			builder.SetRenderArea(renderWidth, renderHeight);
+		}, [multisampledColor](FrameGraph& graph) {
+			graph.BlitFrom(multisampledColor);
+		});
+	}
+
+	if (taaOn) {
+		// Last frame's result is read, this frame's is written into the other history target and used from here on
+		FrameGraphResource history = mFrameGraph->Import("TAA History", mHistoryTextures[mHistoryIndex], colorDesc);
+		FrameGraphResource resolved = mFrameGraph->Import("TAA Resolved", mHistoryTextures[1 - mHistoryIndex], colorDesc);
+		FrameGraphResource currentColor = sceneColor;
+		FrameGraphResource depth = sceneDepth;
+		mFrameGraph->AddPass("TAA", [&](FrameGraph::PassBuilder& builder) {
+			builder.Read(currentColor);
+			builder.Read(history);
+			builder.Read(velocity);
+			builder.Read(depth);
+			sceneColor = builder.Write(resolved);
+			builder.SetRenderArea(renderWidth, renderHeight);
+		}, [this, currentColor, history, velocity, depth, renderWidth, renderHeight, currToPrevClip,
+			historyUVScale = mHistoryUVScale, historyValid = mHistoryValid](FrameGraph& graph) {
+			GLState::Disable(GL_DEPTH_TEST);
+			mTAAShader->Use();
+			mTAAShader->SetVec2("renderSize", static_cast<float>(renderWidth), static_cast<float>(renderHeight));
+			mTAAShader->SetVec2("historyUVScale", historyUVScale.x, historyUVScale.y);
+			mTAAShader->SetMat4("currToPrevClip", currToPrevClip);
+			mTAAShader->SetFloat("historyWeight", mTAAHistoryWeight);
+			mTAAShader->SetInt("historyValid", historyValid);
+			mQuadMesh->BindVAO();
+			GLState::ActiveTexture(GL_TEXTURE0);
+			GLState::BindTexture(GL_TEXTURE_2D, graph.GetTexture(currentColor));
+			GLState::ActiveTexture(GL_TEXTURE1);
+			GLState::BindTexture(GL_TEXTURE_2D, graph.GetTexture(history));
+			GLState::ActiveTexture(GL_TEXTURE2);
+			GLState::BindTexture(GL_TEXTURE_2D, graph.GetTexture(velocity));
+			GLState::ActiveTexture(GL_TEXTURE3);
+			GLState::BindTexture(GL_TEXTURE_2D, graph.GetTexture(depth));
+			glDrawArrays(GL_TRIANGLES, 0, 6);
+			GLState::Enable(GL_DEPTH_TEST);
+		});
+
+		mHistoryIndex = 1 - mHistoryIndex;
+		mHistoryValid = true;
+		mHistoryUVScale = glm::vec2(static_cast<float>(renderWidth) / targetWidth, static_cast<float>(renderHeight) / targetHeight);
+	}
+
+	if (mDynamicResolutionOn) {
+		glm::vec2 uvScale = glm::vec2(static_cast<float>(renderWidth) / targetWidth, static_cast<float>(renderHeight) / targetHeight);
+		FrameGraphResource lowResColor = sceneColor;
+		mFrameGraph->AddPass("Upscale", [&](FrameGraph::PassBuilder& builder) {
+			builder.Read(lowResColor);
+			sceneColor = builder.Write(builder.Create("Upscaled Color", colorDesc));
+		}, [this, lowResColor, uvScale](FrameGraph& graph) {
+			GLState::Disable(GL_DEPTH_TEST);
+			mUpscaleShader->Use();
+			mUpscaleShader->SetVec2("uvScale", uvScale.x, uvScale.y);
+			mUpscaleShader->SetFloat("sharpness", mUpscaleSharpness);
+			mQuadMesh->BindVAO();
+			GLState::ActiveTexture(GL_TEXTURE0);
+			GLState::BindTexture(GL_TEXTURE_2D, graph.GetTexture(lowResColor));
+			glDrawArrays(GL_TRIANGLES, 0, 6);
+		});
+	}
 
-		glActiveTexture(GL_TEXTURE3);
-		glBindTexture(GL_TEXTURE_2D, mGBufferTextures[3]);
+	// ------ POST-PROCESSING PASS ------
+	// Bloom mip chain, then one resolve pass does exposure, tone mapping and the screen filters
+
+	FrameGraphResource bloom = FrameGraph::INVALID_RESOURCE;
+	if (mBloomOn) {
+		std::pmr::vector<FrameGraphResource> mips(mBloom->GetMipCount(), mFrameArena->GetResource());
+		int width = targetWidth, height = targetHeight;
+		char name[32];
+
+		mFrameGraph->BeginGroup("Bloom Downsample");
+		for (int i = 0; i < static_cast<int>(mips.size()); ++i) {
+			FrameGraphResource source = i == 0 ? sceneColor : mips[i - 1];
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+
+			// R11G11B10 is plenty for bloom and a third of the bandwidth of RGBA16F
+			snprintf(name, sizeof(name), "Bloom Downsample %d", i);
+			mFrameGraph->AddPass(name, [&](FrameGraph::PassBuilder& builder) {
+				snprintf(name, sizeof(name), "Bloom Mip %d", i);
+				builder.Read(source);
+				mips[i] = builder.Write(builder.Create(name, { width, height, GL_R11F_G11F_B10F, GL_LINEAR }));
+			}, [this, source, i](FrameGraph& graph) {
+				mBloom->Downsample(graph.GetTexture(source), i == 0, mQuadMesh);
+			});
+		}
+		mFrameGraph->EndGroup();
+
+		mFrameGraph->BeginGroup("Bloom Upsample");
+		for (int i = static_cast<int>(mips.size()) - 1; i > 0; --i) {
+			FrameGraphResource source = mips[i];
+			snprintf(name, sizeof(name), "Bloom Upsample %d", i);
+			mFrameGraph->AddPass(name, [&](FrameGraph::PassBuilder& builder) {
+				builder.Read(source);
+				mips[i - 1] = builder.Write(mips[i - 1]);
+			}, [this, source](FrameGraph& graph) {
+				mBloom->Upsample(graph.GetTexture(source), mQuadMesh);
+			});
+		}
+		mFrameGraph->EndGroup();
 
-		glActiveTexture(GL_TEXTURE4);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, mShadowDepthCubeMap);
+		bloom = mips[0];
+	}
 
-		// Set up shader vars
-		SetLightVarsInShader(mDeferredShadingLightingShaderPBR);
-		mDeferredShadingLightingShaderPBR->SetVec3("viewPos", pCamera->mPosition);
-		mDeferredShadingLightingShaderPBR->SetVec3("lightPos", lightPos);
-		mDeferredShadingLightingShaderPBR->SetFloat("farPlane", 25.0f);
+	FrameGraphResource blur = FrameGraph::INVALID_RESOURCE;
+	bool blurOn = mImageFilters->blur > 0.0f;
+	if (blurOn) {
+		int scale = mGaussianBlur->SetRadius(mImageFilters->blur * MAX_BLUR_RADIUS);
+		FrameGraphTextureDesc blurDesc = { std::max(1, targetWidth / scale), std::max(1, targetHeight / scale), GL_RGBA16F, GL_LINEAR };
+
+		mFrameGraph->BeginGroup("Blur");
+
+		// The folded taps step through texels of the texture they sample, so both passes run on a copy
+		// of the scene at the blur's resolution instead of skipping over full resolution texels
+		FrameGraphResource blurSource = sceneColor;
+		for (int levelScale = 2; levelScale <= scale; levelScale *= 2) {
+			FrameGraphTextureDesc levelDesc = { std::max(1, targetWidth / levelScale), std::max(1, targetHeight / levelScale), GL_RGBA16F, GL_LINEAR };
+			FrameGraphResource source = blurSource;
+			mFrameGraph->AddPass("Blur Downsample", [&](FrameGraph::PassBuilder& builder) {
+				builder.Read(source);
+				blurSource = builder.Write(builder.Create("Blur Downsample", levelDesc));
+			}, [this, source](FrameGraph& graph) {
+				mGaussianBlur->Downsample(graph.GetTexture(source), mQuadMesh);
+			});
+		}
 
+		FrameGraphResource horizontal;
+		mFrameGraph->AddPass("Blur Horizontal", [&](FrameGraph::PassBuilder& builder) {
+			builder.Read(blurSource);
+			horizontal = builder.Write(builder.Create("Blur Horizontal", blurDesc));
+		}, [this, blurSource, blurDesc](FrameGraph& graph) {
+			mGaussianBlur->Pass(graph.GetTexture(blurSource), 1.0f / blurDesc.width, 0.0f, mQuadMesh);
+		});
+		mFrameGraph->AddPass("Blur Vertical", [&](FrameGraph::PassBuilder& builder) {
+			builder.Read(horizontal);
+			blur = builder.Write(builder.Create("Blur", blurDesc));
+		}, [this, horizontal, blurDesc](FrameGraph& graph) {
+			mGaussianBlur->Pass(graph.GetTexture(horizontal), 0.0f, 1.0f / blurDesc.height, mQuadMesh);
+		});
+		mFrameGraph->EndGroup();
+	}
+
+	FrameGraphResource backbuffer = mFrameGraph->ImportBackbuffer(windowWidth, windowHeight);
+	mFrameGraph->AddPass("Resolve", [&](FrameGraph::PassBuilder& builder) {
+		builder.Read(sceneColor);
+		builder.Read(bloom);
+		builder.Read(blur);
+		builder.Write(backbuffer);
+	}, [this, sceneColor, bloom, blur, blurOn](FrameGraph& graph) {
+		GLState::Disable(GL_DEPTH_TEST);
+
+		mScreenShader->Use();
+		mScreenShader->SetInt("bloomOn", mBloomOn);
+		mScreenShader->SetFloat("bloomIntensity", mBloomIntensity);
+		mScreenShader->SetInt("tonemapper", static_cast<int>(mTonemapper));
+		mScreenShader->SetFloat("exposure", mExposure);
+		mScreenShader->SetFloat("t_saturation", mImageFilters->saturation);
+		mScreenShader->SetInt("blurOn", blurOn);
+		mScreenShader->SetFloat("t_outline", mImageFilters->outline);
+		mScreenShader->SetInt("t_invert", mImageFilters->invert);
+		mQuadMesh->BindVAO();
+		GLState::ActiveTexture(GL_TEXTURE0);
+		GLState::BindTexture(GL_TEXTURE_2D, graph.GetTexture(sceneColor));
+		GLState::ActiveTexture(GL_TEXTURE1);
+		GLState::BindTexture(GL_TEXTURE_2D, graph.GetTexture(bloom));
+		GLState::ActiveTexture(GL_TEXTURE2);
+		GLState::BindTexture(GL_TEXTURE_2D, graph.GetTexture(blur));
 		glDrawArrays(GL_TRIANGLES, 0, 6);
+	});
 
-		glBindFramebuffer(GL_READ_FRAMEBUFFER, mGBuffer);
-		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mHDRFBO); // write to the HDR FBO
-		glBlitFramebuffer(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
-		glBindFramebuffer(GL_FRAMEBUFFER, mHDRFBO);
+	mFrameGraph->Compile();
+	mFrameGraph->Execute(mProfiler);
 
+	// Targets at the old size weren't used this frame, free them right away instead of when they age out
+	if (resized) {
+		mFrameGraph->Trim();
+	}
+
+	if (mDeferredShadingOn) {
+		for (int i = 0; i < 4; ++i) {
+			mGBufferTextures[i] = mShowGBuffer ? mFrameGraph->GetTexture(mGBufferResources[i]) : 0;
+		}
 
-		//mDeferredShadingLightingShader->SetFloat("constant", 1.0f);
-		//mDeferredShadingLightingShader->SetFloat("linear", 0.35f);
-		//mDeferredShadingLightingShader->SetFloat("quadratic", 0.44f);
+		// Timings arrive a few frames late, so only credit a filter once it has been active for a while
+		if (mShadowFilter != mLastShadowFilter) {
+			mLastShadowFilter = mShadowFilter;
+			mShadowFilterFrames = 0;
+		}
+		else if (++mShadowFilterFrames > 30) {
+			mShadowFilterCost[static_cast<int>(mShadowFilter)] = mProfiler->GetTiming("Lighting");
+		}
 
-		// Render light spheres on top of scene;
-		for (auto& [name, shape] : mShapeDS) {
-			if (shape->mShading == ShapeShading::LIGHT) {
-				SetShaderVarsAndUse(shape, pCamera, pAudioPlayer);
-				SetShapeAndDraw(shape);
-			}
+		// Same for SSAO at each resolution. The upsample is part of the lighting pass and not counted
+		if (!mSSAOOn || mSSAOHalfResolution != mLastSSAOHalfResolution) {
+			mLastSSAOHalfResolution = mSSAOHalfResolution;
+			mSSAOFrames = 0;
+		}
+		else if (++mSSAOFrames > 30) {
+			mSSAOCost[mSSAOHalfResolution ? 1 : 0] = mProfiler->GetTiming("SSAO");
 		}
+
+		// Anti-aliasing is compared in forward mode only, start over when coming back to it
+		mLastAntiAliasing = AntiAliasing::NUM;
 	}
 	else {
-		// Draw all the models
-		//for (auto& [name, model] : mModelDS) {
-		//	glm::mat4 modelMat = glm::mat4(1.0f);
-		//	modelMat = glm::scale(modelMat, glm::vec3(1.0f));
-		//	modelMat = glm::translate(modelMat, glm::vec3(0.1f));
-		//	modelMat = glm::rotate(modelMat, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-		//	modelMat = glm::rotate(modelMat, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		//	modelMat = glm::rotate(modelMat, glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-		//	mModelShader->Use();
-		//	mModelShader->SetMat4("model", modelMat);
-		//	mModelShader->SetMat4("view", pCamera->GetViewMatrix());
-		//	mModelShader->SetMat4("proj", mProj);
-		//	mModelShader->SetVec3("viewPos", pCamera->mPosition);
-		//	SetLightVarsInShader(mModelShader);
-		//	model->Draw(mModelShader);
-		//}
-		glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
-		//mSphereMesh->BindVAO();
-		for (const auto& [name, shape] : mShapeDS) {
-			// if shape is selected - edit stencil buffer (for outlining)
-			if (shape->mIsSelected) {
-
-				glStencilFunc(GL_ALWAYS, 1, 0xFF);
-				glStencilMask(0xFF);
-
-				SetShaderVarsAndUse(shape, pCamera, pAudioPlayer);
-				SetShapeAndDraw(shape);
-
-				glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
-				glStencilMask(0x00);
+		if (antiAliasing != mLastAntiAliasing) {
+			mLastAntiAliasing = antiAliasing;
+			mAntiAliasingFrames = 0;
+		}
+		else if (++mAntiAliasingFrames > 30) {
+			// Everything that renders the scene, plus what the mode adds on top
+			float cost = mProfiler->GetTiming("Forward") + mProfiler->GetTiming("Skybox");
+			if (mDepthPrepassOn) {
+				cost += mProfiler->GetTiming("Depth Pre-Pass");
 			}
-			else {
-				SetShaderVarsAndUse(shape, pCamera, pAudioPlayer);
-				SetShapeAndDraw(shape);
+			if (taaOn) {
+				cost += mProfiler->GetTiming("TAA");
+			}
+			else if (msaaOn) {
+				cost += mProfiler->GetTiming("MSAA Resolve");
 			}
+			mAntiAliasingCost[static_cast<int>(antiAliasing)] = cost;
 		}
 	}
-	//glDisable(GL_DEPTH_TEST); // <--- Why? Still don't understand
-	//mSphereMesh->BindVAO();
-	// draw the outline for the selected cube
-	if (!mDeferredShadingOn) {
-		mOutlineShader->Use();
-		mOutlineShader->SetMat4("view", pCamera->GetViewMatrix());
-		mOutlineShader->SetMat4("proj", mProj);
-		mOutlineShader->SetFloat("outlining", mSelectedShapeThickness);
-		mOutlineShader->SetVec3("outlineColor", mSelectedShapeOutlineColor);
 
-		for (auto& [name, shape] : mShapeDS) {
-			if (shape->mIsSelected) {
-				glm::mat4 model = CreateModelMatrix(shape, pAudioPlayer);
-				mOutlineShader->SetMat4("model", model);
-				SetShapeAndDraw(shape);
-			}
-		}
+	mProfiler->EndFrame();
 
-		glStencilMask(0xFF);
-		glStencilFunc(GL_ALWAYS, 1, 0xFF);
+	// Nothing submitted from here on was prepared before these shapes were removed
+	mSubmittedFrames++;
+	for (size_t i = 0; i < mRetiredShapes.size();) {
+		if (mRetiredShapes[i].lastFrame <= mSubmittedFrames) {
+			delete mRetiredShapes[i].shape;
+			mRetiredShapes[i] = mRetiredShapes.back();
+			mRetiredShapes.pop_back();
+		}
+		else {
+			i++;
+		}
 	}
+}
 
-	//mCubeMesh->BindVAO();
-	
-	
-	// ------ Draw BG ------
 
-	if (mSkyboxOn) {
-		glDepthFunc(GL_LEQUAL);
-		mEquiRecToCubeMapShader->Use();
-		glm::mat4 view = glm::mat4(glm::mat3(pCamera->GetViewMatrix()));
-		mEquiRecToCubeMapShader->SetMat4("view", view);
-		mEquiRecToCubeMapShader->SetMat4("proj", mProj);
-		glActiveTexture(GL_TEXTURE0);
-		mHDRIBLTextureBG->Bind();
-		glBindVertexArray(mSkyVAO);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-		glBindVertexArray(0);
-		glDepthFunc(GL_LESS);
-	}
-	
-	//if (mSkyboxOn) {
-	//	glDepthFunc(GL_LEQUAL);
-	//	mSkyboxShader->Use();
-	//	glm::mat4 view = glm::mat4(glm::mat3(pCamera->GetViewMatrix()));
-	//	mSkyboxShader->SetMat4("view", view);
-	//	mSkyboxShader->SetMat4("proj", mProj);
-	//	mCubemap->Bind();
-	//	glBindVertexArray(mSkyVAO);
-	//	glDrawArrays(GL_TRIANGLES, 0, 36);
-	//	glBindVertexArray(0);
-	//	glDepthFunc(GL_LESS); // set depth function back to default
-	//}
-
-	// Tone-mapping pass. Tone-map and draw it all onto another FBO which will be post-processed
-	glBindFramebuffer(GL_FRAMEBUFFER, mFBO);
-	glDisable(GL_DEPTH_TEST);
-	//glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	mHDRShader->Use();
-	mHDRShader->SetInt("hdrOn", mHDROn);
-	mHDRShader->SetFloat("exposure", mExposure);
-	mQuadMesh->BindVAO();
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, mHDRTextureColorBuffer);	// use the color attachment texture as the texture of the quad plane
-	glDrawArrays(GL_TRIANGLES, 0, 6);
+void Renderer::SetupShadowSamples() {
+	ShadowSamplesBlock block = {};
 
-	
-	// ------ POST-PROCESSING PASS ------
-	
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	// Fixed PCF kernel: 20 directions around the light-to-fragment vector
+	const glm::vec3 pcfDirections[SHADOW_PCF_SAMPLES] = {
+		glm::vec3(1,  1,  1), glm::vec3( 1, -1,  1), glm::vec3(-1, -1,  1), glm::vec3(-1,  1,  1),
+		glm::vec3(1,  1, -1), glm::vec3( 1, -1, -1), glm::vec3(-1, -1, -1), glm::vec3(-1,  1, -1),
+		glm::vec3(1,  1,  0), glm::vec3( 1, -1,  0), glm::vec3(-1, -1,  0), glm::vec3(-1,  1,  0),
+		glm::vec3(1,  0,  1), glm::vec3(-1,  0,  1), glm::vec3( 1,  0, -1), glm::vec3(-1,  0, -1),
+		glm::vec3(0,  1,  1), glm::vec3( 0, -1,  1), glm::vec3( 0, -1, -1), glm::vec3( 0,  1, -1)
+	};
+	for (int i = 0; i < SHADOW_PCF_SAMPLES; i++) {
+		block.pcfOffsets[i] = glm::vec4(pcfDirections[i], 0.0f);
+	}
 
-	mScreenShader->Use();
-	mScreenShader->SetFloat("t_saturation", mImageFilters->saturation);
-	mScreenShader->SetFloat("t_blur", mImageFilters->blur);
-	mScreenShader->SetFloat("t_outline", mImageFilters->outline);
-	mScreenShader->SetInt("t_invert", mImageFilters->invert);
-	mQuadMesh->BindVAO();
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, mTextureColorBuffer);	// use the color attachment texture as the texture of the quad plane
-	glDrawArrays(GL_TRIANGLES, 0, 6);
+	// Poisson disk from best-candidate sampling. Fixed seed, so the pattern is the same every run
+	std::mt19937 rng(1337);
+	std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+	std::vector<glm::vec2> disk;
+	while (disk.size() < SHADOW_POISSON_SAMPLES) {
+		glm::vec2 best;
+		float bestDistance = -1.0f;
+		for (int candidate = 0; candidate < 30; candidate++) {
+			glm::vec2 point;
+			do {
+				point = glm::vec2(distribution(rng), distribution(rng));
+			} while (glm::dot(point, point) > 1.0f);
+
+			float closest = FLT_MAX;
+			for (const auto& other : disk) {
+				closest = std::min(closest, glm::length(point - other));
+			}
+			if (closest > bestDistance) {
+				best = point;
+				bestDistance = closest;
+			}
+		}
+		disk.push_back(best);
+	}
+	for (int i = 0; i < SHADOW_POISSON_SAMPLES; i++) {
+		block.poissonDisk[i] = glm::vec4(disk[i].x, disk[i].y, 0.0f, 0.0f);
+	}
+
+	block.sampleCounts[0] = SHADOW_PCF_SAMPLES;
+	block.sampleCounts[1] = SHADOW_POISSON_SAMPLES;
+	block.sampleCounts[2] = SHADOW_BLOCKER_SAMPLES;
+
+	glGenBuffers(1, &mShadowSamplesUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, mShadowSamplesUBO);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(ShadowSamplesBlock), &block, GL_STATIC_DRAW);
+	MemoryTracker::TrackGPU(GPUObject::BUFFER, mShadowSamplesUBO, sizeof(ShadowSamplesBlock));
+	glBindBufferBase(GL_UNIFORM_BUFFER, SHADOW_SAMPLES_BINDING, mShadowSamplesUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	// Depth comparison with bilinear filtering gives 2x2 PCF per fetch for free
+	glGenSamplers(1, &mShadowCompareSampler);
+	glSamplerParameteri(mShadowCompareSampler, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glSamplerParameteri(mShadowCompareSampler, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glSamplerParameteri(mShadowCompareSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glSamplerParameteri(mShadowCompareSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glSamplerParameteri(mShadowCompareSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(mShadowCompareSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(mShadowCompareSampler, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 }
 
+void Renderer::SetupSSAO() {
+	SSAOKernelBlock block = {};
 
-void Renderer::SetupForShadows() {
-	const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
-	
-	glGenFramebuffers(1, &mShadowDepthMapFBO);
+	// Hemisphere samples around +Z, more of them close to the center where occlusion matters most.
+	// Fixed seed, so the pattern is the same every run
+	std::mt19937 rng(1337);
+	std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+	for (int i = 0; i < SSAO_KERNEL_SIZE; i++) {
+		glm::vec3 sample(distribution(rng) * 2.0f - 1.0f, distribution(rng) * 2.0f - 1.0f, distribution(rng));
+		sample = glm::normalize(sample) * distribution(rng);
 
-	// Create depth cubemap texture
-	glGenTextures(1, &mShadowDepthCubeMap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, mShadowDepthCubeMap);
-	for (unsigned int i = 0; i < 6; ++i) {
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0,
-			GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		float scale = static_cast<float>(i) / SSAO_KERNEL_SIZE;
+		sample *= 0.1f + 0.9f * scale * scale;
+		block.kernel[i] = glm::vec4(sample, 0.0f);
 	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-	// Attach depth texture as FBO's depth buffer
-	glBindFramebuffer(GL_FRAMEBUFFER, mShadowDepthMapFBO);
-	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, mShadowDepthCubeMap, 0);
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	// Rotations around the normal, tiled over the screen
+	for (int i = 0; i < SSAO_NOISE_SIZE * SSAO_NOISE_SIZE; i++) {
+		block.noise[i] = glm::vec4(distribution(rng) * 2.0f - 1.0f, distribution(rng) * 2.0f - 1.0f, 0.0f, 0.0f);
+	}
+
+	glGenBuffers(1, &mSSAOKernelUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, mSSAOKernelUBO);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(SSAOKernelBlock), &block, GL_STATIC_DRAW);
+	MemoryTracker::TrackGPU(GPUObject::BUFFER, mSSAOKernelUBO, sizeof(SSAOKernelBlock));
+	glBindBufferBase(GL_UNIFORM_BUFFER, SSAO_KERNEL_BINDING, mSSAOKernelUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void Renderer::SetupIndirectDraw() {
+	// Same order as GetMeshID
+	mIndirectGeometry = new IndirectGeometry();
+	mIndirectGeometry->AddMesh(mSphereMesh->GetPositions(), mSphereMesh->GetTriangleIndices());
+	mIndirectGeometry->AddMesh(mCubeMesh->GetPositions(), mCubeMesh->GetTriangleIndices());
+	mIndirectGeometry->AddMesh(mQuadMesh->GetPositions(), mQuadMesh->GetTriangleIndices());
+	mIndirectGeometry->Upload();
+
+	mShadowBatch = new IndirectBatch(mIndirectGeometry, mJobSystem);
+	mPrepassBatch = new IndirectBatch(mIndirectGeometry, mJobSystem);
+
+	// Below GL 4.3 the batches cull on the CPU and draw with the regular shaders
+	if (IndirectBatch::IsGPUCullingSupported()) {
+		mIndirectCullShader = new Shader("IndirectCull.comp");
+		mIndirectShadowShader = new Shader("PointShadowDepth.vert", "PointShadowDepth.frag", "PointShadowDepth.geom", { "INDIRECT" });
+		mIndirectPrepassShader = new Shader("DepthPrepass.vert", "DepthPrepass.frag", nullptr, { "INDIRECT" });
+	}
+}
+
+IndirectBatch* Renderer::GetIndirectBatch(QueuePass pass) {
+	return pass == QueuePass::SHADOW ? mShadowBatch : mPrepassBatch;
 }
 
 void Renderer::SetupSkybox() {
 	glGenVertexArrays(1, &mSkyVAO);
 	glGenBuffers(1, &mSkyVBO);
 
-	glBindVertexArray(mSkyVAO);
+	GLState::BindVertexArray(mSkyVAO);
 
 	glBindBuffer(GL_ARRAY_BUFFER, mSkyVBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(mSkyboxVertices), mSkyboxVertices, GL_STATIC_DRAW);
+	MemoryTracker::TrackGPU(GPUObject::BUFFER, mSkyVBO, sizeof(mSkyboxVertices));
 
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
 	glEnableVertexAttribArray(0);
 
-	glBindVertexArray(0);
+	GLState::BindVertexArray(0);
 
 	mSkyboxShader->SetInt("skybox", 0);
 }
 
 void Renderer::SetupForIBL(ResourceManager* pResourceManager) {
+	// Bakes only write color, so the capture FBO has no depth attachment
 	glGenFramebuffers(1, &mCaptureFBO);
-	glGenRenderbuffers(1, &mCaptureRBO);
-
-	glBindFramebuffer(GL_FRAMEBUFFER, mCaptureFBO);
-	glBindRenderbuffer(GL_RENDERBUFFER, mCaptureRBO);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 512, 512);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mCaptureRBO);
 
-	glGenTextures(1, &mEnvCubemap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, mEnvCubemap);
-	for (int i = 0; i < 6; ++i) {
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 512, 512, 0, GL_RGB, GL_FLOAT, nullptr);
-	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glGenBuffers(1, &mIrradianceSHUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, mIrradianceSHUBO);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(SHIrradiance), nullptr, GL_DYNAMIC_DRAW);
+	MemoryTracker::TrackGPU(GPUObject::BUFFER, mIrradianceSHUBO, sizeof(SHIrradiance));
+	glBindBufferBase(GL_UNIFORM_BUFFER, IRRADIANCE_SH_BINDING, mIrradianceSHUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	// Seamless filtering across faces matters for the small, blurry mips
+	GLState::Enable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
 	mCaptureViews[0] = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f));
 	mCaptureViews[1] = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f));
@@ -471,221 +1210,229 @@ void Renderer::SetupForIBL(ResourceManager* pResourceManager) {
 	mCaptureViews[5] = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f));
 
 
-	// ------ IBL PASS: HDR TO CUBEMAP CONVERSION ------
+	// ------ IBL PASS: HDR TO CUBEMAP CONVERSION AND PRECOMPUTE ------
 
-	GenerateCubemapFromEquiRecIrrMap("Ditch_River", pResourceManager);
-	/*mHDRIBLTextureBG = pResourceManager->GetHDRImage("Ditch_River", 0);
-	mHDRIBLTextureIrrMap = pResourceManager->GetHDRImage("Ditch_River", 1);
-
-	mEquiRecToCubeMapShader->Use();
-	mEquiRecToCubeMapShader->SetInt("equirectangularMap", 0);
-	mEquiRecToCubeMapShader->SetMat4("projection", mCaptureProj);
-
-	glActiveTexture(GL_TEXTURE0);
-	mHDRIBLTextureIrrMap->Bind();
+	glGenTextures(1, &mBRDFLUT);
+	GLState::BindTexture(GL_TEXTURE_2D, mBRDFLUT);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, IBLCache::BRDF_LUT_SIZE, IBLCache::BRDF_LUT_SIZE, 0, GL_RG, GL_FLOAT, nullptr);
+	MemoryTracker::TrackGPU(GPUObject::TEXTURE, mBRDFLUT, MemoryTracker::GetTextureBytes(GL_RG16F, IBLCache::BRDF_LUT_SIZE, IBLCache::BRDF_LUT_SIZE));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	glViewport(0, 0, 512, 512);
-	glBindFramebuffer(GL_FRAMEBUFFER, mCaptureFBO);
+	if (!mIBLCache->LoadBRDFLUT(mBRDFLUT)) {
+		GenerateBRDFLUT();
+		mIBLCache->SaveBRDFLUT(mBRDFLUT);
+	}
 
-	for (unsigned int i = 0; i < 6; ++i)
-	{
-		mEquiRecToCubeMapShader->SetMat4("view", mCaptureViews[i]);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, mEnvCubemap, 0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glBindVertexArray(mSkyVAO);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+	// Nothing is on screen yet, so the first environment is uploaded in one go
+	LoadEnvironment(DEFAULT_ENVIRONMENT, pResourceManager);
+	if (mIBLCache->IsLoading(DEFAULT_ENVIRONMENT)) {
+		mIBLCache->WaitForLoad(DEFAULT_ENVIRONMENT);
+		UpdateEnvironment(SIZE_MAX);
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);*/
 }
 
-void Renderer::GenerateCubemapFromEquiRecIrrMap(std::string envMapName, ResourceManager* pResourceManager){
-	mHDRIBLTextureBG = pResourceManager->GetHDRImage(envMapName, 0);
-	mHDRIBLTextureIrrMap = pResourceManager->GetHDRImage(envMapName, 1);
+void Renderer::SetEnvironment(std::string envMapName, ResourceManager* pResourceManager) {
+	mRequestedEnvironment = envMapName;
+	mRequestedEnvironmentSource = pResourceManager;
+}
 
-	mEquiRecToCubeMapShader->Use();
-	mEquiRecToCubeMapShader->SetInt("equirectangularMap", 0);
-	mEquiRecToCubeMapShader->SetMat4("projection", mCaptureProj);
+void Renderer::LoadEnvironment(std::string envMapName, ResourceManager* pResourceManager) {
+	mPendingEnvironment = "";
 
-	glActiveTexture(GL_TEXTURE0);
-	mHDRIBLTextureIrrMap->Bind();
+	// Resident: just swap
+	if (IBLEnvironment* environment = mIBLCache->Find(envMapName)) {
+		ActivateEnvironment(environment);
+		return;
+	}
 
-	glViewport(0, 0, 512, 512);
-	glBindFramebuffer(GL_FRAMEBUFFER, mCaptureFBO);
+	// Baked in an earlier run: stream it in, keep rendering with the current one meanwhile
+	if (mIBLCache->RequestLoad(envMapName, pResourceManager->GetHDRImagePath(envMapName))) {
+		mPendingEnvironment = envMapName;
+		mPendingEnvironmentSource = pResourceManager;
+		return;
+	}
 
-	for (unsigned int i = 0; i < 6; ++i)
-	{
-		mEquiRecToCubeMapShader->SetMat4("view", mCaptureViews[i]);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, mEnvCubemap, 0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glBindVertexArray(mSkyVAO);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+	// First time this environment is used. Bake once and persist
+	if (IBLEnvironment* environment = BakeEnvironment(envMapName, pResourceManager)) {
+		ActivateEnvironment(environment);
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+const std::string& Renderer::GetPendingEnvironment() {
+	return mPendingEnvironment;
+}
 
-void Renderer::SetupForDeferredShading(int SCREEN_WIDTH, int SCREEN_HEIGHT) {
-
-	glGenFramebuffers(1, &mGBuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, mGBuffer);
-
-	// Position G-Buffer
-	glGenTextures(1, &mGBufferTextures[0]);
-	glBindTexture(GL_TEXTURE_2D, mGBufferTextures[0]);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCREEN_WIDTH, SCREEN_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mGBufferTextures[0], 0);
-
-	// Normal G-buffer
-	glGenTextures(1, &mGBufferTextures[1]);
-	glBindTexture(GL_TEXTURE_2D, mGBufferTextures[1]);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCREEN_WIDTH, SCREEN_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, mGBufferTextures[1], 0);
-
-	// Diffuse color or Albedo G-Buffer
-	glGenTextures(1, &mGBufferTextures[2]);
-	glBindTexture(GL_TEXTURE_2D, mGBufferTextures[2]);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SCREEN_WIDTH, SCREEN_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, mGBufferTextures[2], 0);
-
-	// Roughness, metalness and ambient occlusion values buffer
-	glGenTextures(1, &mGBufferTextures[3]);
-	glBindTexture(GL_TEXTURE_2D, mGBufferTextures[3]);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SCREEN_WIDTH, SCREEN_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, mGBufferTextures[3], 0);
-
-	// Tell OpenGL which color attachments well use (of this framebuffer)
-	mAttachments[0] = GL_COLOR_ATTACHMENT0;
-	mAttachments[1] = GL_COLOR_ATTACHMENT1;
-	mAttachments[2] = GL_COLOR_ATTACHMENT2;
-	mAttachments[3] = GL_COLOR_ATTACHMENT3;
-	glDrawBuffers(4, mAttachments);
+IBLCache* Renderer::GetIBLCache() {
+	return mIBLCache;
+}
 
-	glGenRenderbuffers(1, &mGRBODepth);
-	glBindRenderbuffer(GL_RENDERBUFFER, mGRBODepth);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCREEN_WIDTH, SCREEN_HEIGHT);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, mGRBODepth);
+void Renderer::UpdateEnvironment(size_t uploadBudgetBytes) {
+	std::vector<std::string> failedLoads;
+	IBLEnvironment* loaded = mIBLCache->Update(failedLoads, uploadBudgetBytes);
+	if (loaded && loaded->name == mPendingEnvironment) {
+		mPendingEnvironment = "";
+		ActivateEnvironment(loaded);
+	}
 
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-		std::cout << "Framebuffer ain't complete!" << std::endl;
+	// The cache file turned out to be unreadable. Bake it like a cache miss in LoadEnvironment
+	for (const std::string& name : failedLoads) {
+		if (name != mPendingEnvironment) {
+			continue;
+		}
+		mPendingEnvironment = "";
+		if (IBLEnvironment* environment = BakeEnvironment(name, mPendingEnvironmentSource)) {
+			ActivateEnvironment(environment);
+		}
 	}
+}
+
+void Renderer::ActivateEnvironment(IBLEnvironment* environment) {
+	mEnvironment = environment;
+	mIBLCache->SetActive(environment);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	// Diffuse irradiance is already projected, it only needs uploading
+	glBindBuffer(GL_UNIFORM_BUFFER, mIrradianceSHUBO);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(SHIrradiance), &environment->irradianceSH);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 
-void Renderer::SetupFBO(const int SCREEN_WIDTH, const int SCREEN_HEIGHT) {
-	glGenFramebuffers(1, &mFBO);
-	glBindFramebuffer(GL_FRAMEBUFFER, mFBO);
+IBLEnvironment* Renderer::BakeEnvironment(std::string envMapName, ResourceManager* pResourceManager){
+	TextureHDR* hdrTexture = pResourceManager->GetHDRImage(envMapName);
+	if (!hdrTexture) {
+		std::cout << "No HDR image for environment " << envMapName << '\n';
+		return nullptr;
+	}
 
-	glGenTextures(1, &mTextureColorBuffer);
-	glBindTexture(GL_TEXTURE_2D, mTextureColorBuffer);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, SCREEN_WIDTH, SCREEN_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	IBLEnvironment* environment = mIBLCache->CreateEnvironment(envMapName);
+	environment->irradianceSH = hdrTexture->GetIrradianceSH();
 
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTextureColorBuffer, 0);
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
 
-	glGenRenderbuffers(1, &mRBO);
-	glBindRenderbuffer(GL_RENDERBUFFER, mRBO);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCREEN_WIDTH, SCREEN_HEIGHT);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, mRBO);
+	GLState::Disable(GL_DEPTH_TEST);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, mCaptureFBO);
+	GLState::BindVertexArray(mSkyVAO);
+	GLState::ActiveTexture(GL_TEXTURE0);
 
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-		std::cout << "Framebuffer ain't complete!" << std::endl;
+	// Equirectangular HDR to environment cubemap. Its mips are read by the prefilter pass
+	mEquiRecToCubeMapShader->Use();
+	mEquiRecToCubeMapShader->SetInt("equirectangularMap", 0);
+	mEquiRecToCubeMapShader->SetMat4("projection", mCaptureProj);
+	hdrTexture->Bind();
+	RenderToCubemap(mEquiRecToCubeMapShader, environment->envCubemap, IBLCache::ENV_CUBEMAP_SIZE, 0);
+
+	GLState::BindTexture(GL_TEXTURE_CUBE_MAP, environment->envCubemap);
+	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+
+	// GGX-prefiltered specular, one roughness level per mip
+	mPrefilterShader->Use();
+	mPrefilterShader->SetInt("environmentMap", 0);
+	mPrefilterShader->SetMat4("projection", mCaptureProj);
+	mPrefilterShader->SetFloat("resolution", static_cast<float>(IBLCache::ENV_CUBEMAP_SIZE));
+	for (int mip = 0; mip < IBLCache::PREFILTER_MIP_LEVELS; ++mip) {
+		mPrefilterShader->SetFloat("roughness", static_cast<float>(mip) / static_cast<float>(IBLCache::PREFILTER_MIP_LEVELS - 1));
+		RenderToCubemap(mPrefilterShader, environment->prefilterMap, IBLCache::PREFILTER_MAP_SIZE >> mip, mip);
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::Viewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	GLState::Enable(GL_DEPTH_TEST);
 
-void Renderer::SetupForHDR(const int SCREEN_WIDTH, const int SCREEN_HEIGHT) {
+	mIBLCache->Insert(environment);
+	mIBLCache->Save(*environment);
+	return environment;
+}
 
-	glGenFramebuffers(1, &mHDRFBO);
-	glBindFramebuffer(GL_FRAMEBUFFER, mHDRFBO);
+void Renderer::GenerateBRDFLUT() {
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
 
-	glGenTextures(1, &mHDRTextureColorBuffer);
-	glBindTexture(GL_TEXTURE_2D, mHDRTextureColorBuffer);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCREEN_WIDTH, SCREEN_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	GLState::Disable(GL_DEPTH_TEST);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, mCaptureFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mBRDFLUT, 0);
+	GLState::Viewport(0, 0, IBLCache::BRDF_LUT_SIZE, IBLCache::BRDF_LUT_SIZE);
+	glClear(GL_COLOR_BUFFER_BIT);
 
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mHDRTextureColorBuffer, 0);
+	mBRDFShader->Use();
+	mQuadMesh->BindVAO();
+	glDrawArrays(GL_TRIANGLES, 0, 6);
 
-	glGenRenderbuffers(1, &mHDRRBO);
-	glBindRenderbuffer(GL_RENDERBUFFER, mHDRRBO);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCREEN_WIDTH, SCREEN_HEIGHT);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, mHDRRBO);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::Viewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	GLState::Enable(GL_DEPTH_TEST);
+}
 
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-		std::cout << "HDR Framebuffer ain't complete!" << std::endl;
+void Renderer::RenderToCubemap(Shader* shader, GLuint cubemap, int size, int mipLevel) {
+	GLState::Viewport(0, 0, size, size);
+	for (unsigned int i = 0; i < 6; ++i)
+	{
+		shader->SetMat4("view", mCaptureViews[i]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, cubemap, mipLevel);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glDrawArrays(GL_TRIANGLES, 0, 36);
 	}
+}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+void Renderer::BindIBLMaps() {
+	GLState::ActiveTexture(GL_TEXTURE7);
+	GLState::BindTexture(GL_TEXTURE_CUBE_MAP, mEnvironment->prefilterMap);
+	GLState::ActiveTexture(GL_TEXTURE8);
+	GLState::BindTexture(GL_TEXTURE_2D, mBRDFLUT);
 }
 
 void Renderer::SetLightVarsInShader(Shader* shader) {
+	// Names go through a stack buffer, this runs for every lit program every frame
+	char uniform[64];
 	int i = 0;
-	for (auto& [name, cube] : mShapeDS) {
-		if (cube->mShading == ShapeShading::LIGHT) {
-			shader->SetVec3("lights[" + std::to_string(i) + "].position", cube->mTransform->position);
-			shader->SetVec3("lights[" + std::to_string(i) + "].color", cube->mMaterial->ambient);
-			i++;
-		}
+	for (const FrameSnapshot::Light& light : mFrame->lights) {
+		snprintf(uniform, sizeof(uniform), "lights[%d].position", i);
+		shader->SetVec3(uniform, light.position);
+		snprintf(uniform, sizeof(uniform), "lights[%d].color", i);
+		shader->SetVec3(uniform, light.color);
+		i++;
 	}
 	shader->SetInt("numberOfLights", i);
 }
 
-void Renderer::SetVertexShaderVarsForDeferredShadingAndUse(Shape* pShape, Camera* pCamera, AudioPlayer* pAudioPlayer) {
-
-	glm::mat4 model = CreateModelMatrix(pShape, pAudioPlayer);
-	mGBufferShaderPBR->Use();
-	mGBufferShaderPBR->SetMat4("model", model);
-	mGBufferShaderPBR->SetMat4("view", pCamera->GetViewMatrix());
-	mGBufferShaderPBR->SetMat4("proj", mProj);
-	mGBufferShaderPBR->SetInt("packEnabled", pShape->mMaterialPBR->texturePackEnabled);
-
-	if (pShape->mMaterialPBR->texturePackEnabled) {
-		glActiveTexture(GL_TEXTURE0);
-		if (pShape->mMaterialPBR->texturePack->albedoMap) {
-			pShape->mMaterialPBR->texturePack->albedoMap->Bind();
-		}
-
-		glActiveTexture(GL_TEXTURE1);
-		if (pShape->mMaterialPBR->texturePack->normalMap) {
-			pShape->mMaterialPBR->texturePack->normalMap->Bind();
-		}
-
-		glActiveTexture(GL_TEXTURE2);
-		if (pShape->mMaterialPBR->texturePack->roughnessMap) {
-			pShape->mMaterialPBR->texturePack->roughnessMap->Bind();
-		}
+void Renderer::SetProgramVars(Shader* shader) {
+	shader->SetMat4("view", mFrame->view);
+	shader->SetMat4("proj", mProj);
 
-		glActiveTexture(GL_TEXTURE3);
-		if (pShape->mMaterialPBR->texturePack->metallicMap) {
-			pShape->mMaterialPBR->texturePack->metallicMap->Bind();
-			mGBufferShaderPBR->SetInt("metallicMapOn", true);
-		}
-		else {
-			mGBufferShaderPBR->SetInt("metallicMapOn", false);
+	if (shader == mGBufferShaderPBR) {
+		shader->SetVec3("viewPos", mFrame->cameraPosition);
+	}
+	else if (shader == mShapeShaders[static_cast<int>(ShapeShading::GLOWY)]) {
+		shader->SetFloat("time", static_cast<float>(glfwGetTime()));
+	}
+	else if (shader == mShapeShaders[static_cast<int>(ShapeShading::PHONG)]) {
+		SetLightVarsInShader(shader);
+		shader->SetVec3("viewPos", mFrame->cameraPosition);
+	}
+	else if (shader == mShapeShaders[static_cast<int>(ShapeShading::PBR)]) {
+		shader->SetVec3("viewPos", mFrame->cameraPosition);
+		SetLightVarsInShader(shader);
+		shader->SetInt("iblOn", mSkyboxOn && mEnvironment);
+		if (mSkyboxOn && mEnvironment) {
+			BindIBLMaps();
 		}
+	}
+}
 
-		glActiveTexture(GL_TEXTURE4);
-		if (pShape->mMaterialPBR->texturePack->depthMap) {
-			pShape->mMaterialPBR->texturePack->depthMap->Bind();
-			mGBufferShaderPBR->SetVec3("viewPos", pCamera->mPosition);
-		}
+void Renderer::SetVertexShaderVarsForDeferredShadingAndUse(Shape* pShape) {
 
-		glActiveTexture(GL_TEXTURE5);
-		if (pShape->mMaterialPBR->texturePack->aoMap) {
-			pShape->mMaterialPBR->texturePack->aoMap->Bind();
-		}
+	if (UseProgram(mGBufferShaderPBR)) {
+		SetProgramVars(mGBufferShaderPBR);
+	}
+	mGBufferShaderPBR->SetMat4("model", mFrame->transforms.GetWorld(pShape->mTransformHandle));
+	mGBufferShaderPBR->SetMat4("prevModel", mFrame->transforms.GetPrevWorld(pShape->mTransformHandle));
+	mGBufferShaderPBR->SetInt("packEnabled", pShape->mMaterialPBR->texturePackEnabled);
 
+	if (pShape->mMaterialPBR->texturePackEnabled) {
+		BindTexturePack(pShape->mMaterialPBR->texturePack);
+		mGBufferShaderPBR->SetInt("metallicMapOn", pShape->mMaterialPBR->texturePack->metallicMap != nullptr);
 		mGBufferShaderPBR->SetFloat("heightScale", 0.1f);
 	}
 	else {
@@ -696,128 +1443,624 @@ void Renderer::SetVertexShaderVarsForDeferredShadingAndUse(Shape* pShape, Camera
 	}
 }
 
-void Renderer::SetShaderVarsAndUse(Shape* pShape, Camera* pCamera, AudioPlayer* pAudioPlayer) {
+void Renderer::SetShaderVarsAndUse(Shape* pShape) {
 
-	glm::mat4 model = CreateModelMatrix(pShape, pAudioPlayer);
 	Shader* shader = mShapeShaders[static_cast<int>(pShape->mShading)];
 
-	shader->Use();
-	shader->SetMat4("model", model);
-	shader->SetMat4("view", pCamera->GetViewMatrix());
-	shader->SetMat4("proj", mProj);
-
-	if (pShape->mShading == ShapeShading::GLOWY) {
-		shader->SetFloat("time", static_cast<float>(glfwGetTime()));
+	// Camera, lights and IBL are the same for every shape, only set up when the program changes
+	if (UseProgram(shader)) {
+		SetProgramVars(shader);
 	}
-	else if (pShape->mShading == ShapeShading::PHONG) {
-		SetLightVarsInShader(shader);
-		shader->SetVec3("material.ambient", pShape->mMaterial->ambient + glm::vec3(static_cast<float>(pAudioPlayer->GetData()) / 70000));
+
+	shader->SetMat4("model", mFrame->transforms.GetWorld(pShape->mTransformHandle));
+	shader->SetMat4("prevModel", mFrame->transforms.GetPrevWorld(pShape->mTransformHandle));
+
+	if (pShape->mShading == ShapeShading::PHONG) {
+		shader->SetVec3("material.ambient", pShape->mMaterial->ambient + glm::vec3(static_cast<float>(mFrame->audioSample) / 70000));
 		shader->SetVec3("material.diffuse", pShape->mMaterial->diffuse);
 		shader->SetVec3("material.specular", pShape->mMaterial->specular);
 		shader->SetFloat("material.shininess", pShape->mMaterial->shininess);
-		shader->SetVec3("viewPos", pCamera->mPosition);
 	}
 	else if (pShape->mShading == ShapeShading::PBR) {
-		shader->SetVec3("viewPos", pCamera->mPosition);
-		SetLightVarsInShader(shader);
 		shader->SetInt("packEnabled", pShape->mMaterialPBR->texturePackEnabled);
 		if (pShape->mMaterialPBR->texturePackEnabled) {
-			glActiveTexture(GL_TEXTURE0);
-			if (pShape->mMaterialPBR->texturePack->albedoMap) {
-				pShape->mMaterialPBR->texturePack->albedoMap->Bind();
+			BindTexturePack(pShape->mMaterialPBR->texturePack);
+			shader->SetInt("metallicMapOn", pShape->mMaterialPBR->texturePack->metallicMap != nullptr);
+			shader->SetFloat("heightScale", 0.1f);
+		}
+		else {
+			shader->SetVec3("albedoUnif", pShape->mMaterialPBR->albedo);
+			shader->SetFloat("roughnessUnif", pShape->mMaterialPBR->roughness);
+			shader->SetFloat("metalnessUnif", pShape->mMaterialPBR->metalness);
+			shader->SetFloat("aoUnif", pShape->mMaterialPBR->ao);
+		}
+	}
+	else if (pShape->mShading == ShapeShading::LIGHT) {
+		glm::vec3 newVal = pShape->mMaterial->ambient - glm::vec3(0, mFrame->audioSample / 1000.0f, 0);
+		shader->SetVec3("lightColor", newVal);
+	}
+}
+
+void Renderer::BuildRenderQueue() {
+	// A shape makes at most two items. Each writes its own slots, the unused ones sort after every pass
+	size_t count = mFrame->shapes.size();
+	mRenderQueue->Resize(count * 2);
+	mShapeDrawInfos.resize(count);
+
+	glm::mat4 view = mFrame->view;
+	mJobSystem->ParallelFor(count, SHAPES_PER_JOB, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			Shape* shape = mFrame->shapes[i];
+
+			// View depth of the shape's origin, normalized between the clip planes. View space looks down -Z
+			const glm::mat4& model = mFrame->transforms.GetWorld(shape->mTransformHandle);
+			float viewDepth = -(view * model[3]).z;
+			float depth = (viewDepth - CAMERA_NEAR_PLANE) / (CAMERA_FAR_PLANE - CAMERA_NEAR_PLANE);
+			unsigned int program = static_cast<unsigned int>(shape->mShading);
+			unsigned int material = GetMaterialID(shape);
+			unsigned int mesh = GetMeshID(shape->mShape);
+
+			ShapeDrawInfo& info = mShapeDrawInfos[i];
+			info = { mesh, material, -1, -1 };
+
+			if (mDeferredShadingOn) {
+				if (shape->mShading == ShapeShading::LIGHT) {
+					mRenderQueue->Set(i * 2, RenderQueue::MakeStateKey(QueuePass::LIGHT_SOURCES, program, material, mesh, depth), shape);
+				}
+				else if (mGPUDrivenOn) {
+					info.shadowSlot = 0;
+				}
+				else {
+					// One program and no textures for shadow casters, only the mesh changes
+					mRenderQueue->Set(i * 2, RenderQueue::MakeStateKey(QueuePass::SHADOW, 0, 0, mesh, depth), shape);
+				}
+
+				if (shape->mShading == ShapeShading::PBR) {
+					mRenderQueue->Set(i * 2 + 1, RenderQueue::MakeStateKey(QueuePass::GBUFFER, 0, material, mesh, depth), shape);
+				}
+			}
+			else if (mDepthPrepassOn) {
+				// Depth goes in front to back. After it every pixel is shaded once whatever the order, so state goes first
+				if (mGPUDrivenOn) {
+					info.prepassSlot = 0;
+				}
+				else {
+					mRenderQueue->Set(i * 2, RenderQueue::MakeDepthKey(QueuePass::DEPTH_PREPASS, depth), shape);
+				}
+				mRenderQueue->Set(i * 2 + 1, RenderQueue::MakeStateKey(QueuePass::FORWARD, program, material, mesh, depth), shape);
 			}
+			else {
+				// Nearest first, so the depth test rejects as much hidden shading as possible
+				mRenderQueue->Set(i * 2, RenderQueue::MakeDepthKey(QueuePass::FORWARD, depth), shape);
+			}
+		}
+	});
 
-			glActiveTexture(GL_TEXTURE1);
-			if (pShape->mMaterialPBR->texturePack->normalMap) {
-				pShape->mMaterialPBR->texturePack->normalMap->Bind();
+	// Batch objects are packed, so their indices come from a running count over the shapes
+	int shadowCount = 0, prepassCount = 0;
+	for (ShapeDrawInfo& info : mShapeDrawInfos) {
+		if (info.shadowSlot == 0) {
+			info.shadowSlot = shadowCount++;
+		}
+		if (info.prepassSlot == 0) {
+			info.prepassSlot = prepassCount++;
+		}
+	}
+	mShadowBatch->Resize(shadowCount);
+	mPrepassBatch->Resize(prepassCount);
+
+	if (shadowCount > 0 || prepassCount > 0) {
+		mJobSystem->ParallelFor(count, SHAPES_PER_JOB, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				const ShapeDrawInfo& info = mShapeDrawInfos[i];
+				const glm::mat4& model = mFrame->transforms.GetWorld(mFrame->shapes[i]->mTransformHandle);
+				if (info.shadowSlot >= 0) {
+					mShadowBatch->Set(info.shadowSlot, info.mesh, model, info.material);
+				}
+				if (info.prepassSlot >= 0) {
+					mPrepassBatch->Set(info.prepassSlot, info.mesh, model, info.material);
+				}
 			}
+		});
+	}
+
+	mRenderQueue->Sort();
+}
+
+void Renderer::SetupCommandBuffers() {
+	auto lookUp = [](Shader* shader, const std::string& materialSuffix) {
+		ObjectUniforms uniforms;
+		uniforms.model = shader->GetUniformLocation("model");
+		uniforms.prevModel = shader->GetUniformLocation("prevModel");
+		uniforms.ambient = shader->GetUniformLocation("material.ambient");
+		uniforms.diffuse = shader->GetUniformLocation("material.diffuse");
+		uniforms.specular = shader->GetUniformLocation("material.specular");
+		uniforms.shininess = shader->GetUniformLocation("material.shininess");
+		uniforms.packEnabled = shader->GetUniformLocation("packEnabled");
+		uniforms.metallicMapOn = shader->GetUniformLocation("metallicMapOn");
+		uniforms.heightScale = shader->GetUniformLocation("heightScale");
+		uniforms.albedo = shader->GetUniformLocation("albedo" + materialSuffix);
+		uniforms.roughness = shader->GetUniformLocation("roughness" + materialSuffix);
+		uniforms.metalness = shader->GetUniformLocation("metalness" + materialSuffix);
+		uniforms.ao = shader->GetUniformLocation("ao" + materialSuffix);
+		uniforms.lightColor = shader->GetUniformLocation("lightColor");
+		return uniforms;
+	};
+
+	// The forward PBR shader names its material uniforms apart from the texture maps
+	for (int i = 0; i < static_cast<int>(ShapeShading::NUM); i++) {
+		mShapeUniforms[i] = lookUp(mShapeShaders[i], "Unif");
+	}
+	mGBufferUniforms = lookUp(mGBufferShaderPBR, "");
+	mShadowUniforms = lookUp(mPointShadowDepthShader, "");
+	mPrepassUniforms = lookUp(mDepthPrepassShader, "");
+}
 
-			glActiveTexture(GL_TEXTURE2);
-			if (pShape->mMaterialPBR->texturePack->roughnessMap) {
-				pShape->mMaterialPBR->texturePack->roughnessMap->Bind();
+void Renderer::RecordCommandBuffers() {
+	// Chunks of every pass go into one parallel-for, each into its own buffer.
+	// Replaying a pass's buffers in order gives back the queue order
+	mRecordChunks.clear();
+	for (int p = 0; p < static_cast<int>(QueuePass::NUM); p++) {
+		QueuePass pass = static_cast<QueuePass>(p);
+		RenderQueue::Range items = mRenderQueue->GetPass(pass);
+		size_t count = items.end() - items.begin();
+		size_t chunks = (count + ITEMS_PER_COMMAND_BUFFER - 1) / ITEMS_PER_COMMAND_BUFFER;
+
+		std::vector<CommandBuffer>& buffers = mCommandBuffers[p];
+		if (buffers.size() < chunks) {
+			buffers.resize(chunks);
+		}
+		mCommandBufferCounts[p] = chunks;
+
+		for (size_t c = 0; c < chunks; c++) {
+			const RenderItem* first = items.begin() + c * ITEMS_PER_COMMAND_BUFFER;
+			const RenderItem* last = std::min(first + ITEMS_PER_COMMAND_BUFFER, items.end());
+			mRecordChunks.push_back({ pass, first, last, &buffers[c] });
+		}
+	}
+
+	mJobSystem->ParallelFor(mRecordChunks.size(), 1, [this](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			const RecordChunk& chunk = mRecordChunks[i];
+			chunk.buffer->Clear();
+			RecordQueuePass(*chunk.buffer, chunk.pass, chunk.first, chunk.last);
+		}
+	});
+}
+
+void Renderer::RecordQueuePass(CommandBuffer& buffer, QueuePass pass, const RenderItem* first, const RenderItem* last) const {
+	switch (pass) {
+	case QueuePass::SHADOW:
+	case QueuePass::DEPTH_PREPASS: {
+		// The pass binds the depth-only program and sets its uniforms, only the model changes
+		const ObjectUniforms& uniforms = pass == QueuePass::SHADOW ? mShadowUniforms : mPrepassUniforms;
+		for (const RenderItem* item = first; item != last; item++) {
+			buffer.SetMat4(uniforms.model, mFrame->transforms.GetWorld(item->shape->mTransformHandle));
+			buffer.Draw(GetMeshID(item->shape->mShape));
+		}
+		break;
+	}
+	case QueuePass::GBUFFER:
+		buffer.BindProgram(mGBufferShaderPBR);
+		for (const RenderItem* item = first; item != last; item++) {
+			RecordGBufferVars(buffer, item->shape);
+			buffer.Draw(GetMeshID(item->shape->mShape));
+		}
+		break;
+	case QueuePass::FORWARD:
+	case QueuePass::LIGHT_SOURCES: {
+		// Each chunk binds its first program itself, replaying skips it if the last chunk left it bound
+		int shading = -1;
+		for (const RenderItem* item = first; item != last; item++) {
+			Shape* shape = item->shape;
+			if (static_cast<int>(shape->mShading) != shading) {
+				shading = static_cast<int>(shape->mShading);
+				buffer.BindProgram(mShapeShaders[shading]);
 			}
+			RecordShapeVars(buffer, shape);
 
-			glActiveTexture(GL_TEXTURE3);
-			if (pShape->mMaterialPBR->texturePack->metallicMap) {
-				pShape->mMaterialPBR->texturePack->metallicMap->Bind();
-				shader->SetInt("metallicMapOn", true);
+			// Selected shapes mark the stencil buffer for their outline
+			if (pass == QueuePass::FORWARD && shape->mIsSelected) {
+				buffer.SetStencil(GL_ALWAYS, 1, 0xFF, 0xFF);
+				buffer.Draw(GetMeshID(shape->mShape));
+				buffer.SetStencil(GL_NOTEQUAL, 1, 0xFF, 0x00);
 			}
 			else {
-				shader->SetInt("metallicMapOn", false);
+				buffer.Draw(GetMeshID(shape->mShape));
 			}
+		}
+		break;
+	}
+	default:
+		break;
+	}
+}
 
-			glActiveTexture(GL_TEXTURE4);
-			if (pShape->mMaterialPBR->texturePack->depthMap) {
-				pShape->mMaterialPBR->texturePack->depthMap->Bind();
-			}
+void Renderer::RecordShapeVars(CommandBuffer& buffer, Shape* pShape) const {
+	// Same uniforms as SetShaderVarsAndUse
+	const ObjectUniforms& uniforms = mShapeUniforms[static_cast<int>(pShape->mShading)];
+	buffer.SetMat4(uniforms.model, mFrame->transforms.GetWorld(pShape->mTransformHandle));
+	buffer.SetMat4(uniforms.prevModel, mFrame->transforms.GetPrevWorld(pShape->mTransformHandle));
+
+	if (pShape->mShading == ShapeShading::PHONG) {
+		buffer.SetVec3(uniforms.ambient, pShape->mMaterial->ambient + glm::vec3(static_cast<float>(mFrame->audioSample) / 70000));
+		buffer.SetVec3(uniforms.diffuse, pShape->mMaterial->diffuse);
+		buffer.SetVec3(uniforms.specular, pShape->mMaterial->specular);
+		buffer.SetFloat(uniforms.shininess, pShape->mMaterial->shininess);
+	}
+	else if (pShape->mShading == ShapeShading::PBR) {
+		buffer.SetInt(uniforms.packEnabled, pShape->mMaterialPBR->texturePackEnabled);
+		if (pShape->mMaterialPBR->texturePackEnabled) {
+			buffer.BindTextures(pShape->mMaterialPBR->texturePack);
+			buffer.SetInt(uniforms.metallicMapOn, pShape->mMaterialPBR->texturePack->metallicMap != nullptr);
+			buffer.SetFloat(uniforms.heightScale, 0.1f);
+		}
+		else {
+			buffer.SetVec3(uniforms.albedo, pShape->mMaterialPBR->albedo);
+			buffer.SetFloat(uniforms.roughness, pShape->mMaterialPBR->roughness);
+			buffer.SetFloat(uniforms.metalness, pShape->mMaterialPBR->metalness);
+			buffer.SetFloat(uniforms.ao, pShape->mMaterialPBR->ao);
+		}
+	}
+	else if (pShape->mShading == ShapeShading::LIGHT) {
+		glm::vec3 newVal = pShape->mMaterial->ambient - glm::vec3(0, mFrame->audioSample / 1000.0f, 0);
+		buffer.SetVec3(uniforms.lightColor, newVal);
+	}
+}
+
+void Renderer::RecordGBufferVars(CommandBuffer& buffer, Shape* pShape) const {
+	// Same uniforms as SetVertexShaderVarsForDeferredShadingAndUse
+	const ObjectUniforms& uniforms = mGBufferUniforms;
+	buffer.SetMat4(uniforms.model, mFrame->transforms.GetWorld(pShape->mTransformHandle));
+	buffer.SetMat4(uniforms.prevModel, mFrame->transforms.GetPrevWorld(pShape->mTransformHandle));
+	buffer.SetInt(uniforms.packEnabled, pShape->mMaterialPBR->texturePackEnabled);
+
+	if (pShape->mMaterialPBR->texturePackEnabled) {
+		buffer.BindTextures(pShape->mMaterialPBR->texturePack);
+		buffer.SetInt(uniforms.metallicMapOn, pShape->mMaterialPBR->texturePack->metallicMap != nullptr);
+		buffer.SetFloat(uniforms.heightScale, 0.1f);
+	}
+	else {
+		buffer.SetVec3(uniforms.albedo, pShape->mMaterialPBR->albedo);
+		buffer.SetFloat(uniforms.roughness, pShape->mMaterialPBR->roughness);
+		buffer.SetFloat(uniforms.metalness, pShape->mMaterialPBR->metalness);
+		buffer.SetFloat(uniforms.ao, pShape->mMaterialPBR->ao);
+	}
+}
 
-			glActiveTexture(GL_TEXTURE5);
-			if (pShape->mMaterialPBR->texturePack->aoMap) {
-				pShape->mMaterialPBR->texturePack->aoMap->Bind();
+void Renderer::ExecuteCommands(QueuePass pass, Shader* program) {
+	const int p = static_cast<int>(pass);
+	Shader* shader = program;
+
+	for (size_t i = 0; i < mCommandBufferCounts[p]; i++) {
+		const CommandBuffer& buffer = mCommandBuffers[p][i];
+		mSubmitStats.commands += buffer.GetCount();
+		mSubmitStats.commandBytes += buffer.GetSize();
+
+		const unsigned char* command = buffer.begin();
+		while (command != buffer.end()) {
+			const CommandHeader& header = *reinterpret_cast<const CommandHeader*>(command);
+			switch (header.type) {
+			case CommandType::BIND_PROGRAM:
+				shader = reinterpret_cast<const BindProgramCommand*>(command)->shader;
+				if (UseProgram(shader)) {
+					SetProgramVars(shader);
+				}
+				break;
+			case CommandType::SET_MAT4: {
+				const SetMat4Command* setMat4 = reinterpret_cast<const SetMat4Command*>(command);
+				shader->SetMat4(setMat4->location, setMat4->value);
+				break;
 			}
-			
-			shader->SetFloat("heightScale", 0.1f);
+			case CommandType::SET_VEC3: {
+				const SetVec3Command* setVec3 = reinterpret_cast<const SetVec3Command*>(command);
+				shader->SetVec3(setVec3->location, setVec3->value);
+				break;
+			}
+			case CommandType::SET_FLOAT: {
+				const SetFloatCommand* setFloat = reinterpret_cast<const SetFloatCommand*>(command);
+				shader->SetFloat(setFloat->location, setFloat->value);
+				break;
+			}
+			case CommandType::SET_INT: {
+				const SetIntCommand* setInt = reinterpret_cast<const SetIntCommand*>(command);
+				shader->SetInt(setInt->location, setInt->value);
+				break;
+			}
+			case CommandType::BIND_TEXTURES:
+				BindTexturePack(reinterpret_cast<const BindTexturesCommand*>(command)->texturePack);
+				break;
+			case CommandType::SET_STENCIL: {
+				const SetStencilCommand* setStencil = reinterpret_cast<const SetStencilCommand*>(command);
+				GLState::StencilFunc(setStencil->func, setStencil->ref, setStencil->mask);
+				GLState::StencilMask(setStencil->writeMask);
+				break;
+			}
+			case CommandType::DRAW:
+				DrawMesh(reinterpret_cast<const DrawCommand*>(command)->mesh);
+				break;
+			default:
+				break;
+			}
+			command += header.size;
 		}
-		else {
-			shader->SetVec3("albedoUnif", pShape->mMaterialPBR->albedo);
-			shader->SetFloat("roughnessUnif", pShape->mMaterialPBR->roughness);
-			shader->SetFloat("metalnessUnif", pShape->mMaterialPBR->metalness);
-			shader->SetFloat("aoUnif", pShape->mMaterialPBR->ao);
+	}
+}
+
+void Renderer::SubmitDirect(QueuePass pass, Shader* program) {
+	for (const RenderItem& item : mRenderQueue->GetPass(pass)) {
+		Shape* shape = item.shape;
+		switch (pass) {
+		case QueuePass::SHADOW:
+		case QueuePass::DEPTH_PREPASS:
+			program->SetMat4("model", mFrame->transforms.GetWorld(shape->mTransformHandle));
+			break;
+		case QueuePass::GBUFFER:
+			SetVertexShaderVarsForDeferredShadingAndUse(shape);
+			break;
+		default:
+			SetShaderVarsAndUse(shape);
+			break;
 		}
-		shader->SetInt("iblOn", mSkyboxOn);
-		if (mSkyboxOn) {
-			glActiveTexture(GL_TEXTURE6);
-			glBindTexture(GL_TEXTURE_CUBE_MAP, mEnvCubemap);
+
+		// if shape is selected - edit stencil buffer (for outlining)
+		if (pass == QueuePass::FORWARD && shape->mIsSelected) {
+
+			GLState::StencilFunc(GL_ALWAYS, 1, 0xFF);
+			GLState::StencilMask(0xFF);
+
+			SetShapeAndDraw(shape);
+
+			GLState::StencilFunc(GL_NOTEQUAL, 1, 0xFF);
+			GLState::StencilMask(0x00);
 		}
 		else {
-			glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+			SetShapeAndDraw(shape);
 		}
 	}
-	else if (pShape->mShading == ShapeShading::LIGHT) {
-		glm::vec3 newVal = pShape->mMaterial->ambient - glm::vec3(0, pAudioPlayer->GetData() / 1000.0f, 0);
-		shader->SetVec3("lightColor", newVal);
+}
+
+void Renderer::SubmitQueuePass(QueuePass pass, Shader* program) {
+	if (mCommandBuffersOn) {
+		ExecuteCommands(pass, program);
+	}
+	else {
+		SubmitDirect(pass, program);
+	}
+}
+
+Shader* Renderer::GetQueuePassProgram(QueuePass pass) {
+	// Passes that draw with one program bound beforehand, the others bind the shapes' programs
+	if (pass == QueuePass::SHADOW) {
+		return mPointShadowDepthShader;
+	}
+	if (pass == QueuePass::DEPTH_PREPASS) {
+		return mDepthPrepassShader;
 	}
+	return nullptr;
+}
+
+void Renderer::RunSubmitBenchmark() {
+	// Submits every pass of the current queue into whatever framebuffer is bound, with color and depth
+	// writes off. The frame's own passes clear their targets afterwards
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	GLState::DepthMask(GL_FALSE);
+
+	auto submitAll = [this](bool recorded) {
+		for (int p = 0; p < static_cast<int>(QueuePass::NUM); p++) {
+			QueuePass pass = static_cast<QueuePass>(p);
+			Shader* program = GetQueuePassProgram(pass);
+			ResetSubmitState();
+			if (program) {
+				UseProgram(program);
+			}
+			if (recorded) {
+				ExecuteCommands(pass, program);
+			}
+			else {
+				SubmitDirect(pass, program);
+			}
+		}
+	};
+	auto elapsedMs = [](std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	};
+
+	// Work queued before doesn't count against the first path timed
+	glFinish();
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < SUBMIT_BENCHMARK_ITERATIONS; i++) {
+		submitAll(false);
+	}
+	glFinish();
+	float directMs = elapsedMs(start);
+
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < SUBMIT_BENCHMARK_ITERATIONS; i++) {
+		RecordCommandBuffers();
+	}
+	float recordMs = elapsedMs(start);
+
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < SUBMIT_BENCHMARK_ITERATIONS; i++) {
+		submitAll(true);
+	}
+	glFinish();
+	float replayMs = elapsedMs(start);
+
+	mSubmitBenchmark.iterations = SUBMIT_BENCHMARK_ITERATIONS;
+	mSubmitBenchmark.draws = mSubmitStats.draws / (SUBMIT_BENCHMARK_ITERATIONS * 2);
+	mSubmitBenchmark.directMs = directMs / SUBMIT_BENCHMARK_ITERATIONS;
+	mSubmitBenchmark.recordMs = recordMs / SUBMIT_BENCHMARK_ITERATIONS;
+	mSubmitBenchmark.replayMs = replayMs / SUBMIT_BENCHMARK_ITERATIONS;
+	std::cout << "Submit benchmark, " << mSubmitBenchmark.draws << " draws: direct " << mSubmitBenchmark.directMs
+		<< " ms, record " << mSubmitBenchmark.recordMs << " ms, replay " << mSubmitBenchmark.replayMs << " ms" << std::endl;
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	GLState::DepthMask(GL_TRUE);
+	GLState::StencilMask(0xFF);
+	GLState::StencilFunc(GL_ALWAYS, 1, 0xFF);
+
+	// The frame's stats shouldn't include the benchmark's calls
+	mSubmitStats = SubmitStats();
+	Shader::GetUniformStats() = Shader::UniformStats();
+	GLState::ResetStats();
+}
+
+void Renderer::RegisterMaterial(TexturePack* pTexturePack) {
+	if (mMaterialIDs.find(pTexturePack) == mMaterialIDs.end()) {
+		unsigned int id = static_cast<unsigned int>(mMaterialIDs.size()) + 1;
+		mMaterialIDs[pTexturePack] = id;
+	}
+}
+
+unsigned int Renderer::GetMaterialID(Shape* pShape) const {
+	// Shapes without a texture pack only differ in uniforms
+	if (pShape->mShading != ShapeShading::PBR || !pShape->mMaterialPBR->texturePackEnabled) {
+		return 0;
+	}
+
+	auto it = mMaterialIDs.find(pShape->mMaterialPBR->texturePack);
+	return it != mMaterialIDs.end() ? it->second : 0;
+}
+
+unsigned int Renderer::GetMeshID(const std::string& shape) const {
+	if (shape == "Sphere") {
+		return 0;
+	}
+	if (shape == "Cube") {
+		return 1;
+	}
+	if (shape == "Quad") {
+		return 2;
+	}
+	return 3;
+}
+
+void Renderer::ResetSubmitState() {
+	mSubmitState = SubmitState();
+}
+
+bool Renderer::UseProgram(Shader* shader) {
+	if (shader == mSubmitState.program) {
+		mSubmitStats.redundantProgramBinds++;
+		return false;
+	}
+
+	shader->Use();
+	mSubmitState.program = shader;
+	mSubmitStats.programBinds++;
+	return true;
+}
+
+void Renderer::BindTexturePack(TexturePack* pTexturePack) {
+	Texture* maps[] = { pTexturePack->albedoMap, pTexturePack->normalMap, pTexturePack->roughnessMap,
+		pTexturePack->metallicMap, pTexturePack->depthMap, pTexturePack->aoMap };
+
+	bool bound = pTexturePack == mSubmitState.textures;
+	for (int i = 0; i < 6; i++) {
+		if (!maps[i]) {
+			continue;
+		}
+		if (bound) {
+			mSubmitStats.redundantTextureBinds++;
+		}
+		else {
+			GLState::ActiveTexture(GL_TEXTURE0 + i);
+			maps[i]->Bind();
+			mSubmitStats.textureBinds++;
+		}
+	}
+	mSubmitState.textures = pTexturePack;
 }
 
 void Renderer::SetShapeAndDraw(Shape* pShape) {
+	DrawMesh(GetMeshID(pShape->mShape));
+}
+
+void Renderer::DrawMesh(unsigned int mesh) {
+	bool bind = mesh != mSubmitState.mesh;
+	if (bind) {
+		mSubmitState.mesh = mesh;
+		mSubmitStats.vaoBinds++;
+	}
+	else {
+		mSubmitStats.redundantVaoBinds++;
+	}
+	mSubmitStats.draws++;
 
-	if (pShape->mShape == "Sphere") {
-		mSphereMesh->BindVAO();
+	// Ids from GetMeshID
+	if (mesh == 0) {
+		if (bind) {
+			mSphereMesh->BindVAO();
+		}
 		glDrawElements(GL_TRIANGLE_STRIP, mSphereMesh->GetIndexCount(), GL_UNSIGNED_INT, 0);
 	}
-	if (pShape->mShape == "Cube") {
-		mCubeMesh->BindVAO();
+	else if (mesh == 1) {
+		if (bind) {
+			mCubeMesh->BindVAO();
+		}
 		glDrawArrays(GL_TRIANGLES, 0, 36);
 	}
-	if (pShape->mShape == "Quad") {
-		mQuadMesh->BindVAO();
+	else if (mesh == 2) {
+		if (bind) {
+			mQuadMesh->BindVAO();
+		}
 		glDrawArrays(GL_TRIANGLES, 0, 6);
 	}
 }
 
-glm::mat4 Renderer::CreateModelMatrix(Shape* pShape, AudioPlayer* pAudioPlayer) {
-	glm::mat4 model = glm::mat4(1.0f);
+void Renderer::AddShape(std::string name, Shape* pShape) {
+	MemoryScope memoryScope(MemoryCategory::SCENE);
+	mShapeDS[name] = pShape;
+	pShape->mTransformHandle = mTransforms->Add(*pShape->mTransform);
+	RegisterMaterial(pShape->mMaterialPBR->texturePack);
+}
 
-	model = glm::translate(model, pShape->mTransform->position);
-	model = glm::scale(model, glm::vec3(pShape->mTransform->scale) + glm::vec3(static_cast<float>(pAudioPlayer->GetData()) / 100000));
+void Renderer::RemoveShape(std::string name) {
+	auto it = mShapeDS.find(name);
+	if (it == mShapeDS.end()) {
+		return;
+	}
+	Shape* shape = it->second;
+	mTransforms->Remove(shape->mTransformHandle);
+	mShapeDS.erase(it);
 
-	model = glm::rotate(model, glm::radians(pShape->mTransform->rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(pShape->mTransform->rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(pShape->mTransform->rotation.z), glm::vec3(1.0f, 0.0f, 1.0f));
+	// Snapshots waiting for the render thread still point at it
+	if (mSubmittedFrames >= mPreparedFrames) {
+		delete shape;
+	}
+	else {
+		mRetiredShapes.push_back({ shape, mPreparedFrames });
+	}
+}
 
-	return model;
+void Renderer::MarkTransformDirty(std::string name) {
+	Shape* shape = mShapeDS[name];
+	mTransforms->SetLocal(shape->mTransformHandle, *shape->mTransform);
 }
 
-void Renderer::AddShape(std::string name, Shape* pShape) {
-	mShapeDS[name] = pShape;
+bool Renderer::SetShapeParent(std::string name, std::string parent) {
+	TransformSystem::Handle parentHandle = parent.empty() ? TransformSystem::NO_PARENT : mShapeDS[parent]->mTransformHandle;
+	return mTransforms->SetParent(mShapeDS[name]->mTransformHandle, parentHandle);
 }
 
-void Renderer::RemoveShape(std::string name) {
-	mShapeDS.erase(name);
+const std::string& Renderer::GetShapeParent(const std::string& name) {
+	TransformSystem::Handle parentHandle = mTransforms->GetParent(mShapeDS[name]->mTransformHandle);
+	for (auto& [shapeName, shape] : mShapeDS) {
+		if (shape->mTransformHandle == parentHandle) {
+			return shapeName;
+		}
+	}
+	static const std::string noParent;
+	return noParent;
 }
 
 void Renderer::AddModel(std::string name, std::string path, ResourceManager* pResourceManager) {
-	mModelDS[name] = new Model(path, pResourceManager);
+	MemoryScope memoryScope(MemoryCategory::MESHES);
+	Model* model = new Model(path, pResourceManager);
+	model->AddToSceneGraph(mTransforms);
+	mModelDS[name] = model;
 }
 
 std::unordered_map<std::string, Shape*>& Renderer::GetShapeMap() {
@@ -826,16 +2069,111 @@ std::unordered_map<std::string, Shape*>& Renderer::GetShapeMap() {
 
 void Renderer::SetTexturePackForShape(TexturePack* texturePack, std::string name) {
 	mShapeDS[name]->mMaterialPBR->texturePack = texturePack;
+	RegisterMaterial(texturePack);
 }
 
 void Renderer::SetShapeGeometry(std::string shape, std::string name) {
 	mShapeDS[name]->mShape = shape;
 }
 
-std::vector<Shader*> Renderer::ShapeShaderList() {
+const std::vector<Shader*>& Renderer::ShapeShaderList() const {
 	return mShapeShaders;
 }
 
 std::vector<GLuint>* Renderer::GetDefShadingGBufferTextures() {
 	return &mGBufferTextures;
 }
+
+FrameGraph* Renderer::GetFrameGraph() {
+	return mFrameGraph;
+}
+
+FrameArena* Renderer::GetFrameArena() {
+	return mFrameArena;
+}
+
+bool Renderer::UpdateTargetSize(int windowWidth, int windowHeight) {
+	if (windowWidth != mPendingWidth || windowHeight != mPendingHeight) {
+		mPendingWidth = windowWidth;
+		mPendingHeight = windowHeight;
+		mResizeTime = glfwGetTime();
+	}
+
+	bool changed = mPendingWidth != mTargetWidth || mPendingHeight != mTargetHeight;
+	if (changed && glfwGetTime() - mResizeTime >= RESIZE_DEBOUNCE_SECONDS) {
+		mTargetWidth = mPendingWidth;
+		mTargetHeight = mPendingHeight;
+		return true;
+	}
+	return false;
+}
+
+void Renderer::UpdateMotionVectors(const glm::mat4& viewProj) {
+	MotionVectorsBlock block = { viewProj, mPrevViewProj };
+	glBindBuffer(GL_UNIFORM_BUFFER, mMotionVectorsUBO);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(MotionVectorsBlock), &block);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	mPrevViewProj = viewProj;
+}
+
+void Renderer::UpdateHistoryTextures(int width, int height) {
+	if (width == mHistoryWidth && height == mHistoryHeight) {
+		return;
+	}
+
+	if (mHistoryWidth > 0) {
+		for (GLuint texture : mHistoryTextures) {
+			mFrameGraph->ForgetTexture(texture);
+		}
+		GLState::DeleteTextures(2, mHistoryTextures);
+		mHistoryTextures[0] = mHistoryTextures[1] = 0;
+	}
+	mHistoryWidth = width;
+	mHistoryHeight = height;
+	mHistoryValid = false;
+
+	// Sized like the other screen targets, 0 frees them
+	if (width == 0 || height == 0) {
+		return;
+	}
+
+	glGenTextures(2, mHistoryTextures);
+	for (GLuint texture : mHistoryTextures) {
+		GLState::BindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+		MemoryTracker::TrackGPU(GPUObject::TEXTURE, texture, MemoryTracker::GetTextureBytes(GL_RGBA16F, width, height));
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+}
+
+const Renderer::SubmitStats& Renderer::GetSubmitStats() {
+	return mSubmitStats;
+}
+
+void Renderer::RequestSubmitBenchmark() {
+	mSubmitBenchmarkRequested = true;
+}
+
+const Renderer::SubmitBenchmark& Renderer::GetSubmitBenchmark() {
+	return mSubmitBenchmark;
+}
+
+RenderQueue* Renderer::GetRenderQueue() {
+	return mRenderQueue;
+}
+
+JobSystem* Renderer::GetJobSystem() {
+	return mJobSystem;
+}
+
+TransformSystem* Renderer::GetTransformSystem() {
+	return mTransforms;
+}
+
+GPUProfiler* Renderer::GetProfiler() {
+	return mProfiler;
+}
@@ -9,6 +9,18 @@
 #include "AudioPlayer.h"
 #include "Camera.h"
 #include "Model.h"
+#include "GPUProfiler.h"
+#include "FrameGraph.h"
+#include "RenderQueue.h"
+#include "CommandBuffer.h"
+#include "IndirectDraw.h"
+#include "JobSystem.h"
+#include "TransformSystem.h"
+#include "FrameSnapshot.h"
+#include "IBLCache.h"
+#include "Bloom.h"
+#include "GaussianBlur.h"
+#include "DynamicResolution.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -18,6 +30,38 @@
 #include "imgui/imgui_impl_glfw.h"
 
 #include <vector>
+#include <unordered_map>
+#include <climits>
+#include <cstdint>
+
+// Filtering used for the point light's shadow map, roughly cheapest to most expensive
+enum class ShadowFilter {
+	HARD,
+	HARDWARE_PCF,
+	PCF,
+	POISSON_PCF,
+	PCSS,
+	NUM
+};
+
+// Tone mapping operator used by the final resolve. NONE passes the HDR color through unchanged
+enum class Tonemapper {
+	NONE,
+	EXPONENTIAL,
+	REINHARD,
+	ACES,
+	AGX,
+	NUM
+};
+
+// Anti-aliasing of the scene. MSAA is only available in forward mode, multisampling four
+// G-Buffer targets costs too much bandwidth
+enum class AntiAliasing {
+	NONE,
+	TAA,
+	MSAA_4X,
+	NUM
+};
 
 class Renderer
 {
@@ -29,36 +73,121 @@ public:
 		bool invert;
 	};
 
+	// Calls made while submitting the render queue this frame, and the ones skipped because the state was already set
+	struct SubmitStats {
+		int draws = 0;
+		int programBinds = 0, redundantProgramBinds = 0;
+		int vaoBinds = 0, redundantVaoBinds = 0;
+		int textureBinds = 0, redundantTextureBinds = 0;
+
+		// Replayed from command buffers, and the bytes they took
+		int commands = 0;
+		size_t commandBytes = 0;
+	};
+
+	// CPU time (ms) of submitting every queue pass of one frame, averaged over a run of the benchmark.
+	// Draws only count what the queue holds, passes drawn from IndirectBatches aren't included
+	struct SubmitBenchmark {
+		int iterations = 0;
+		int draws = 0;
+		float directMs = 0.0f;
+		float recordMs = 0.0f;
+		float replayMs = 0.0f;
+	};
+
 	Renderer(const int SCREEN_WIDTH, const int SCREEN_HEIGHT, Cubemap* _cubemap, ResourceManager* pResourceManager);
 	~Renderer();
 
-	void Draw(const int SCREEN_WIDTH, const int SCREEN_HEIGHT, Camera* pCamera, AudioPlayer* pAudioPlayer);
-	void GenerateCubemapFromEquiRecIrrMap(std::string envMapName, ResourceManager* pResourceManager);
+	// Takes the current framebuffer size of the window. Prepare and Submit in one go
+	void Draw(const int windowWidth, const int windowHeight, Camera* pCamera, AudioPlayer* pAudioPlayer);
+
+	// Main thread half of a frame: camera, audio sample, shapes, lights and updated world matrices go into frame.
+	// Touches no GL, so it can run while the render thread submits the previous frame
+	void Prepare(FrameSnapshot& frame, const int windowWidth, const int windowHeight, Camera* pCamera, AudioPlayer* pAudioPlayer);
+
+	// GL half: renders a prepared frame. frame must stay untouched until it returns
+	void Submit(const FrameSnapshot& frame);
+
+	// Swaps to a resident environment, streams it from the disk cache or bakes it if it was never baked.
+	// Happens at the start of the next submitted frame
+	void SetEnvironment(std::string envMapName, ResourceManager* pResourceManager);
+	// Environment still streaming in, empty if none
+	const std::string& GetPendingEnvironment();
 
 private:
 	// Setup Stuff
-	void SetupForShadows();
+	void SetupShadowSamples();
+	void SetupSSAO();
+	void SetupIndirectDraw();
 	void SetupSkybox();
 	void SetupForIBL(ResourceManager* pResourceManager);
-	void SetupForDeferredShading(int SCREEN_WIDTH, int SCREEN_HEIGHT);
-	void SetupFBO(const int SCREEN_WIDTH, const int SCREEN_HEIGHT);
-	void SetupForHDR(const int SCREEN_WIDTH, const int SCREEN_HEIGHT);
+	void GenerateBRDFLUT();
+	void LoadEnvironment(std::string envMapName, ResourceManager* pResourceManager);
+	IBLEnvironment* BakeEnvironment(std::string envMapName, ResourceManager* pResourceManager);
+	void ActivateEnvironment(IBLEnvironment* environment);
+	void UpdateEnvironment(size_t uploadBudgetBytes);
+	void RenderToCubemap(Shader* shader, GLuint cubemap, int size, int mipLevel);
+	void BindIBLMaps();
+	bool UpdateTargetSize(int windowWidth, int windowHeight);
+	void UpdateMotionVectors(const glm::mat4& viewProj);
+	void UpdateHistoryTextures(int width, int height);
 	void SetLightVarsInShader(Shader* shader);
-	void SetVertexShaderVarsForDeferredShadingAndUse(Shape* pCube, Camera* pCamera, AudioPlayer* pAudioPlayer);
-	void SetShaderVarsAndUse(Shape* pSphere, Camera* pCamera, AudioPlayer* pAudioPlayer);
+	void SetProgramVars(Shader* shader);
+	void SetVertexShaderVarsForDeferredShadingAndUse(Shape* pCube);
+	void SetShaderVarsAndUse(Shape* pSphere);
+	void BuildRenderQueue();
+	void SetupCommandBuffers();
+	void RecordCommandBuffers();
+	void RecordQueuePass(CommandBuffer& buffer, QueuePass pass, const RenderItem* first, const RenderItem* last) const;
+	void RecordShapeVars(CommandBuffer& buffer, Shape* pShape) const;
+	void RecordGBufferVars(CommandBuffer& buffer, Shape* pShape) const;
+	void ExecuteCommands(QueuePass pass, Shader* program);
+	void SubmitDirect(QueuePass pass, Shader* program);
+	void SubmitQueuePass(QueuePass pass, Shader* program);
+	Shader* GetQueuePassProgram(QueuePass pass);
+	void RunSubmitBenchmark();
+	void RegisterMaterial(TexturePack* pTexturePack);
+	unsigned int GetMaterialID(Shape* pShape) const;
+	unsigned int GetMeshID(const std::string& shape) const;
+	void ResetSubmitState();
+	bool UseProgram(Shader* shader);
+	void BindTexturePack(TexturePack* pTexturePack);
 	void SetShapeAndDraw(Shape* pShape);
-	glm::mat4 CreateModelMatrix(Shape* pSphere, AudioPlayer* pAudioPlayer);
+	void DrawMesh(unsigned int mesh);
 	
 public:
 	void AddShape(std::string name, Shape* pSphere);
 	void RemoveShape(std::string name);
+
+	// Call after changing a shape's Transform, its matrix is only recomposed then
+	void MarkTransformDirty(std::string name);
+
+	// The shape's Transform becomes relative to the parent's. An empty parent makes it a root.
+	// Fails if the parent is the shape or one of its descendants
+	bool SetShapeParent(std::string name, std::string parent);
+	const std::string& GetShapeParent(const std::string& name);
 	void AddModel(std::string name, std::string path, ResourceManager* pResourceManager);
 	std::unordered_map<std::string, Shape*>& GetShapeMap();
 	
 	void SetTexturePackForShape(TexturePack* texturePack, std::string name);
 	void SetShapeGeometry(std::string shape, std::string name);
-	std::vector<Shader*> ShapeShaderList();
+	const std::vector<Shader*>& ShapeShaderList() const;
 	std::vector<GLuint>* GetDefShadingGBufferTextures();
+	GPUProfiler* GetProfiler();
+	const SubmitStats& GetSubmitStats();
+
+	// Times direct submission against recording and replaying command buffers, at the start of the next frame
+	void RequestSubmitBenchmark();
+	const SubmitBenchmark& GetSubmitBenchmark();
+	RenderQueue* GetRenderQueue();
+	JobSystem* GetJobSystem();
+	TransformSystem* GetTransformSystem();
+
+	// Batch drawing the shadow casters (SHADOW) or the depth pre-pass (DEPTH_PREPASS)
+	IndirectBatch* GetIndirectBatch(QueuePass pass);
+	FrameGraph* GetFrameGraph();
+	FrameArena* GetFrameArena();
+	IBLCache* GetIBLCache();
 
 public:
 	// screen shader vars
@@ -67,17 +196,63 @@ public:
 
 	// HDR settings
 	GLfloat mExposure;
-	bool mHDROn;
+	Tonemapper mTonemapper;
+
+	// Bloom settings. Threshold, knee and radius live in the Bloom itself
+	bool mBloomOn;
+	float mBloomIntensity;
+	Bloom* mBloom;
+
+	// Backs the Blur filter. The slider maps to a radius of up to MAX_BLUR_RADIUS pixels
+	GaussianBlur* mGaussianBlur;
+
+	// Renders the scene below window resolution when over the frame time budget, upscales and sharpens
+	bool mDynamicResolutionOn;
+	float mUpscaleSharpness;
+	DynamicResolution* mDynamicResolution;
+
+	// TAA blends each frame with this much of the reprojected history
+	AntiAliasing mAntiAliasing;
+	float mTAAHistoryWeight;
+
+	// Forward scene cost (ms) last measured with each anti-aliasing mode
+	float mAntiAliasingCost[static_cast<int>(AntiAliasing::NUM)];
 
 	// Def. Shading
 	bool mDeferredShadingOn;
+
+	// Forward mode lays down depth first and shades with an equal depth test
+	bool mDepthPrepassOn;
+
+	// Shadow casters and the depth pre-pass drawn from IndirectBatches, culled on the GPU
+	bool mGPUDrivenOn;
+
+	// Shape passes are recorded into command buffers by the job system and replayed, instead of setting
+	// uniforms and drawing shape by shape on the GL thread
+	bool mCommandBuffersOn;
 	
 	// Clear color
 	glm::vec3 mClearColor;
 
-	GLuint mGBuffer, mAttachments[4], mGRBODepth;
+	// Shadow settings. Bias, filter radius and light size are in world units
+	ShadowFilter mShadowFilter;
+	float mShadowBias, mShadowFilterRadius, mShadowLightSize;
+
+	// Lighting pass cost (ms) last measured with each shadow filter
+	float mShadowFilterCost[static_cast<int>(ShadowFilter::NUM)];
+
+	// G-Buffer textures of the last frame for the editor. Only filled while mShowGBuffer is set,
+	// otherwise the frame graph reuses them for later passes
+	bool mShowGBuffer;
 	std::vector<GLuint> mGBufferTextures;
 
+	// Screen-space ambient occlusion in deferred mode. Radius and bias are in world units
+	bool mSSAOOn, mSSAOHalfResolution;
+	float mSSAORadius, mSSAOBias, mSSAOIntensity;
+
+	// SSAO cost (ms) last measured at full [0] and half [1] resolution
+	float mSSAOCost[2];
+
 private:
 	// outline properties
 	glm::vec3 mSelectedShapeOutlineColor = glm::vec3(10.0f, 10.0f, 0.0f);
@@ -96,9 +271,13 @@ private:
 	QuadMesh* mQuadMesh;
 
 	// Shaders
-	Shader* mScreenShader, *mSkyboxShader, *mOutlineShader, *mLightBlockShader, *mGBufferShader, *mGBufferShaderPBR,
-		*mDeferredShadingLightingShader, *mDeferredShadingLightingShaderPBR, *mHDRShader, *mModelShader, *mPointShadowDepthShader,
-		*mEquiRecToCubeMapShader;
+	Shader* mScreenShader, *mSkyboxShader, *mOutlineShader, *mGBufferShader, *mGBufferShaderPBR,
+		*mDeferredShadingLightingShader, *mDeferredShadingLightingShaderPBR, *mModelShader, *mPointShadowDepthShader,
+		*mEquiRecToCubeMapShader, *mPrefilterShader, *mBRDFShader, *mUpscaleShader, *mTAAShader,
+		*mSSAOShader, *mSSAOBlurShader, *mDepthPrepassShader;
+
+	// GPU culling and the depth-only shaders built with INDIRECT. Null without GL 4.3
+	Shader* mIndirectCullShader, *mIndirectShadowShader, *mIndirectPrepassShader;
 	
 	// Proj matrix is common for all
 	glm::mat4 mProj;
@@ -108,31 +287,142 @@ private:
 	// Skybox Mesh
 	GLuint mSkyVAO, mSkyVBO;
 
-	// Framebuffer for post-processing
-	GLuint mRBO, mFBO, mTextureColorBuffer;
-
-	// FBO for HDR
-	GLuint mHDRRBO, mHDRFBO, mHDRTextureColorBuffer;
-
-	// G-Buffer framebuffer, color textures for different properties and a depth buffer
-	//GLuint mGBuffer, mGPosition, mGNormal, mGDiffuseColor, mGSpecularColor, mAttachments[4], mGRBODepth;
-	
 	// transformation matrices for shadowmaps
 	std::vector<glm::mat4> mShadowTransforms;
 	glm::mat4 mShadowProj;
 
-	// FBO for Shadow map(s)
-	GLuint mShadowDepthMapFBO, mShadowDepthCubeMap;
+	// Sampler for hardware depth comparison on the shadow map and UBO with precomputed filter offsets
+	GLuint mShadowCompareSampler, mShadowSamplesUBO;
+	ShadowFilter mLastShadowFilter;
+	int mShadowFilterFrames;
+
+	// Hemisphere kernel and noise rotations for SSAO
+	GLuint mSSAOKernelUBO;
+	bool mLastSSAOHalfResolution;
+	int mSSAOFrames;
+
+	// Model matrices of this and the last frame, composed once per frame. Every pass reads the frame's
+	// copy of them. Their difference is what the velocity buffer holds
+	TransformSystem* mTransforms;
+
+	// Frame being submitted, and the one Draw prepares without a render thread
+	const FrameSnapshot* mFrame;
+	FrameSnapshot mSnapshot;
+
+	// Removed shapes that snapshots prepared before the removal may still draw, deleted once those are
+	// submitted. Only used with the render thread, otherwise every prepared frame is already submitted
+	struct RetiredShape {
+		Shape* shape;
+		uint64_t lastFrame;
+	};
+	std::vector<RetiredShape> mRetiredShapes;
+	uint64_t mPreparedFrames, mSubmittedFrames;
+	glm::mat4 mPrevViewProj;
+	GLuint mMotionVectorsUBO;
+
+	// TAA history ping-pongs between two persistent targets, one is read while the other is written.
+	// Jitter cycles through a Halton sequence
+	GLuint mHistoryTextures[2];
+	int mHistoryWidth, mHistoryHeight, mHistoryIndex;
+	bool mHistoryValid;
+	glm::vec2 mHistoryUVScale;
+	unsigned int mJitterIndex;
+	AntiAliasing mLastAntiAliasing;
+	int mAntiAliasingFrames;
+
+	GPUProfiler* mProfiler;
+
+	// Scratch memory of the frame being submitted: frame graph passes, names and lists. Rewound at the start of Submit
+	FrameArena* mFrameArena;
+
+	// Owns every render target of a frame: scene color/depth, G-Buffer, shadow cube, bloom and blur
+	FrameGraph* mFrameGraph;
+	FrameGraphResource mGBufferResources[4];
+
+	// Every shape draw of the frame, sorted by pass and state. Rebuilt every frame
+	RenderQueue* mRenderQueue;
+
+	// Merged shape meshes and the objects of the passes drawn with multi-draw indirect
+	IndirectGeometry* mIndirectGeometry;
+	IndirectBatch* mShadowBatch, *mPrepassBatch;
+
+	// Ids are handed out when a shape gets a texture pack, so the key jobs only read them
+	std::unordered_map<TexturePack*, unsigned int> mMaterialIDs;
+
+	// Transforms, sort keys, batch filling and CPU culling are split over its workers
+	JobSystem* mJobSystem;
+
+	// What BuildRenderQueue worked out for each of the frame's shapes, at the shape's index
+	struct ShapeDrawInfo {
+		unsigned int mesh;
+		unsigned int material;
+
+		// Object index in the shadow and prepass batches, -1 when not in them
+		int shadowSlot;
+		int prepassSlot;
+	};
+	std::vector<ShapeDrawInfo> mShapeDrawInfos;
+
+	// What the queue's draws left bound in the current pass. Reset at the start of each pass,
+	// since code outside the queue binds programs, VAOs and textures too
+	struct SubmitState {
+		Shader* program = nullptr;
+		unsigned int mesh = UINT_MAX;
+		TexturePack* textures = nullptr;
+	};
+	SubmitState mSubmitState;
+	SubmitStats mSubmitStats;
+
+	// Locations of the uniforms set per shape, looked up once so recording jobs don't touch GL.
+	// -1 where the program doesn't have one
+	struct ObjectUniforms {
+		GLint model, prevModel;
+		GLint ambient, diffuse, specular, shininess;
+		GLint packEnabled, metallicMapOn, heightScale;
+		GLint albedo, roughness, metalness, ao;
+		GLint lightColor;
+	};
+	ObjectUniforms mShapeUniforms[static_cast<int>(ShapeShading::NUM)];
+	ObjectUniforms mGBufferUniforms, mShadowUniforms, mPrepassUniforms;
+
+	// Commands of each queue pass, a buffer per chunk of items so chunks record in parallel.
+	// Buffers past the count are kept for their memory
+	std::vector<CommandBuffer> mCommandBuffers[static_cast<int>(QueuePass::NUM)];
+	size_t mCommandBufferCounts[static_cast<int>(QueuePass::NUM)];
+	struct RecordChunk {
+		QueuePass pass;
+		const RenderItem* first;
+		const RenderItem* last;
+		CommandBuffer* buffer;
+	};
+	std::vector<RecordChunk> mRecordChunks;
+
+	bool mSubmitBenchmarkRequested;
+	SubmitBenchmark mSubmitBenchmark;
+
+	// Size of the screen-sized targets, and the window size waiting to become it
+	int mTargetWidth, mTargetHeight;
+	int mPendingWidth, mPendingHeight;
+	double mResizeTime;
 
 	// FBO for CubeMap for IBL
-	GLuint mCaptureFBO, mCaptureRBO;
+	GLuint mCaptureFBO;
 
-	// HDR texture for IBL
-	TextureHDR* mHDRIBLTextureBG, *mHDRIBLTextureIrrMap;
-	
+	// Baked environments (environment cube and GGX-prefiltered specular mip chain), resident and on disk
+	IBLCache* mIBLCache;
+	IBLEnvironment* mEnvironment;
+	std::string mPendingEnvironment;
+	ResourceManager* mPendingEnvironmentSource;
+
+	// Picked in the editor, loaded at the start of the next submitted frame where the GL context is current
+	std::string mRequestedEnvironment;
+	ResourceManager* mRequestedEnvironmentSource;
+
+	// Diffuse irradiance as L2 spherical harmonics, projected on the CPU when the HDR is loaded
+	GLuint mIrradianceSHUBO;
 
-	// Cubemap for IBL
-	GLuint mEnvCubemap;
+	// Split-sum BRDF integration LUT. Independent of the environment, so baked once
+	GLuint mBRDFLUT;
 
 	// Shaders that cubes can use. Each cube can decide which one to use
 	std::vector<Shader*> mShapeShaders;
@@ -5,6 +5,7 @@
 #include "Texture.h"
 #include "TextureHDR.h"
 #include "Cubemap.h"
+#include "MemoryTracker.h"
 
 #include <fstream>
 
@@ -26,6 +27,7 @@ class ResourceManager {
 
 public:
 	ResourceManager() {
+		MemoryScope memoryScope(MemoryCategory::TEXTURES);
 
 		stbi_set_flip_vertically_on_load(true);
 
@@ -40,13 +42,9 @@ public:
 
 		AddCubeMap("Default", skyFaces);
 
-		AddHDRImagePairForIBL("Ditch_River", 
-			"../resources/IBL/Ditch_River/Ditch-River_2k.hdr", 
-			"../resources/IBL/Ditch_River/Ditch-River_Env.hdr");
+		AddHDRImageForIBL("Ditch_River", "../resources/IBL/Ditch_River/Ditch-River_2k.hdr");
 
-		AddHDRImagePairForIBL("Factory_Catwalk",
-			"../resources/IBL/Factory_Catwalk/Factory_Catwalk_2k.hdr",
-			"../resources/IBL/Factory_Catwalk/Factory_Catwalk_Env.hdr");
+		AddHDRImageForIBL("Factory_Catwalk", "../resources/IBL/Factory_Catwalk/Factory_Catwalk_2k.hdr");
 		
 		std::ifstream input;
 		input.open("../resources/texture_packs/Texture_Pack_List.txt");
@@ -72,7 +70,24 @@ public:
 		}
 	};
 
+	// Deletes the GL textures too, so the context must still be current
+	~ResourceManager() {
+		for (auto& [name, texturePack] : mTexturePacks) {
+			delete texturePack;
+		}
+		for (auto& [name, texture] : mTextures) {
+			delete texture;
+		}
+		for (auto& [name, image] : mHDRImagesForIBL) {
+			delete image;
+		}
+		for (auto& [name, cubemap] : mCubemaps) {
+			delete cubemap;
+		}
+	}
+
 	Texture* AddTexture(std::string name, std::string path, std::string type = "texture_diffuse") {
+		MemoryScope memoryScope(MemoryCategory::TEXTURES);
 		std::ifstream input;
 		input.open(path);
 		if (!input.is_open()) {
@@ -84,7 +99,8 @@ public:
 		}
 	}
 
-	TexturePack* AddTexturePack(std::string name, std::vector<std::string>& paths) {		
+	TexturePack* AddTexturePack(std::string name, std::vector<std::string>& paths) {
+		MemoryScope memoryScope(MemoryCategory::TEXTURES);
 		mTexturePacks[name] = new TexturePack(
 			AddTexture(name + "_Albedo", paths[0]),
 			AddTexture(name + "_Normal", paths[1]),
@@ -97,11 +113,14 @@ public:
 	}
 
 	void AddCubeMap(std::string name, std::vector<std::string>& facePaths) {
+		MemoryScope memoryScope(MemoryCategory::TEXTURES);
 		mCubemaps[name] = new Cubemap(facePaths);
 	}
 
-	void AddHDRImagePairForIBL(std::string name, std::string envMapBGPath, std::string envMapIrrPath) {
-		mHDRImagePairsForIBL[name] = std::make_pair(new TextureHDR(envMapBGPath), new TextureHDR(envMapIrrPath));
+	// Diffuse irradiance comes from the SH projection of the same image, so one HDR per environment is enough.
+	// The image is only decoded when an environment has to be baked, cached bakes never touch it
+	void AddHDRImageForIBL(std::string name, std::string envMapPath) {
+		mHDRImagePaths[name] = envMapPath;
 	}
 
 	TexturePack* GetTexturePack(std::string name) {
@@ -122,14 +141,14 @@ public:
 		}
 	}
 
-	TextureHDR* GetHDRImage(std::string name, int index) {
-		if (mHDRImagePairsForIBL.find(name) != mHDRImagePairsForIBL.end()) {
-			if (index == 0) {
-				return mHDRImagePairsForIBL[name].first;
-			}
-			else {
-				return mHDRImagePairsForIBL[name].second;
-			}
+	TextureHDR* GetHDRImage(std::string name) {
+		if (mHDRImagesForIBL.find(name) != mHDRImagesForIBL.end()) {
+			return mHDRImagesForIBL[name];
+		}
+		else if (mHDRImagePaths.find(name) != mHDRImagePaths.end()) {
+			MemoryScope memoryScope(MemoryCategory::TEXTURES);
+			mHDRImagesForIBL[name] = new TextureHDR(mHDRImagePaths[name]);
+			return mHDRImagesForIBL[name];
 		}
 		else {
 			return nullptr;
@@ -153,13 +172,23 @@ public:
 		return mTexturePacks;
 	}
 
-	std::unordered_map<std::string, std::pair<TextureHDR*, TextureHDR*>>& GetHDRImagePairList() {
-		return mHDRImagePairsForIBL;
+	std::string GetHDRImagePath(std::string name) {
+		if (mHDRImagePaths.find(name) != mHDRImagePaths.end()) {
+			return mHDRImagePaths[name];
+		}
+		else {
+			return "";
+		}
+	}
+
+	std::unordered_map<std::string, std::string>& GetHDRImagePathList() {
+		return mHDRImagePaths;
 	}
 
 private:
 	std::unordered_map<std::string, Texture*> mTextures;
 	std::unordered_map<std::string, TexturePack*> mTexturePacks;
-	std::unordered_map<std::string, std::pair<TextureHDR*, TextureHDR*>> mHDRImagePairsForIBL;
+	std::unordered_map<std::string, TextureHDR*> mHDRImagesForIBL;
+	std::unordered_map<std::string, std::string> mHDRImagePaths;
 	std::unordered_map<std::string, Cubemap*> mCubemaps;
 };
\ No newline at end of file
@@ -0,0 +1,77 @@
+#version 330 core
+out vec2 FragColor;
+
+in vec2 TexCoords;
+
+// Screen-space ambient occlusion from the G-Buffer, possibly at a fraction of its resolution.
+// Outputs the occlusion and the pixel's view depth, which the blur and the upsample use to stay on one surface
+uniform sampler2D gPosition;
+uniform sampler2D gNormal;
+uniform sampler2D depthTexture;
+
+uniform mat4 view;
+uniform mat4 proj;
+
+// Part of the G-Buffer the scene was rendered into, in pixels, and how many G-Buffer pixels one output pixel covers
+uniform vec2 renderSize;
+uniform int scale;
+
+uniform float radius;
+uniform float bias;
+uniform float intensity;
+
+// Hemisphere kernel (denser towards the center) and a 4x4 tile of rotation vectors, precomputed on the CPU
+// (Renderer::SetupSSAO). Must match SSAO_KERNEL_SIZE and SSAO_NOISE_SIZE
+layout (std140) uniform SSAOKernel {
+	vec4 kernel[32];
+	vec4 noise[16];
+};
+
+const int KERNEL_SIZE = 32;
+const int NOISE_SIZE = 4;
+
+// Sky has no surface, so nothing is occluded and its depth is far from everything
+const float SKY_DEPTH = 10000.0;
+
+void main()
+{
+	ivec2 lowResPixel = ivec2(gl_FragCoord.xy);
+	ivec2 pixel = lowResPixel * scale;
+	if (texelFetch(depthTexture, pixel, 0).r >= 1.0) {
+		FragColor = vec2(1.0, SKY_DEPTH);
+		return;
+	}
+
+	vec3 position = (view * vec4(texelFetch(gPosition, pixel, 0).xyz, 1.0)).xyz;
+	vec3 normal = normalize(mat3(view) * texelFetch(gNormal, pixel, 0).xyz);
+
+	// Random rotation around the normal, repeating every NOISE_SIZE pixels. The blur averages the tile out
+	ivec2 noisePixel = lowResPixel % NOISE_SIZE;
+	vec3 randomVec = noise[noisePixel.y * NOISE_SIZE + noisePixel.x].xyz;
+	vec3 tangent = normalize(randomVec - normal * dot(randomVec, normal));
+	vec3 bitangent = cross(normal, tangent);
+	mat3 TBN = mat3(tangent, bitangent, normal);
+
+	float occlusion = 0.0;
+	for (int i = 0; i < KERNEL_SIZE; i++) {
+		vec3 samplePos = position + TBN * kernel[i].xyz * radius;
+		vec4 clip = proj * vec4(samplePos, 1.0);
+		vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+		if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0)))) {
+			continue;
+		}
+
+		ivec2 samplePixel = min(ivec2(uv * renderSize), ivec2(renderSize) - 1);
+		if (texelFetch(depthTexture, samplePixel, 0).r >= 1.0) {
+			continue;
+		}
+
+		// Occluders further away than the radius fade out instead of darkening silhouettes
+		float sampleDepth = (view * vec4(texelFetch(gPosition, samplePixel, 0).xyz, 1.0)).z;
+		float rangeCheck = smoothstep(0.0, 1.0, radius / abs(position.z - sampleDepth));
+		occlusion += (sampleDepth >= samplePos.z + bias ? 1.0 : 0.0) * rangeCheck;
+	}
+
+	float ao = 1.0 - occlusion / float(KERNEL_SIZE);
+	FragColor = vec2(pow(ao, intensity), -position.z);
+}
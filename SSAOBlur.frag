@@ -0,0 +1,35 @@
+#version 330 core
+out vec2 FragColor;
+
+in vec2 TexCoords;
+
+// Depth-aware 4x4 box blur of the SSAO output, the size of its noise tile. Neighbours on another
+// surface (view depth too different) are left out, so occlusion doesn't bleed across edges
+uniform sampler2D ssaoTexture;
+
+// Part of ssaoTexture that holds this frame's occlusion, in pixels
+uniform vec2 renderSize;
+
+// Relative view depth difference above which a neighbour counts as another surface
+const float DEPTH_THRESHOLD = 0.05;
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	vec2 center = texelFetch(ssaoTexture, pixel, 0).rg;
+
+	float occlusion = 0.0;
+	float weightSum = 0.0;
+	for (int y = -2; y < 2; y++) {
+		for (int x = -2; x < 2; x++) {
+			ivec2 neighbour = clamp(pixel + ivec2(x, y), ivec2(0), ivec2(renderSize) - 1);
+			vec2 ssao = texelFetch(ssaoTexture, neighbour, 0).rg;
+			float weight = abs(ssao.g - center.g) <= DEPTH_THRESHOLD * center.g ? 1.0 : 0.0;
+			occlusion += ssao.r * weight;
+			weightSum += weight;
+		}
+	}
+
+	// The center pixel always counts, weightSum is at least 1
+	FragColor = vec2(occlusion / weightSum, center.g);
+}
@@ -3,63 +3,145 @@ out vec4 FragColor;
 
 in vec2 TexCoords;
 
+// Final resolve: HDR scene + bloom -> exposure -> tone mapping -> gamma -> screen filters, in one pass
 uniform sampler2D screenTexture;
+uniform sampler2D bloomTexture;
+
+// Separable Gaussian blur of screenTexture, possibly at reduced resolution
+uniform sampler2D blurTexture;
+uniform bool blurOn;
+
+uniform bool bloomOn;
+uniform float bloomIntensity;
+
+// Matches the Tonemapper enum in Renderer.h
+const int TONEMAP_NONE = 0;
+const int TONEMAP_EXPONENTIAL = 1;
+const int TONEMAP_REINHARD = 2;
+const int TONEMAP_ACES = 3;
+const int TONEMAP_AGX = 4;
+
+uniform int tonemapper;
+uniform float exposure;
 
 uniform float t_saturation;
-uniform float t_blur;
 uniform float t_outline;
 uniform bool t_invert;
 
-const float offset = 1.0 / 300.0;
+// ACES fit by Stephen Hill. Matrices are sRGB -> ACES AP1 (with RRT saturation) and back
+vec3 RRTAndODTFit(vec3 v)
+{
+	vec3 a = v * (v + 0.0245786) - 0.000090537;
+	vec3 b = v * (0.983729 * v + 0.4329510) + 0.238081;
+	return a / b;
+}
+
+vec3 TonemapACES(vec3 color)
+{
+	const mat3 ACESInputMat = mat3(
+		0.59719, 0.07600, 0.02840,
+		0.35458, 0.90834, 0.13383,
+		0.04823, 0.01566, 0.83777);
+	const mat3 ACESOutputMat = mat3(
+		 1.60475, -0.10208, -0.00327,
+		-0.53108,  1.10813, -0.07276,
+		-0.07367, -0.00605,  1.07602);
+
+	color = ACESOutputMat * RRTAndODTFit(ACESInputMat * color);
+	return clamp(color, 0.0, 1.0);
+}
+
+// Minimal AgX (Troy Sobotka's AgX with the polynomial contrast fit by Benjamin Wrensch)
+vec3 AgXContrastApprox(vec3 x)
+{
+	vec3 x2 = x * x;
+	vec3 x4 = x2 * x2;
+	return 15.5 * x4 * x2 - 40.14 * x4 * x + 31.96 * x4 - 6.868 * x2 * x + 0.4298 * x2 + 0.1191 * x - 0.00232;
+}
+
+vec3 TonemapAgX(vec3 color)
+{
+	const mat3 agxMat = mat3(
+		0.842479062253094, 0.0423282422610123, 0.0423756549057051,
+		0.0784335999999992, 0.878468636469772, 0.0784336,
+		0.0792237451477643, 0.0791661274605434, 0.879142973793104);
+	const mat3 agxMatInv = mat3(
+		1.19687900512017, -0.0528968517574562, -0.0529716355144438,
+		-0.0980208811401368, 1.15190312990417, -0.0980434501171241,
+		-0.0990297440797205, -0.0989611768448433, 1.15107367264116);
+	const float minEv = -12.47393;
+	const float maxEv = 4.026069;
+
+	color = agxMat * max(color, vec3(1e-10));
+	color = clamp(log2(color), minEv, maxEv);
+	color = (color - minEv) / (maxEv - minEv);
+	color = AgXContrastApprox(color);
+	color = agxMatInv * color;
+
+	// AgX output is display encoded, linearize so it goes through the same gamma as the others
+	return pow(max(color, vec3(0.0)), vec3(2.2));
+}
+
+vec3 Tonemap(vec3 color)
+{
+	if (tonemapper == TONEMAP_EXPONENTIAL) {
+		return vec3(1.0) - exp(-color);
+	}
+	else if (tonemapper == TONEMAP_REINHARD) {
+		return color / (color + vec3(1.0));
+	}
+	else if (tonemapper == TONEMAP_ACES) {
+		return TonemapACES(color);
+	}
+	else {
+		return TonemapAgX(color);
+	}
+}
+
+vec3 SampleScene()
+{
+	vec3 color = blurOn ? texture(blurTexture, TexCoords).rgb : texture(screenTexture, TexCoords).rgb;
+
+	// Outline is a 3x3 sharpen, only paid for when it does something
+	if (t_outline > 0.0) {
+		vec2 texel = 1.0 / vec2(textureSize(screenTexture, 0));
+		vec3 center = texture(screenTexture, TexCoords).rgb;
+		vec3 neighbours = vec3(0.0);
+		for (int y = -1; y <= 1; y++) {
+			for (int x = -1; x <= 1; x++) {
+				if (x != 0 || y != 0) {
+					neighbours += texture(screenTexture, TexCoords + vec2(x, y) * texel).rgb;
+				}
+			}
+		}
+		color += 0.5 * t_outline * (8.0 * center - neighbours);
+	}
+	return color;
+}
 
 void main()
 {
-	vec2 offsets[9] = vec2[](
-		vec2(-offset, offset), // top-left
-		vec2( 0.0f, offset), // top-center
-		vec2( offset, offset), // top-right
-		vec2(-offset, 0.0f), // center-left
-		vec2( 0.0f, 0.0f), // center-center
-		vec2( offset, 0.0f), // center-right
-		vec2(-offset, -offset), // bottom-left
-		vec2( 0.0f, -offset), // bottom-center
-		vec2( offset, -offset) // bottom-right
-	);
-
-	
-	float kernel_blur[9] = float[](
-			t_blur/9.0f, t_blur/9.0f, t_blur/9.0f,
-			t_blur/9.0f, 1 - (8 * t_blur/9.0f), t_blur/9.0f,	
-			t_blur/9.0f, t_blur/9.0f, t_blur/9.0f
-	);
-
-	float kernel_outline[9] = float[](
-			-t_outline, -t_outline, -t_outline,
-			-t_outline, 1.0f * (1 - t_outline) + 8.0f * t_outline, -t_outline,
-			-t_outline, -t_outline, -t_outline
-	);
-
-	vec3 sampleTex[9];
-	for(int i = 0; i < 9; i++) {
-		sampleTex[i] = texture(screenTexture, TexCoords.st + offsets[i]).rgb;
+	const float gamma = 2.2;
+
+	vec3 color = SampleScene();
+	if (bloomOn) {
+		color += texture(bloomTexture, TexCoords).rgb * bloomIntensity;
 	}
 
-	vec3 col = vec3(0.0);
-	for(int i = 0; i < 9; i++)
-		col += (sampleTex[i] * (kernel_blur[i] + kernel_outline[i]))/2.0f;
-	vec4 color = vec4(col, 1.0);
+	if (tonemapper != TONEMAP_NONE) {
+		color = Tonemap(color * exposure);
+		color = pow(color, vec3(1.0 / gamma));
+	}
 
+	// The filters below work on display values, as they did when they ran on an 8-bit target
+	color = clamp(color, 0.0, 1.0);
 
-    //vec4 color = texture(screenTexture, TexCoords);
-    float average = (color.r + color.g + color.b) / 3.0;
-    color.r = color.r * t_saturation + average * (1 - t_saturation);
-    color.g = color.g * t_saturation + average * (1 - t_saturation);
-    color.b = color.b * t_saturation + average * (1 - t_saturation);
+	float average = (color.r + color.g + color.b) / 3.0;
+	color = color * t_saturation + average * (1.0 - t_saturation);
 
 	if (t_invert) {
-		FragColor = vec4(1.0f) - color;
+		color = vec3(1.0) - color;
 	}
-	else {
-		FragColor = color;
-	}
-} 
\ No newline at end of file
+
+	FragColor = vec4(color, 1.0);
+}
@@ -1,10 +1,52 @@
 #include "Shader.h"
+#include "GLState.h"
+#include "ShaderCache.h"
 
+#include <glfw/glfw3.h>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <chrono>
+#include <cstring>
+
+struct ShaderStage
+{
+    GLenum type;
+    const char* typeName;
+    const std::string* source;
+};
+
+// Compiled and linked program whose status hasn't been checked yet
+struct PendingProgram
+{
+    GLuint program;
+    GLuint shaders[3];
+    const char* typeNames[3];
+    int count;
+    uint64_t name;
+    uint64_t sourceHash;
+};
+
+// KHR_parallel_shader_compile and the ARB version share their enums and entry point
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (APIENTRY* MaxShaderCompilerThreadsProc)(GLuint count);
+
+namespace
+{
+    bool sBatching = false;
+    std::vector<PendingProgram> sPendingPrograms;
+}
+
+GLuint buildProgram(const ShaderStage* stages, int count, uint64_t name);
+void finishProgram(const PendingProgram& pending);
 void checkCompileErrors(GLuint shader, std::string type);
+std::string addDefines(const std::string& source, const std::vector<std::string>& defines);
 
-Shader::Shader(const char* vertexShaderPath, const char* fragmentShaderPath, const char* geometryPath)
+Shader::Shader(const char* vertexShaderPath, const char* fragmentShaderPath, const char* geometryPath, const std::vector<std::string>& defines)
 {
     // 1. retrieve the vertex/fragment source code from filePath
     std::string vertexShaderCodeString;
@@ -30,8 +72,8 @@ Shader::Shader(const char* vertexShaderPath, const char* fragmentShaderPath, con
         vShaderFile.close();
         fShaderFile.close();
         // convert stream into string
-        vertexShaderCodeString = vShaderStream.str();
-        fragmentShaderCodeString = fShaderStream.str();
+        vertexShaderCodeString = addDefines(vShaderStream.str(), defines);
+        fragmentShaderCodeString = addDefines(fShaderStream.str(), defines);
 
         if (geometryPath != nullptr)
         {
@@ -39,7 +81,7 @@ Shader::Shader(const char* vertexShaderPath, const char* fragmentShaderPath, con
             std::stringstream gShaderStream;
             gShaderStream << gShaderFile.rdbuf();
             gShaderFile.close();
-            geometryShaderCodeString = gShaderStream.str();
+            geometryShaderCodeString = addDefines(gShaderStream.str(), defines);
         }
     }
     catch (std::ifstream::failure& e)
@@ -47,73 +89,295 @@ Shader::Shader(const char* vertexShaderPath, const char* fragmentShaderPath, con
         std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
     }
 
-    GLuint vertexShader, fragmentShader;
+    uint64_t name = ShaderCache::Hash(vertexShaderPath);
+    name = ShaderCache::Hash(fragmentShaderPath, name);
+    if (geometryPath != nullptr)
+        name = ShaderCache::Hash(geometryPath, name);
+    for (const std::string& define : defines)
+        name = ShaderCache::Hash(define, name);
+
+    ShaderStage stages[] = {
+        { GL_VERTEX_SHADER, "VERTEX", &vertexShaderCodeString },
+        { GL_FRAGMENT_SHADER, "FRAGMENT", &fragmentShaderCodeString },
+        { GL_GEOMETRY_SHADER, "GEOMETRY", &geometryShaderCodeString }
+    };
+    mID = buildProgram(stages, geometryPath != nullptr ? 3 : 2, name);
+}
+
+Shader::Shader(const char* computeShaderPath)
+{
+    std::string computeShaderCodeString;
+    std::ifstream cShaderFile;
+    cShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    try
+    {
+        cShaderFile.open(computeShaderPath);
+        std::stringstream cShaderStream;
+        cShaderStream << cShaderFile.rdbuf();
+        cShaderFile.close();
+        computeShaderCodeString = cShaderStream.str();
+    }
+    catch (std::ifstream::failure& e)
+    {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
+    }
 
-    const GLchar* vertexShaderCode = vertexShaderCodeString.c_str();
-    const GLchar* fragmentShaderCode = fragmentShaderCodeString.c_str();
+    ShaderStage stage = { GL_COMPUTE_SHADER, "COMPUTE", &computeShaderCodeString };
+    mID = buildProgram(&stage, 1, ShaderCache::Hash(computeShaderPath));
+}
 
-    vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderCode, NULL);
-    glCompileShader(vertexShader);
-    checkCompileErrors(vertexShader, "VERTEX");
+Shader::~Shader()
+{
+    GLState::DeleteProgram(mID);
+}
 
-    fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderCode, NULL);
-    glCompileShader(fragmentShader);
-    checkCompileErrors(fragmentShader, "FRAGMENT");
+void Shader::Use()
+{
+    GLState::UseProgram(mID);
+}
 
-    unsigned int geometryShader;
-    if (geometryPath != nullptr)
+void Shader::SetVec2(std::string_view name, GLfloat v0, GLfloat v1)
+{
+    GLint location = GetLocation(name);
+    GLfloat value[2] = { v0, v1 };
+    if (Changed(location, value, sizeof(value)))
+        glUniform2f(location, v0, v1);
+}
+
+void Shader::SetVec3(std::string_view name, GLfloat v0, GLfloat v1, GLfloat v2)
+{
+    SetVec3(name, glm::vec3(v0, v1, v2));
+}
+
+void Shader::SetVec3(std::string_view name, glm::vec3 value)
+{
+    SetVec3(GetLocation(name), value);
+}
+
+void Shader::SetVec3(GLint location, glm::vec3 value)
+{
+    if (Changed(location, &value[0], sizeof(value)))
+        glUniform3fv(location, 1, &value[0]);
+}
+
+void Shader::SetVec4(std::string_view name, glm::vec4 value)
+{
+    GLint location = GetLocation(name);
+    if (Changed(location, &value[0], sizeof(value)))
+        glUniform4fv(location, 1, &value[0]);
+}
+
+void Shader::SetFloat(std::string_view name, GLfloat value)
+{
+    SetFloat(GetLocation(name), value);
+}
+
+void Shader::SetFloat(GLint location, GLfloat value)
+{
+    if (Changed(location, &value, sizeof(value)))
+        glUniform1f(location, value);
+}
+
+void Shader::SetFloatArray(std::string_view name, const GLfloat* values, GLsizei count)
+{
+    // Arrays aren't cached, they are only set when something changed anyway
+    GetUniformStats().writes++;
+    glUniform1fv(GetLocation(name), count, values);
+}
+
+void Shader::SetInt(std::string_view name, GLint value)
+{
+    SetInt(GetLocation(name), value);
+}
+
+void Shader::SetInt(GLint location, GLint value)
+{
+    if (Changed(location, &value, sizeof(value)))
+        glUniform1i(location, value);
+}
+
+void Shader::SetMat4(std::string_view name, const glm::mat4& mat)
+{
+    SetMat4(GetLocation(name), mat);
+}
+
+void Shader::SetMat4(GLint location, const glm::mat4& mat)
+{
+    if (Changed(location, glm::value_ptr(mat), sizeof(mat)))
+        glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(mat));
+}
+
+void Shader::SetUniformBlockBinding(const std::string& name, GLuint bindingPoint)
+{
+    GLuint blockIndex = glGetUniformBlockIndex(mID, name.c_str());
+    if (blockIndex != GL_INVALID_INDEX)
+        glUniformBlockBinding(mID, blockIndex, bindingPoint);
+}
+
+Shader::UniformStats& Shader::GetUniformStats()
+{
+    static UniformStats stats;
+    return stats;
+}
+
+void Shader::BeginBatch()
+{
+    sBatching = true;
+
+    BuildStats& stats = GetBuildStats();
+    if (stats.parallelCompile)
+        return;
+
+    MaxShaderCompilerThreadsProc maxShaderCompilerThreads = nullptr;
+    if (glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+        maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+    else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+        maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+
+    // As many threads as the driver wants to use
+    if (maxShaderCompilerThreads)
     {
-        const char* gShaderCode = geometryShaderCodeString.c_str();
-        geometryShader = glCreateShader(GL_GEOMETRY_SHADER);
-        glShaderSource(geometryShader, 1, &gShaderCode, NULL);
-        glCompileShader(geometryShader);
-        checkCompileErrors(geometryShader, "GEOMETRY");
+        maxShaderCompilerThreads(0xFFFFFFFF);
+        stats.parallelCompile = true;
     }
-    
-    mID = glCreateProgram();
-    glAttachShader(mID, vertexShader);
-    glAttachShader(mID, fragmentShader);
-    if (geometryPath != nullptr)
-        glAttachShader(mID, geometryShader);
-    glLinkProgram(mID);
-    checkCompileErrors(mID, "PROGRAM");
+}
 
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-    if (geometryPath != nullptr)
-        glDeleteShader(geometryShader);
+int Shader::PollBatch()
+{
+    // Without the extension asking for completion would wait, EndBatch does that
+    if (!GetBuildStats().parallelCompile)
+        return static_cast<int>(sPendingPrograms.size());
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < sPendingPrograms.size();)
+    {
+        GLint completed = GL_FALSE;
+        glGetProgramiv(sPendingPrograms[i].program, GL_COMPLETION_STATUS_KHR, &completed);
+        if (completed)
+        {
+            finishProgram(sPendingPrograms[i]);
+            sPendingPrograms[i] = sPendingPrograms.back();
+            sPendingPrograms.pop_back();
+        }
+        else
+        {
+            i++;
+        }
+    }
+    GetBuildStats().milliseconds += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<int>(sPendingPrograms.size());
 }
 
-void Shader::Use()
+void Shader::EndBatch()
 {
-    glUseProgram(mID);
+    auto start = std::chrono::steady_clock::now();
+    for (const PendingProgram& pending : sPendingPrograms)
+        finishProgram(pending);
+    sPendingPrograms.clear();
+    sBatching = false;
+    GetBuildStats().milliseconds += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
 }
 
-void Shader::SetVec3(const std::string& name, GLfloat v0, GLfloat v1, GLfloat v2)
+Shader::BuildStats& Shader::GetBuildStats()
 {
-    glUniform3f(glGetUniformLocation(mID, name.c_str()), v0, v1, v2);
+    static BuildStats stats;
+    return stats;
 }
 
-void Shader::SetVec3(const std::string& name, glm::vec3 value)
+GLint Shader::GetUniformLocation(std::string_view name)
 {
-    glUniform3fv(glGetUniformLocation(mID, name.c_str()), 1, &value[0]);
+    return GetLocation(name);
 }
 
-void Shader::SetFloat(const std::string& name, GLfloat value)
+GLint Shader::GetLocation(std::string_view name)
 {
-    glUniform1f(glGetUniformLocation(mID, name.c_str()), value);
+    auto it = mLocations.find(name);
+    if (it != mLocations.end())
+        return it->second;
+
+    const std::string& storedName = mLocationNames.emplace_back(name);
+    GLint location = glGetUniformLocation(mID, storedName.c_str());
+    mLocations[storedName] = location;
+    return location;
+}
+
+bool Shader::Changed(GLint location, const void* data, size_t size)
+{
+    // Not an active uniform, the write would be ignored anyway
+    if (location == -1)
+        return false;
+
+    auto it = mValues.find(location);
+    if (it != mValues.end() && std::memcmp(it->second.data(), data, size) == 0)
+    {
+        GetUniformStats().redundantWrites++;
+        return false;
+    }
+
+    std::memcpy(mValues[location].data(), data, size);
+    GetUniformStats().writes++;
+    return true;
 }
 
-void Shader::SetInt(const std::string& name, GLint value)
+// name identifies the program across launches, the cached binary is only used if it was built from the same sources
+GLuint buildProgram(const ShaderStage* stages, int count, uint64_t name)
 {
-    glUniform1i(glGetUniformLocation(mID, name.c_str()), value);
+    auto start = std::chrono::steady_clock::now();
+    Shader::BuildStats& stats = Shader::GetBuildStats();
+    stats.programs++;
+
+    uint64_t sourceHash = ShaderCache::HASH_SEED;
+    for (int i = 0; i < count; i++)
+        sourceHash = ShaderCache::Hash(*stages[i].source, sourceHash);
+
+    GLuint program = ShaderCache::Load(name, sourceHash);
+    if (program != 0)
+    {
+        stats.cachedPrograms++;
+    }
+    else
+    {
+        // No status is queried here, that would wait for the driver to finish. finishProgram checks later
+        PendingProgram pending = {};
+        pending.count = count;
+        pending.name = name;
+        pending.sourceHash = sourceHash;
+        for (int i = 0; i < count; i++)
+        {
+            const GLchar* code = stages[i].source->c_str();
+            pending.shaders[i] = glCreateShader(stages[i].type);
+            pending.typeNames[i] = stages[i].typeName;
+            glShaderSource(pending.shaders[i], 1, &code, NULL);
+            glCompileShader(pending.shaders[i]);
+        }
+
+        program = glCreateProgram();
+        pending.program = program;
+        for (int i = 0; i < count; i++)
+            glAttachShader(program, pending.shaders[i]);
+        ShaderCache::PrepareForStore(program);
+        glLinkProgram(program);
+
+        if (sBatching)
+            sPendingPrograms.push_back(pending);
+        else
+            finishProgram(pending);
+    }
+
+    stats.milliseconds += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return program;
 }
 
-void Shader::SetMat4(const std::string& name, const glm::mat4& mat)
+void finishProgram(const PendingProgram& pending)
 {
-    glUniformMatrix4fv(glGetUniformLocation(mID, name.c_str()), 1, GL_FALSE, glm::value_ptr(mat));
+    for (int i = 0; i < pending.count; i++)
+        checkCompileErrors(pending.shaders[i], pending.typeNames[i]);
+    checkCompileErrors(pending.program, "PROGRAM");
+
+    for (int i = 0; i < pending.count; i++)
+        glDeleteShader(pending.shaders[i]);
+
+    ShaderCache::Store(pending.name, pending.sourceHash, pending.program);
 }
 
 void checkCompileErrors(GLuint shader, std::string type)
@@ -139,3 +403,18 @@ void checkCompileErrors(GLuint shader, std::string type)
         }
     }
 }
+
+std::string addDefines(const std::string& source, const std::vector<std::string>& defines)
+{
+    if (defines.empty())
+        return source;
+
+    // #version has to stay the first line
+    size_t lineEnd = source.find('\n', source.find("#version"));
+    std::string definesCode;
+    for (const std::string& define : defines)
+        definesCode += "#define " + define + "\n";
+    if (lineEnd == std::string::npos)
+        return source + "\n" + definesCode;
+    return source.substr(0, lineEnd + 1) + definesCode + source.substr(lineEnd + 1);
+}
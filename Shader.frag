@@ -2,8 +2,13 @@
 
 in vec3 Color;
 
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec2 Velocity;
+
+in vec4 CurrClipPos;
+in vec4 PrevClipPos;
 
 void main() {
 	FragColor = vec4(Color, 1.0f);
+	Velocity = 0.5 * (CurrClipPos.xy / CurrClipPos.w - PrevClipPos.xy / PrevClipPos.w);
 }
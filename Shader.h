@@ -7,20 +7,76 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <deque>
+#include <unordered_map>
+#include <array>
+#include <vector>
 
 class Shader
 {
 public:
-	Shader(const char* vertexShaderPath, const char* fragmentShaderPath, const char* geometryShaderPath = nullptr);
+	// Each define is added as "#define <define>" right after the #version line of every stage
+	Shader(const char* vertexShaderPath, const char* fragmentShaderPath, const char* geometryShaderPath = nullptr,
+		const std::vector<std::string>& defines = {});
+	explicit Shader(const char* computeShaderPath);
+	~Shader();
 	void Use();
 
-	void SetVec3(const std::string& name, GLfloat v0, GLfloat v1, GLfloat v2);
-	void SetVec3(const std::string& name, glm::vec3 value);
-	void SetFloat(const std::string& name, GLfloat value);
-	void SetInt(const std::string& name, GLint value);
-	void SetMat4(const std::string& name, const glm::mat4& mat);
+	void SetVec2(std::string_view name, GLfloat v0, GLfloat v1);
+	void SetVec3(std::string_view name, GLfloat v0, GLfloat v1, GLfloat v2);
+	void SetVec3(std::string_view name, glm::vec3 value);
+	void SetVec4(std::string_view name, glm::vec4 value);
+	void SetFloat(std::string_view name, GLfloat value);
+	void SetFloatArray(std::string_view name, const GLfloat* values, GLsizei count);
+	void SetInt(std::string_view name, GLint value);
+	void SetMat4(std::string_view name, const glm::mat4& mat);
+	void SetUniformBlockBinding(const std::string& name, GLuint bindingPoint);
+
+	// By a location looked up beforehand, -1 if the uniform isn't active. Same caching as the setters by name
+	GLint GetUniformLocation(std::string_view name);
+	void SetVec3(GLint location, glm::vec3 value);
+	void SetFloat(GLint location, GLfloat value);
+	void SetInt(GLint location, GLint value);
+	void SetMat4(GLint location, const glm::mat4& mat);
+
+	// Uniform writes of all shaders, and how many were skipped because the uniform already held the value
+	struct UniformStats {
+		int writes = 0;
+		int redundantWrites = 0;
+	};
+	static UniformStats& GetUniformStats();
+
+	// Programs created so far, how many came from the ShaderCache, and the time spent compiling, linking or loading them.
+	// With a batch open the time is only what the main thread spent submitting and waiting
+	struct BuildStats {
+		int programs = 0;
+		int cachedPrograms = 0;
+		float milliseconds = 0.0f;
+		bool parallelCompile = false;
+	};
+	static BuildStats& GetBuildStats();
+
+	// Between BeginBatch and EndBatch, shaders are compiled and linked without checking the result, so the
+	// driver can build them in the background (on its own threads with KHR_parallel_shader_compile) while
+	// loading carries on. Errors are reported and binaries cached once a program is finished: by PollBatch
+	// for those done, which returns how many are left, or by EndBatch, which waits for all.
+	// Programs can be used right away, GL waits for the ones still building. Shaders must outlive the batch
+	static void BeginBatch();
+	static int PollBatch();
+	static void EndBatch();
 
 private:
+	GLint GetLocation(std::string_view name);
+
+	// False if the uniform already holds these bytes. Uniform values belong to the program,
+	// so the cache stays right no matter which program is bound in between
+	bool Changed(GLint location, const void* data, size_t size);
+
 	GLuint mID;
+	// Keys point into mLocationNames, so looking a name up never builds a std::string
+	std::unordered_map<std::string_view, GLint> mLocations;
+	std::deque<std::string> mLocationNames;
+	std::unordered_map<GLint, std::array<unsigned char, sizeof(glm::mat4)>> mValues;
 };
 
@@ -4,12 +4,24 @@ layout (location = 1) in vec2 aTexCoord;
 
 out vec3 Color;
 
+// Must match the depth pre-pass exactly
+invariant gl_Position;
+
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 proj;
 
 uniform float time;
 
+layout(std140) uniform MotionVectors {
+	mat4 currViewProj;
+	mat4 prevViewProj;
+};
+uniform mat4 prevModel;
+
+out vec4 CurrClipPos;
+out vec4 PrevClipPos;
+
 void main() {
 	
 	float t = sin(time);
@@ -19,4 +31,6 @@ void main() {
 	Color.b = ((aPos.z * t + aPos.x * (1-t)) - (-0.5));
 
 	gl_Position = proj * view * model * vec4(aPos, 1.0);
+	CurrClipPos = currViewProj * model * vec4(aPos, 1.0);
+	PrevClipPos = prevViewProj * prevModel * vec4(aPos, 1.0);
 }
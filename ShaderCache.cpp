@@ -0,0 +1,165 @@
+#include "ShaderCache.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// Bump whenever the file layout changes
+const uint32_t CACHE_VERSION = 1;
+
+namespace {
+	struct FileHeader {
+		char magic[4];
+		uint32_t version;
+		uint64_t driverHash;
+		uint64_t sourceHash;
+		uint32_t format;
+		uint32_t length;
+	};
+
+	bool sEnabled = false;
+	std::string sDirectory;
+	uint64_t sDriverHash = 0;
+
+	FileHeader MakeHeader(uint64_t sourceHash) {
+		FileHeader header = {};
+		std::memcpy(header.magic, "PBIN", 4);
+		header.version = CACHE_VERSION;
+		header.driverHash = sDriverHash;
+		header.sourceHash = sourceHash;
+		return header;
+	}
+
+	std::string_view GetString(GLenum name) {
+		const char* string = reinterpret_cast<const char*>(glGetString(name));
+		return string ? std::string_view(string) : std::string_view();
+	}
+}
+
+void ShaderCache::Init(const std::string& directory) {
+	sDirectory = directory;
+
+	GLint formats = 0;
+	if (GLAD_GL_VERSION_4_1) {
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	}
+	sEnabled = formats > 0;
+	if (!sEnabled) {
+		std::cout << "Program binaries aren't supported, shaders are compiled every launch." << '\n';
+		return;
+	}
+
+	// A driver update can change what binaries it accepts without failing glProgramBinary
+	sDriverHash = Hash(GetString(GL_VENDOR));
+	sDriverHash = Hash(GetString(GL_RENDERER), sDriverHash);
+	sDriverHash = Hash(GetString(GL_VERSION), sDriverHash);
+	sDriverHash = Hash(GetString(GL_SHADING_LANGUAGE_VERSION), sDriverHash);
+
+	std::error_code error;
+	std::filesystem::create_directories(sDirectory, error);
+}
+
+bool ShaderCache::IsEnabled() {
+	return sEnabled;
+}
+
+uint64_t ShaderCache::Hash(std::string_view data, uint64_t seed) {
+	const uint64_t PRIME = 1099511628211ull;
+	uint64_t hash = seed;
+	uint64_t size = data.size();
+	for (int i = 0; i < 8; i++) {
+		hash = (hash ^ ((size >> (i * 8)) & 0xFF)) * PRIME;
+	}
+	for (char c : data) {
+		hash = (hash ^ static_cast<unsigned char>(c)) * PRIME;
+	}
+	return hash;
+}
+
+GLuint ShaderCache::Load(uint64_t name, uint64_t sourceHash) {
+	if (!sEnabled) {
+		return 0;
+	}
+
+	std::ifstream file(GetPath(name), std::ios::binary);
+	if (!file.is_open()) {
+		return 0;
+	}
+
+	FileHeader header, expected = MakeHeader(sourceHash);
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || std::memcmp(&header, &expected, offsetof(FileHeader, format)) != 0) {
+		return 0;
+	}
+
+	std::vector<char> binary(header.length);
+	file.read(binary.data(), binary.size());
+	if (!file) {
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+
+	// Rejected, e.g. by a driver that reports the same strings. The caller compiles and replaces the file
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked) {
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+void ShaderCache::PrepareForStore(GLuint program) {
+	if (sEnabled) {
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+}
+
+void ShaderCache::Store(uint64_t name, uint64_t sourceHash, GLuint program) {
+	if (!sEnabled) {
+		return;
+	}
+
+	GLint linked = GL_FALSE, length = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (!linked || length <= 0) {
+		return;
+	}
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+
+	FileHeader header = MakeHeader(sourceHash);
+	header.format = format;
+	header.length = static_cast<uint32_t>(length);
+
+	// Written to a temporary and renamed, so a crash mid-write never leaves a truncated binary behind
+	std::string path = GetPath(name);
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary);
+		if (!file.is_open()) {
+			std::cout << "Failed to write program binary " << path << '\n';
+			return;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(binary.data(), length);
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, path, error);
+}
+
+std::string ShaderCache::GetPath(uint64_t name) {
+	char fileName[32];
+	std::snprintf(fileName, sizeof(fileName), "%016llx.bin", static_cast<unsigned long long>(name));
+	return sDirectory + "/" + fileName;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Linked program binaries on disk (glGetProgramBinary), so later launches skip compiling and linking GLSL.
+// Each program has one file, named by a hash of what it's built from (stage paths and defines). The file
+// also stores a hash of the final sources and one of the driver (vendor, renderer, version), and is only
+// used while both still match; otherwise the program is compiled and the file replaced.
+// Off without GL 4.1 or when the driver offers no binary formats
+class ShaderCache
+{
+public:
+	static const uint64_t HASH_SEED = 14695981039346656037ull;
+
+	// Call once the context is current, before any Shader is created
+	static void Init(const std::string& directory);
+	static bool IsEnabled();
+
+	// FNV-1a over the size and the bytes, chained through seed
+	static uint64_t Hash(std::string_view data, uint64_t seed = HASH_SEED);
+
+	// A linked program, or 0 if there is no usable binary and the program has to be compiled
+	static GLuint Load(uint64_t name, uint64_t sourceHash);
+
+	// Set on a program before linking it, or the driver may not keep a binary to hand out
+	static void PrepareForStore(GLuint program);
+	static void Store(uint64_t name, uint64_t sourceHash, GLuint program);
+
+private:
+	static std::string GetPath(uint64_t name);
+};
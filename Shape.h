@@ -12,6 +12,7 @@
 #include "Texture.h"
 #include "AudioPlayer.h"
 #include "ResourceManager.h"
+#include "ObjectPool.h"
 
 enum class ShapeShading {
 	GLOWY,
@@ -21,7 +22,7 @@ enum class ShapeShading {
 	NUM
 };
 
-struct Material {
+struct Material : Pooled<Material> {
 	glm::vec3 ambient;
 	glm::vec3 diffuse;
 	glm::vec3 specular;
@@ -31,7 +32,7 @@ struct Material {
 		: ambient(_ambient), diffuse(_diffuse), specular(_specular), shininess(_shininess) {}
 };
 
-struct MaterialPBR {
+struct MaterialPBR : Pooled<MaterialPBR> {
 	glm::vec3 albedo;
 	float metalness;
 	float roughness;
@@ -44,7 +45,7 @@ struct MaterialPBR {
 		//texturePack(_texturePack), texturePackEnabled(_enabled) {}
 };
 
-struct Transform {
+struct Transform : Pooled<Transform> {
 	glm::vec3 position;
 	glm::vec3 scale;
 	glm::vec3 rotation;
@@ -53,7 +54,8 @@ struct Transform {
 		: position(_position), scale(_scale), rotation(_rotation){}
 };
 
-class Shape
+// Shapes and their components come from slabs, see ObjectPool
+class Shape : public Pooled<Shape>
 {
 public:
 	Shape(ResourceManager* pResourceManager, ShapeShading shading, std::string shape = "Sphere") {
@@ -85,5 +87,8 @@ public:
 	std::string mShape;
 
 	bool mIsSelected = false;
+
+	// Entry in the renderer's TransformSystem, set when the shape is added
+	unsigned int mTransformHandle = 0;
 };
 
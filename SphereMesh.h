@@ -5,10 +5,14 @@
 
 #include <glm/glm.hpp>
 
+#include "GLState.h"
+#include "MemoryTracker.h"
+
 class SphereMesh {
 
 public:
 	SphereMesh(): mVAO(0), mVBO(0), mIBO(0), mIndexCount(0) {
+        MemoryScope memoryScope(MemoryCategory::MESHES);
 
         glGenVertexArrays(1, &mVAO);
 
@@ -151,11 +155,13 @@ public:
                 mVertexData.push_back(bitangents[i].z);
             }
         }
-        glBindVertexArray(mVAO);
+        GLState::BindVertexArray(mVAO);
         glBindBuffer(GL_ARRAY_BUFFER, mVBO);
         glBufferData(GL_ARRAY_BUFFER, mVertexData.size() * sizeof(float), &mVertexData[0], GL_STATIC_DRAW);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, mIndices.size() * sizeof(unsigned int), &mIndices[0], GL_STATIC_DRAW);
+        MemoryTracker::TrackGPU(GPUObject::BUFFER, mVBO, mVertexData.size() * sizeof(float));
+        MemoryTracker::TrackGPU(GPUObject::BUFFER, mIBO, mIndices.size() * sizeof(unsigned int));
         unsigned int stride = (3 + 2 + 3 + 3 + 3) * sizeof(float);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
@@ -173,8 +179,43 @@ public:
 		return static_cast<unsigned int>(mIndices.size());
 	}
 
+	~SphereMesh() {
+		GLState::DeleteVertexArrays(1, &mVAO);
+		GLState::DeleteBuffers(1, &mVBO);
+		GLState::DeleteBuffers(1, &mIBO);
+	}
+
 	void BindVAO() {
-		glBindVertexArray(mVAO);
+		GLState::BindVertexArray(mVAO);
+	}
+
+	// Positions as read by the VAO, for the merged geometry of the indirect path
+	std::vector<glm::vec3> GetPositions() {
+		const size_t stride = 3 + 2 + 3 + 3 + 3;
+		std::vector<glm::vec3> positions;
+		for (size_t i = 0; i + 2 < mVertexData.size(); i += stride) {
+			positions.push_back(glm::vec3(mVertexData[i], mVertexData[i + 1], mVertexData[i + 2]));
+		}
+		return positions;
+	}
+
+	// The strip as a triangle list. Every other strip triangle has its first two vertices swapped,
+	// exactly as GL assembles them, so both draw bit-identical depth. Degenerate triangles are dropped
+	std::vector<GLuint> GetTriangleIndices() {
+		std::vector<GLuint> triangles;
+		for (size_t i = 0; i + 2 < mIndices.size(); i++) {
+			GLuint a = mIndices[i], b = mIndices[i + 1], c = mIndices[i + 2];
+			if (a == b || b == c || a == c) {
+				continue;
+			}
+			if (i % 2 == 0) {
+				triangles.insert(triangles.end(), { a, b, c });
+			}
+			else {
+				triangles.insert(triangles.end(), { b, a, c });
+			}
+		}
+		return triangles;
 	}
 
 private:
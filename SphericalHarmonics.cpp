@@ -0,0 +1,162 @@
+#include "SphericalHarmonics.h"
+
+#include <thread>
+#include <array>
+#include <algorithm>
+#include <vector>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SH_USE_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+	const float PI = 3.14159265359f;
+
+	// Normalization constants of the real SH basis up to band 2
+	const float SH_Y00 = 0.282095f;
+	const float SH_Y1 = 0.488603f;
+	const float SH_Y2 = 1.092548f;
+	const float SH_Y20 = 0.315392f;
+	const float SH_Y22 = 0.546274f;
+
+	// Clamped cosine convolution per band (PI, 2PI/3, PI/4) divided by PI for the Lambert BRDF
+	const float SH_BAND_SCALE[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+
+	void EvaluateBasis(float x, float y, float z, float basis[9]) {
+		basis[0] = SH_Y00;
+		basis[1] = SH_Y1 * y;
+		basis[2] = SH_Y1 * z;
+		basis[3] = SH_Y1 * x;
+		basis[4] = SH_Y2 * x * y;
+		basis[5] = SH_Y2 * y * z;
+		basis[6] = SH_Y20 * (3.0f * z * z - 1.0f);
+		basis[7] = SH_Y2 * x * z;
+		basis[8] = SH_Y22 * (x * x - y * y);
+	}
+
+	// Accumulates rows [rowBegin, rowEnd) into sums (9 coefficients * RGB)
+	void ProjectRows(const float* data, int width, int height, int channels, const std::vector<float>& cosPhi,
+		const std::vector<float>& sinPhi, int rowBegin, int rowEnd, double sums[27]) {
+
+		// Every texel in a row covers the same solid angle
+		const float texelArea = (2.0f * PI / width) * (PI / height);
+
+		for (int row = rowBegin; row < rowEnd; ++row) {
+			float latitude = ((row + 0.5f) / height - 0.5f) * PI;
+			float y = std::sin(latitude);
+			float cosLatitude = std::cos(latitude);
+			const float* rowData = data + static_cast<size_t>(row) * width * channels;
+
+			float rowSums[27] = {};
+			int col = 0;
+
+#ifdef SH_USE_SSE
+			__m128 acc[27];
+			for (int i = 0; i < 27; ++i) {
+				acc[i] = _mm_setzero_ps();
+			}
+
+			const __m128 vY = _mm_set1_ps(y);
+			const __m128 vCosLatitude = _mm_set1_ps(cosLatitude);
+			for (; col + 4 <= width; col += 4) {
+				const float* p = rowData + col * channels;
+				__m128 r = _mm_setr_ps(p[0], p[channels], p[2 * channels], p[3 * channels]);
+				__m128 g = _mm_setr_ps(p[1], p[channels + 1], p[2 * channels + 1], p[3 * channels + 1]);
+				__m128 b = _mm_setr_ps(p[2], p[channels + 2], p[2 * channels + 2], p[3 * channels + 2]);
+
+				__m128 x = _mm_mul_ps(vCosLatitude, _mm_loadu_ps(&cosPhi[col]));
+				__m128 z = _mm_mul_ps(vCosLatitude, _mm_loadu_ps(&sinPhi[col]));
+
+				__m128 basis[9];
+				basis[0] = _mm_set1_ps(SH_Y00);
+				basis[1] = _mm_mul_ps(_mm_set1_ps(SH_Y1), vY);
+				basis[2] = _mm_mul_ps(_mm_set1_ps(SH_Y1), z);
+				basis[3] = _mm_mul_ps(_mm_set1_ps(SH_Y1), x);
+				basis[4] = _mm_mul_ps(_mm_set1_ps(SH_Y2), _mm_mul_ps(x, vY));
+				basis[5] = _mm_mul_ps(_mm_set1_ps(SH_Y2), _mm_mul_ps(vY, z));
+				basis[6] = _mm_mul_ps(_mm_set1_ps(SH_Y20), _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3.0f), _mm_mul_ps(z, z)), _mm_set1_ps(1.0f)));
+				basis[7] = _mm_mul_ps(_mm_set1_ps(SH_Y2), _mm_mul_ps(x, z));
+				basis[8] = _mm_mul_ps(_mm_set1_ps(SH_Y22), _mm_sub_ps(_mm_mul_ps(x, x), _mm_mul_ps(vY, vY)));
+
+				for (int i = 0; i < 9; ++i) {
+					acc[i * 3 + 0] = _mm_add_ps(acc[i * 3 + 0], _mm_mul_ps(r, basis[i]));
+					acc[i * 3 + 1] = _mm_add_ps(acc[i * 3 + 1], _mm_mul_ps(g, basis[i]));
+					acc[i * 3 + 2] = _mm_add_ps(acc[i * 3 + 2], _mm_mul_ps(b, basis[i]));
+				}
+			}
+
+			for (int i = 0; i < 27; ++i) {
+				float lanes[4];
+				_mm_storeu_ps(lanes, acc[i]);
+				rowSums[i] = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+			}
+#endif
+
+			// Scalar tail, or the whole row without SSE
+			for (; col < width; ++col) {
+				const float* p = rowData + col * channels;
+				float basis[9];
+				EvaluateBasis(cosLatitude * cosPhi[col], y, cosLatitude * sinPhi[col], basis);
+				for (int i = 0; i < 9; ++i) {
+					rowSums[i * 3 + 0] += p[0] * basis[i];
+					rowSums[i * 3 + 1] += p[1] * basis[i];
+					rowSums[i * 3 + 2] += p[2] * basis[i];
+				}
+			}
+
+			// Texels shrink towards the poles
+			double rowWeight = static_cast<double>(texelArea * cosLatitude);
+			for (int i = 0; i < 27; ++i) {
+				sums[i] += rowSums[i] * rowWeight;
+			}
+		}
+	}
+}
+
+SHIrradiance SphericalHarmonics::ProjectIrradiance(const float* data, int width, int height, int channels) {
+	SHIrradiance result = {};
+	if (!data || width <= 0 || height <= 0 || channels < 3) {
+		return result;
+	}
+
+	// Longitude only depends on the column, matching SampleSphericalMap in EquiRecToCubemap.frag
+	std::vector<float> cosPhi(width), sinPhi(width);
+	for (int col = 0; col < width; ++col) {
+		float phi = ((col + 0.5f) / width - 0.5f) * 2.0f * PI;
+		cosPhi[col] = std::cos(phi);
+		sinPhi[col] = std::sin(phi);
+	}
+
+	int threadCount = static_cast<int>(std::thread::hardware_concurrency());
+	threadCount = std::max(1, std::min(threadCount, height));
+	std::vector<std::array<double, 27>> threadSums(threadCount);
+	std::vector<std::thread> threads;
+
+	int rowsPerThread = (height + threadCount - 1) / threadCount;
+	for (int t = 0; t < threadCount; ++t) {
+		int rowBegin = t * rowsPerThread;
+		int rowEnd = std::min(height, rowBegin + rowsPerThread);
+		threadSums[t].fill(0.0);
+		threads.emplace_back(ProjectRows, data, width, height, channels, std::cref(cosPhi), std::cref(sinPhi),
+			rowBegin, rowEnd, threadSums[t].data());
+	}
+
+	double sums[27] = {};
+	for (int t = 0; t < threadCount; ++t) {
+		threads[t].join();
+		for (int i = 0; i < 27; ++i) {
+			sums[i] += threadSums[t][i];
+		}
+	}
+
+	for (int i = 0; i < 9; ++i) {
+		result.coefficients[i] = glm::vec4(
+			static_cast<float>(sums[i * 3 + 0]) * SH_BAND_SCALE[i],
+			static_cast<float>(sums[i * 3 + 1]) * SH_BAND_SCALE[i],
+			static_cast<float>(sums[i * 3 + 2]) * SH_BAND_SCALE[i],
+			0.0f);
+	}
+	return result;
+}
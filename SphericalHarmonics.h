@@ -0,0 +1,17 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Diffuse irradiance of an environment as 9 L2 spherical harmonics RGB coefficients.
+// Padded to vec4 so the array can be uploaded as-is to a std140 uniform block.
+// The cosine lobe convolution and the 1/PI of the Lambert BRDF are already folded in,
+// so shaders only need to evaluate the basis at the normal.
+struct SHIrradiance {
+	glm::vec4 coefficients[9];
+};
+
+namespace SphericalHarmonics {
+	// Projects an equirectangular RGB(A) float image (rows bottom to top, as loaded by stb with flipping on).
+	// Rows are split across threads and pixels within a row are processed four at a time with SSE
+	SHIrradiance ProjectIrradiance(const float* data, int width, int height, int channels);
+}
@@ -0,0 +1,79 @@
+#version 330 core
+out vec4 FragColor;
+
+// Temporal anti-aliasing resolve. The scene is rendered with a sub-pixel jitter that changes every frame,
+// this blends it with last frame's result reprojected through the velocity buffer. History is clamped
+// to the current 3x3 neighborhood, so disoccluded or changed pixels don't ghost
+uniform sampler2D currentTexture;
+uniform sampler2D historyTexture;
+uniform sampler2D velocityTexture;
+uniform sampler2D depthTexture;
+
+// Part of the targets the scene was rendered into, in pixels, and the part of the history holding last frame
+uniform vec2 renderSize;
+uniform vec2 historyUVScale;
+
+// Reprojects the sky, which has no velocity written
+uniform mat4 currToPrevClip;
+
+uniform float historyWeight;
+uniform bool historyValid;
+
+float Luma(vec3 color)
+{
+	return dot(color, vec3(0.299, 0.587, 0.114));
+}
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	vec2 uv = (vec2(pixel) + 0.5) / renderSize;
+
+	vec3 current = texelFetch(currentTexture, pixel, 0).rgb;
+	vec3 minColor = current;
+	vec3 maxColor = current;
+
+	// Velocity of the closest pixel around, so edges of moving objects carry their motion outwards
+	float closestDepth = texelFetch(depthTexture, pixel, 0).r;
+	ivec2 closestPixel = pixel;
+	for (int y = -1; y <= 1; y++) {
+		for (int x = -1; x <= 1; x++) {
+			ivec2 neighbour = clamp(pixel + ivec2(x, y), ivec2(0), ivec2(renderSize) - 1);
+			vec3 color = texelFetch(currentTexture, neighbour, 0).rgb;
+			minColor = min(minColor, color);
+			maxColor = max(maxColor, color);
+
+			float depth = texelFetch(depthTexture, neighbour, 0).r;
+			if (depth < closestDepth) {
+				closestDepth = depth;
+				closestPixel = neighbour;
+			}
+		}
+	}
+
+	vec2 velocity;
+	if (closestDepth < 1.0) {
+		velocity = texelFetch(velocityTexture, closestPixel, 0).rg;
+	}
+	else {
+		vec4 prevClip = currToPrevClip * vec4(uv * 2.0 - 1.0, 1.0, 1.0);
+		velocity = uv - (prevClip.xy / prevClip.w * 0.5 + 0.5);
+	}
+
+	vec2 prevUV = uv - velocity;
+	if (!historyValid || any(lessThan(prevUV, vec2(0.0))) || any(greaterThan(prevUV, vec2(1.0)))) {
+		FragColor = vec4(current, 1.0);
+		return;
+	}
+
+	vec2 historyTexel = 1.0 / vec2(textureSize(historyTexture, 0));
+	vec2 historyUV = clamp(prevUV * historyUVScale, 0.5 * historyTexel, historyUVScale - 0.5 * historyTexel);
+	vec3 history = clamp(texture(historyTexture, historyUV).rgb, minColor, maxColor);
+
+	// Weighting by inverse luma keeps single bright pixels from flickering through the blend
+	float currentWeight = (1.0 - historyWeight) / (1.0 + Luma(current));
+	float previousWeight = historyWeight / (1.0 + Luma(history));
+	vec3 color = (current * currentWeight + history * previousWeight) / (currentWeight + previousWeight);
+
+	FragColor = vec4(color, 1.0);
+}
@@ -1,5 +1,7 @@
 
 #include "Texture.h"
+#include "GLState.h"
+#include "MemoryTracker.h"
 #include <glad/glad.h>
 
 #include <string>
@@ -8,6 +10,7 @@
 #include <stb/stb_image.h>
 
 Texture::Texture(std::string path, std::string& type) {
+    MemoryScope memoryScope(MemoryCategory::TEXTURES);
 
     mType = type;
     mPath = path;
@@ -25,9 +28,10 @@ Texture::Texture(std::string path, std::string& type) {
             case 4: format = GL_RGBA; break;
         }
 
-        glBindTexture(GL_TEXTURE_2D, mID);
+        GLState::BindTexture(GL_TEXTURE_2D, mID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
+        MemoryTracker::TrackGPU(GPUObject::TEXTURE, mID, MemoryTracker::GetTextureBytes(format, width, height, 1, MemoryTracker::GetMipLevels(width, height)));
 
         // for this tutorial: use GL_CLAMP_TO_EDGE to prevent semi-transparent borders. Due to interpolation it takes texels from next repeat 
         //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
@@ -46,19 +50,23 @@ Texture::Texture(std::string path, std::string& type) {
     }
 }
 
+Texture::~Texture() {
+    GLState::DeleteTextures(1, &mID);
+}
+
 void Texture::Bind() {
-    glBindTexture(GL_TEXTURE_2D, mID);
+    GLState::BindTexture(GL_TEXTURE_2D, mID);
 }
 
 void Texture::Unbind() {
-    glBindTexture(GL_TEXTURE_2D, 0);
+    GLState::BindTexture(GL_TEXTURE_2D, 0);
 }
 
-std::string Texture::GetType() {
+const std::string& Texture::GetType() const {
     return mType;
 }
 
-std::string Texture::GetPath()
+const std::string& Texture::GetPath() const
 {
     return mPath;
 }
@@ -7,11 +7,14 @@ class Texture {
 
 public:
     Texture(std::string path, std::string& type);
+    ~Texture();
+    Texture(const Texture&) = delete;
+    Texture& operator=(const Texture&) = delete;
     void Bind();
     void Unbind();
 
-    std::string GetType();
-    std::string GetPath();
+    const std::string& GetType() const;
+    const std::string& GetPath() const;
 
 private:
     GLuint mID;
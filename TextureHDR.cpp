@@ -2,8 +2,11 @@
 #include <iostream>
 
 #include "TextureHDR.h"
+#include "GLState.h"
+#include "MemoryTracker.h"
 
-TextureHDR::TextureHDR(std::string path) : mID(0) {
+TextureHDR::TextureHDR(std::string path) : mID(0), mIrradianceSH() {
+	MemoryScope memoryScope(MemoryCategory::TEXTURES);
 
 	int width, height, nrComponents;
 	
@@ -11,12 +14,15 @@ TextureHDR::TextureHDR(std::string path) : mID(0) {
 
 	if (data) {
 		glGenTextures(1, &mID);
-		glBindTexture(GL_TEXTURE_2D, mID);
+		GLState::BindTexture(GL_TEXTURE_2D, mID);
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, data);
+		MemoryTracker::TrackGPU(GPUObject::TEXTURE, mID, MemoryTracker::GetTextureBytes(GL_RGB16F, width, height));
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		mIrradianceSH = SphericalHarmonics::ProjectIrradiance(data, width, height, nrComponents);
 		stbi_image_free(data);
 	}
 	else {
@@ -25,14 +31,24 @@ TextureHDR::TextureHDR(std::string path) : mID(0) {
 	}
 }
 
+TextureHDR::~TextureHDR() {
+	if (mID) {
+		GLState::DeleteTextures(1, &mID);
+	}
+}
+
 void TextureHDR::Bind() {
-	glBindTexture(GL_TEXTURE_2D, mID);
+	GLState::BindTexture(GL_TEXTURE_2D, mID);
 }
 
 void TextureHDR::Unbind() {
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLState::BindTexture(GL_TEXTURE_2D, 0);
 }
 
 GLuint TextureHDR::GetID() {
 	return mID;
 }
+
+const SHIrradiance& TextureHDR::GetIrradianceSH() {
+	return mIrradianceSH;
+}
@@ -3,16 +3,25 @@
 #include <string>
 #include <stb/stb_image.h>
 
+#include "SphericalHarmonics.h"
+
 class TextureHDR
 {
 public:
 	TextureHDR(std::string path);
+	~TextureHDR();
+	TextureHDR(const TextureHDR&) = delete;
+	TextureHDR& operator=(const TextureHDR&) = delete;
 	void Bind();
 	void Unbind();
 
 	GLuint GetID();
 
+	// Projected from the CPU-side pixels at load time, before they are freed
+	const SHIrradiance& GetIrradianceSH();
+
 private:
 	GLuint mID;
+	SHIrradiance mIrradianceSH;
 };
 
@@ -0,0 +1,320 @@
+#include "TransformSystem.h"
+#include "Shape.h"
+
+#include <atomic>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define TRANSFORM_SIMD
+#endif
+
+// Entries of a level a job checks and recomputes at once. Fewer run inline
+const size_t TRANSFORMS_PER_JOB = 512;
+
+TransformSystem::TransformSystem(JobSystem* pJobSystem) : mJobSystem(pJobSystem), mOrderDirty(false), mScaleOffset(0.0f) {}
+
+TransformSystem::Handle TransformSystem::Add(const Transform& transform, Handle parent) {
+	return AddEntry(transform, glm::mat4(1.0f), COMPOSED, parent);
+}
+
+TransformSystem::Handle TransformSystem::Add(const glm::mat4& local, Handle parent) {
+	return AddEntry(Transform(glm::vec3(0.0f), glm::vec3(1.0f), glm::vec3(0.0f)), local, 0, parent);
+}
+
+TransformSystem::Handle TransformSystem::AddEntry(const Transform& transform, const glm::mat4& local, uint8_t flags, Handle parent) {
+	Handle handle;
+	if (!mFreeHandles.empty()) {
+		handle = mFreeHandles.back();
+		mFreeHandles.pop_back();
+	}
+	else {
+		handle = static_cast<Handle>(mDenseIndices.size());
+		mDenseIndices.push_back(UINT_MAX);
+		mParentHandles.push_back(NO_PARENT);
+	}
+
+	// Appended for now, the next Update puts it in breadth-first order
+	mDenseIndices[handle] = static_cast<unsigned int>(mHandles.size());
+	mParentHandles[handle] = parent;
+	mHandles.push_back(handle);
+	mParents.push_back(parent == NO_PARENT ? -1 : static_cast<int>(mDenseIndices[parent]));
+	mTransforms.push_back(transform);
+	mLocal.push_back(local);
+	mWorld.emplace_back(1.0f);
+	mPrevWorld.emplace_back(1.0f);
+	mFlags.push_back(flags | DIRTY | NEW);
+
+	mOrderDirty = true;
+	mStats.entries++;
+	return handle;
+}
+
+void TransformSystem::Remove(Handle handle) {
+	for (Handle child = 0; child < mParentHandles.size(); child++) {
+		if (mParentHandles[child] == handle) {
+			mParentHandles[child] = NO_PARENT;
+			mFlags[mDenseIndices[child]] |= DIRTY;
+		}
+	}
+
+	// Left out of the arrays by the next Rebuild
+	mDenseIndices[handle] = UINT_MAX;
+	mParentHandles[handle] = NO_PARENT;
+	mFreeHandles.push_back(handle);
+
+	mOrderDirty = true;
+	mStats.entries--;
+}
+
+bool TransformSystem::SetParent(Handle handle, Handle parent) {
+	for (Handle ancestor = parent; ancestor != NO_PARENT; ancestor = mParentHandles[ancestor]) {
+		if (ancestor == handle) {
+			return false;
+		}
+	}
+
+	mParentHandles[handle] = parent;
+	mFlags[mDenseIndices[handle]] |= DIRTY;
+	mOrderDirty = true;
+	return true;
+}
+
+TransformSystem::Handle TransformSystem::GetParent(Handle handle) const {
+	return mParentHandles[handle];
+}
+
+void TransformSystem::SetLocal(Handle handle, const Transform& transform) {
+	unsigned int index = mDenseIndices[handle];
+	mTransforms[index] = transform;
+	mFlags[index] |= COMPOSED | DIRTY;
+}
+
+void TransformSystem::SetLocal(Handle handle, const glm::mat4& local) {
+	unsigned int index = mDenseIndices[handle];
+	mLocal[index] = local;
+	mFlags[index] = (mFlags[index] & ~COMPOSED) | DIRTY;
+}
+
+void TransformSystem::SetScaleOffset(float offset) {
+	if (offset == mScaleOffset) {
+		return;
+	}
+
+	mScaleOffset = offset;
+	for (uint8_t& flags : mFlags) {
+		if (flags & COMPOSED) {
+			flags |= DIRTY;
+		}
+	}
+}
+
+void TransformSystem::Rebuild() {
+	size_t handleCount = mDenseIndices.size();
+
+	// Children of every handle, bucketed by parent
+	std::vector<unsigned int> childStarts(handleCount + 1, 0);
+	for (Handle handle = 0; handle < handleCount; handle++) {
+		if (mDenseIndices[handle] != UINT_MAX && mParentHandles[handle] != NO_PARENT) {
+			childStarts[mParentHandles[handle] + 1]++;
+		}
+	}
+	for (size_t i = 0; i < handleCount; i++) {
+		childStarts[i + 1] += childStarts[i];
+	}
+	std::vector<Handle> children(childStarts[handleCount]);
+	std::vector<unsigned int> childEnds(childStarts.begin(), childStarts.end() - 1);
+	for (Handle handle = 0; handle < handleCount; handle++) {
+		if (mDenseIndices[handle] != UINT_MAX && mParentHandles[handle] != NO_PARENT) {
+			children[childEnds[mParentHandles[handle]]++] = handle;
+		}
+	}
+
+	// Breadth-first from the roots, a level at a time
+	std::vector<Handle> order;
+	order.reserve(mStats.entries);
+	for (Handle handle = 0; handle < handleCount; handle++) {
+		if (mDenseIndices[handle] != UINT_MAX && mParentHandles[handle] == NO_PARENT) {
+			order.push_back(handle);
+		}
+	}
+	mLevelStarts.clear();
+	for (size_t begin = 0; begin < order.size();) {
+		mLevelStarts.push_back(begin);
+		size_t end = order.size();
+		for (size_t i = begin; i < end; i++) {
+			order.insert(order.end(), children.begin() + childStarts[order[i]], children.begin() + childStarts[order[i] + 1]);
+		}
+		begin = end;
+	}
+	mLevelStarts.push_back(order.size());
+
+	std::vector<Transform> transforms;
+	std::vector<glm::mat4> local, world, prevWorld;
+	std::vector<uint8_t> flags;
+	transforms.reserve(order.size());
+	local.reserve(order.size());
+	world.reserve(order.size());
+	prevWorld.reserve(order.size());
+	flags.reserve(order.size());
+	for (Handle handle : order) {
+		unsigned int index = mDenseIndices[handle];
+		transforms.push_back(mTransforms[index]);
+		local.push_back(mLocal[index]);
+		world.push_back(mWorld[index]);
+		prevWorld.push_back(mPrevWorld[index]);
+		flags.push_back(mFlags[index]);
+	}
+	mTransforms.swap(transforms);
+	mLocal.swap(local);
+	mWorld.swap(world);
+	mPrevWorld.swap(prevWorld);
+	mFlags.swap(flags);
+
+	for (size_t i = 0; i < order.size(); i++) {
+		mDenseIndices[order[i]] = static_cast<unsigned int>(i);
+	}
+	mParents.resize(order.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		Handle parent = mParentHandles[order[i]];
+		mParents[i] = parent == NO_PARENT ? -1 : static_cast<int>(mDenseIndices[parent]);
+	}
+	mHandles.swap(order);
+
+	mStats.levels = static_cast<int>(mLevelStarts.size()) - 1;
+}
+
+void TransformSystem::Update() {
+	if (mOrderDirty) {
+		Rebuild();
+		mOrderDirty = false;
+	}
+
+	// Levels in order, so parents are done before their children read them
+	std::atomic<int> updated(0);
+	for (size_t level = 0; level + 1 < mLevelStarts.size(); level++) {
+		size_t first = mLevelStarts[level];
+		mJobSystem->ParallelFor(mLevelStarts[level + 1] - first, TRANSFORMS_PER_JOB, [&](size_t begin, size_t end) {
+			int count = 0;
+			for (size_t i = first + begin; i < first + end; i++) {
+				uint8_t flags = mFlags[i];
+				int parent = mParents[i];
+				bool parentChanged = parent >= 0 && (mFlags[parent] & CHANGED);
+				if (!(flags & DIRTY) && !parentChanged) {
+					// Moved last frame but not this one
+					if (flags & CHANGED) {
+						mPrevWorld[i] = mWorld[i];
+						mFlags[i] = flags & ~CHANGED;
+					}
+					continue;
+				}
+
+				if ((flags & DIRTY) && (flags & COMPOSED)) {
+					mLocal[i] = Compose(mTransforms[i], mScaleOffset);
+				}
+				mPrevWorld[i] = mWorld[i];
+				mWorld[i] = parent >= 0 ? Multiply(mWorld[parent], mLocal[i]) : mLocal[i];
+				if (flags & NEW) {
+					mPrevWorld[i] = mWorld[i];
+				}
+				mFlags[i] = (flags & COMPOSED) | CHANGED;
+				count++;
+			}
+			updated += count;
+		});
+	}
+	mStats.updated = updated.load();
+}
+
+const glm::mat4& TransformSystem::GetWorld(Handle handle) const {
+	return mWorld[mDenseIndices[handle]];
+}
+
+const glm::mat4& TransformSystem::GetPrevWorld(Handle handle) const {
+	return mPrevWorld[mDenseIndices[handle]];
+}
+
+const TransformSystem::Stats& TransformSystem::GetStats() const {
+	return mStats;
+}
+
+void TransformSystem::Capture(Snapshot& snapshot) const {
+	snapshot.indices = mDenseIndices;
+	snapshot.world = mWorld;
+	snapshot.prevWorld = mPrevWorld;
+}
+
+#ifdef TRANSFORM_SIMD
+// Columns of glm::rotate(glm::mat4(1.0f), angle, axis)
+static void AxisRotation(float angle, glm::vec3 axis, __m128 columns[4]) {
+	axis = glm::normalize(axis);
+	float c = std::cos(angle);
+	float s = std::sin(angle);
+	glm::vec3 t = (1.0f - c) * axis;
+
+	columns[0] = _mm_setr_ps(c + t.x * axis.x, t.x * axis.y + s * axis.z, t.x * axis.z - s * axis.y, 0.0f);
+	columns[1] = _mm_setr_ps(t.y * axis.x - s * axis.z, c + t.y * axis.y, t.y * axis.z + s * axis.x, 0.0f);
+	columns[2] = _mm_setr_ps(t.z * axis.x + s * axis.y, t.z * axis.y - s * axis.x, c + t.z * axis.z, 0.0f);
+	columns[3] = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+// a * b on column matrices. Each result column is a's columns weighted by b's column
+static void MultiplyColumns(const __m128 a[4], const __m128 b[4], __m128 result[4]) {
+	for (int j = 0; j < 4; j++) {
+		__m128 x = _mm_shuffle_ps(b[j], b[j], _MM_SHUFFLE(0, 0, 0, 0));
+		__m128 y = _mm_shuffle_ps(b[j], b[j], _MM_SHUFFLE(1, 1, 1, 1));
+		__m128 z = _mm_shuffle_ps(b[j], b[j], _MM_SHUFFLE(2, 2, 2, 2));
+		__m128 w = _mm_shuffle_ps(b[j], b[j], _MM_SHUFFLE(3, 3, 3, 3));
+		result[j] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], x), _mm_mul_ps(a[1], y)),
+			_mm_add_ps(_mm_mul_ps(a[2], z), _mm_mul_ps(a[3], w)));
+	}
+}
+#endif
+
+glm::mat4 TransformSystem::Compose(const Transform& transform, float scaleOffset) {
+	glm::vec3 scale = transform.scale + glm::vec3(scaleOffset);
+
+#ifdef TRANSFORM_SIMD
+	__m128 rotationX[4], rotationY[4], rotationZ[4], rotationXY[4], rotation[4];
+	AxisRotation(glm::radians(transform.rotation.x), glm::vec3(1.0f, 0.0f, 0.0f), rotationX);
+	AxisRotation(glm::radians(transform.rotation.y), glm::vec3(0.0f, 1.0f, 0.0f), rotationY);
+	AxisRotation(glm::radians(transform.rotation.z), glm::vec3(1.0f, 0.0f, 1.0f), rotationZ);
+	MultiplyColumns(rotationX, rotationY, rotationXY);
+	MultiplyColumns(rotationXY, rotationZ, rotation);
+
+	// Translation only touches the last column, the scale on the left scales every column's rows
+	__m128 scaleRows = _mm_setr_ps(scale.x, scale.y, scale.z, 0.0f);
+	glm::mat4 world;
+	for (int j = 0; j < 3; j++) {
+		_mm_storeu_ps(&world[j][0], _mm_mul_ps(rotation[j], scaleRows));
+	}
+	_mm_storeu_ps(&world[3][0], _mm_setr_ps(transform.position.x, transform.position.y, transform.position.z, 1.0f));
+	return world;
+#else
+	glm::mat4 world = glm::translate(glm::mat4(1.0f), transform.position);
+	world = glm::scale(world, scale);
+	world = glm::rotate(world, glm::radians(transform.rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+	world = glm::rotate(world, glm::radians(transform.rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+	world = glm::rotate(world, glm::radians(transform.rotation.z), glm::vec3(1.0f, 0.0f, 1.0f));
+	return world;
+#endif
+}
+
+glm::mat4 TransformSystem::Multiply(const glm::mat4& a, const glm::mat4& b) {
+#ifdef TRANSFORM_SIMD
+	__m128 aColumns[4], bColumns[4], result[4];
+	for (int j = 0; j < 4; j++) {
+		aColumns[j] = _mm_loadu_ps(&a[j][0]);
+		bColumns[j] = _mm_loadu_ps(&b[j][0]);
+	}
+	MultiplyColumns(aColumns, bColumns, result);
+
+	glm::mat4 product;
+	for (int j = 0; j < 4; j++) {
+		_mm_storeu_ps(&product[j][0], result[j]);
+	}
+	return product;
+#else
+	return a * b;
+#endif
+}
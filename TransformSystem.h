@@ -0,0 +1,110 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+#include "JobSystem.h"
+
+struct Transform;
+
+// Scene graph of world matrices. Entries have a local transform relative to an optional parent, either a
+// Transform (shapes) or a fixed matrix (imported model nodes). Entries are stored breadth-first in contiguous
+// arrays, so every parent comes before its children and propagation is one linear pass, level by level.
+// Only dirty entries and the subtrees under them are recomputed: dirtied by the editor changing a transform,
+// or by the scale offset (the audio-reactive pulse) changing. Last frame's matrices are kept for motion vectors
+class TransformSystem
+{
+public:
+	typedef unsigned int Handle;
+	static constexpr Handle NO_PARENT = UINT_MAX;
+
+	struct Stats {
+		int entries = 0;
+		int updated = 0;
+		int levels = 0;
+	};
+
+	// Copy of the matrices as of the last Update, looked up by handle like the system itself
+	struct Snapshot {
+		std::vector<unsigned int> indices;
+		std::vector<glm::mat4> world, prevWorld;
+
+		const glm::mat4& GetWorld(Handle handle) const { return world[indices[handle]]; }
+		const glm::mat4& GetPrevWorld(Handle handle) const { return prevWorld[indices[handle]]; }
+	};
+
+	explicit TransformSystem(JobSystem* pJobSystem);
+
+	// New entries have no motion on their first frame
+	Handle Add(const Transform& transform, Handle parent = NO_PARENT);
+	Handle Add(const glm::mat4& local, Handle parent = NO_PARENT);
+
+	// Children of a removed entry become roots
+	void Remove(Handle handle);
+
+	// The local transform is kept, so the world matrix follows the new parent. Fails if parent is in handle's subtree
+	bool SetParent(Handle handle, Handle parent);
+	Handle GetParent(Handle handle) const;
+
+	// Copies the local transform in, to be recomposed on the next Update
+	void SetLocal(Handle handle, const Transform& transform);
+	void SetLocal(Handle handle, const glm::mat4& local);
+
+	// Added to the scale of every entry with a Transform
+	void SetScaleOffset(float offset);
+
+	// Recomputes dirty subtrees, each level split over the job system
+	void Update();
+
+	const glm::mat4& GetWorld(Handle handle) const;
+	const glm::mat4& GetPrevWorld(Handle handle) const;
+	const Stats& GetStats() const;
+
+	// For readers on another thread while the next frame updates. Reuses the snapshot's storage
+	void Capture(Snapshot& snapshot) const;
+
+	// translate * scale * rotate x * rotate y * rotate around (1, 0, 1), rotations in degrees.
+	// Uses SSE where available, same result as the glm calls
+	static glm::mat4 Compose(const Transform& transform, float scaleOffset);
+	static glm::mat4 Multiply(const glm::mat4& a, const glm::mat4& b);
+
+private:
+	enum Flags : uint8_t {
+		DIRTY = 1,
+		// World matrix recomputed by the latest Update that reached it. Children read it to know their
+		// parent moved; on the next Update the entry's own previous matrix catches up
+		CHANGED = 2,
+		NEW = 4,
+		// Local matrix comes from a Transform
+		COMPOSED = 8
+	};
+
+	Handle AddEntry(const Transform& transform, const glm::mat4& local, uint8_t flags, Handle parent);
+
+	// Restores breadth-first order after the hierarchy changed
+	void Rebuild();
+
+	JobSystem* mJobSystem;
+
+	// Indexed by handle. Removed handles are reused by the next Add
+	std::vector<unsigned int> mDenseIndices;
+	std::vector<Handle> mParentHandles;
+	std::vector<Handle> mFreeHandles;
+
+	// Indexed in breadth-first order. mParents holds the parent's index in these arrays, -1 for roots
+	std::vector<Handle> mHandles;
+	std::vector<int> mParents;
+	std::vector<Transform> mTransforms;
+	std::vector<glm::mat4> mLocal, mWorld, mPrevWorld;
+	std::vector<uint8_t> mFlags;
+
+	// First index of each depth level, then the entry count
+	std::vector<size_t> mLevelStarts;
+	bool mOrderDirty;
+
+	float mScaleOffset;
+	Stats mStats;
+};
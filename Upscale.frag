@@ -0,0 +1,31 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// Upscales the part of sourceTexture the scene was rendered into (uvScale of it) to the whole target.
+// Bilinear, then a 5-tap sharpen limited to the local min/max so edges don't ring
+uniform sampler2D sourceTexture;
+uniform vec2 uvScale;
+uniform float sharpness;
+
+void main()
+{
+	vec2 texel = 1.0 / vec2(textureSize(sourceTexture, 0));
+
+	// Taps stay inside the rendered region, the rest of the texture holds stale pixels
+	vec2 maxUV = uvScale - 0.5 * texel;
+	vec2 uv = min(TexCoords * uvScale, maxUV);
+
+	vec3 center = texture(sourceTexture, uv).rgb;
+	vec3 north = texture(sourceTexture, min(uv + vec2(0.0, texel.y), maxUV)).rgb;
+	vec3 south = texture(sourceTexture, uv - vec2(0.0, texel.y)).rgb;
+	vec3 east = texture(sourceTexture, min(uv + vec2(texel.x, 0.0), maxUV)).rgb;
+	vec3 west = texture(sourceTexture, uv - vec2(texel.x, 0.0)).rgb;
+
+	vec3 minColor = min(center, min(min(north, south), min(east, west)));
+	vec3 maxColor = max(center, max(max(north, south), max(east, west)));
+
+	vec3 color = center + sharpness * (4.0 * center - north - south - east - west);
+	FragColor = vec4(clamp(color, minColor, maxColor), 1.0);
+}
@@ -13,12 +13,24 @@
 #include "ResourceManager.h"
 #include "AudioPlayer.h"
 #include "Camera.h"
+#include "RenderThread.h"
+#include "MemoryTracker.h"
+#include "ShaderCache.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 
 const int SCREEN_WIDTH = 1920;
 const int SCREEN_HEIGHT = 1080;
 
+// Frame snapshots handed to a separate render thread, so the main thread prepares the next frame while
+// the last one is submitted. 2 double-buffers the handoff, 3 lets the main thread get two frames ahead.
+// 0 renders on the main thread
+const int RENDER_THREAD_SNAPSHOTS = 0;
+
+// Current framebuffer size, in pixels (larger than the window size on high DPI displays)
+int framebufferWidth = SCREEN_WIDTH;
+int framebufferHeight = SCREEN_HEIGHT;
+
 float lastX = SCREEN_WIDTH / 2.0f;
 float lastY = SCREEN_HEIGHT / 2.0f;
 bool firstMouse = true;
@@ -28,8 +40,6 @@ int main() {
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
@@ -38,7 +48,17 @@ int main() {
 
     // glfw window creation
     // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "A Sussy GFX Engine", NULL, NULL);
+    // 4.6 for GPU culling and multi-draw indirect, 3.3 is enough for everything else
+    GLFWwindow* window = NULL;
+    const int contextVersions[][2] = { { 4, 6 }, { 3, 3 } };
+    for (const auto& version : contextVersions)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+        window = glfwCreateWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "A Sussy GFX Engine", NULL, NULL);
+        if (window != NULL)
+            break;
+    }
     if (window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
@@ -56,35 +76,90 @@ int main() {
         return -1;
     }
 
+    ShaderCache::Init("../resources/shader_cache");
+
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+
     ResourceManager* pResourceManager = new ResourceManager();
     AudioPlayer* pAudioHandler = new AudioPlayer();
 
     pAudioHandler->Init();
 
-    Renderer* pRenderer = new Renderer(SCREEN_WIDTH, SCREEN_HEIGHT, pResourceManager->GetCubeMap("Default"), pResourceManager);
+    // Shaders build in the background while the renderer sets up and the model loads
+    double loadStart = glfwGetTime();
+    Shader::BeginBatch();
+
+    Renderer* pRenderer;
+    {
+        MemoryScope memoryScope(MemoryCategory::RENDERER);
+        pRenderer = new Renderer(framebufferWidth, framebufferHeight, pResourceManager->GetCubeMap("Default"), pResourceManager);
+    }
+    Shader::PollBatch();
     Editor* pEditor = new Editor(window);
 
     Camera* pCamera = new Camera(glm::vec3(0.0f, 0.0f, 3.0f));
 
     srand(time(NULL));
 
-    pRenderer->AddShape("PBR Shape", new Shape(pResourceManager, ShapeShading::PBR, "Sphere"));
-    pRenderer->AddShape("Light Source", new Shape(pResourceManager, ShapeShading::LIGHT, "Sphere"));
+    {
+        MemoryScope memoryScope(MemoryCategory::SCENE);
+        pRenderer->AddShape("PBR Shape", new Shape(pResourceManager, ShapeShading::PBR, "Sphere"));
+        pRenderer->AddShape("Light Source", new Shape(pResourceManager, ShapeShading::LIGHT, "Sphere"));
+    }
 
     pRenderer->AddModel("Backpack", "../resources/objects/backpack/backpack.obj", pResourceManager);
+
+    Shader::EndBatch();
+    {
+        // Cold when every program had to be compiled, warm when they all came from the binary cache
+        const Shader::BuildStats& shaderStats = Shader::GetBuildStats();
+        const char* startKind = shaderStats.cachedPrograms == 0 ? "cold" : shaderStats.cachedPrograms == shaderStats.programs ? "warm" : "partly cached";
+        std::cout << "Loaded in " << (glfwGetTime() - loadStart) * 1000.0 << " ms (" << startKind << "), "
+            << shaderStats.programs << " shader programs, " << shaderStats.milliseconds << " ms of it building or waiting for them, "
+            << shaderStats.cachedPrograms << " from the binary cache"
+            << (shaderStats.parallelCompile ? ", compiled in parallel" : "") << std::endl;
+    }
+
+    // Loading is done, GL is only used from the render loop from here on
+    RenderThread* pRenderThread = NULL;
+    if (RENDER_THREAD_SNAPSHOTS > 0)
+        pRenderThread = new RenderThread(window, pRenderer, pEditor, RENDER_THREAD_SNAPSHOTS);
     
     // Render loop
     // -----------
     while (!glfwWindowShouldClose(window))
     {
+        // Nothing to draw into while minimized
+        if (framebufferWidth == 0 || framebufferHeight == 0) {
+            glfwWaitEvents();
+            continue;
+        }
+
         pCamera->Update();
-        pRenderer->Draw(SCREEN_WIDTH, SCREEN_HEIGHT, pCamera, pAudioHandler);
-        pEditor->Update(pRenderer, pResourceManager, pAudioHandler, pCamera);
 
-        glfwSwapBuffers(window);
+        if (pRenderThread) {
+            FrameSnapshot* pFrame = pRenderThread->BeginFrame();
+            {
+                std::lock_guard<std::mutex> lock(pRenderThread->GetRendererMutex());
+                pEditor->Update(pRenderer, pResourceManager, pAudioHandler, pCamera);
+            }
+            pFrame->ui.Capture(ImGui::GetDrawData());
+            pRenderer->Prepare(*pFrame, framebufferWidth, framebufferHeight, pCamera, pAudioHandler);
+            pRenderThread->EndFrame(pFrame);
+        }
+        else {
+            pRenderer->Draw(framebufferWidth, framebufferHeight, pCamera, pAudioHandler);
+            pEditor->Update(pRenderer, pResourceManager, pAudioHandler, pCamera);
+            pEditor->Render(ImGui::GetDrawData());
+
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
     }
 
+    // Takes the context back for the cleanup below
+    delete pRenderThread;
+
     delete pRenderer;
     delete pResourceManager;
     delete pEditor;
@@ -97,7 +172,8 @@ int main() {
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-    // make sure the viewport matches the new window dimensions; note that width and 
+    // The renderer sets its own viewports and resizes its targets from this; note that width and 
     // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
+    framebufferWidth = width;
+    framebufferHeight = height;
 }
\ No newline at end of file